@@ -1,10 +1,12 @@
-#include <jsc/jsc.h>
 #include <webkit/webkit.h>
 
 #include "bridge/bridge-object.h"
 #include "bridge/utils.h"
 #include "browser-web-view.h"
-#include "utils/utils.h"
+#include "browser.h"
+#include "watchdog.h"
+
+extern GPtrArray *greeter_browsers;
 
 G_DEFINE_TYPE(BridgeObject, bridge_object, G_TYPE_OBJECT)
 
@@ -134,21 +136,14 @@ bridge_object_handle_property(
     if (g_strcmp0(current->name, method) == 0) {
 
       if (parameters->len > 0) {
-        JSCValue *param = parameters->pdata[0];
-        ((void (*)(JSCValue *, BrowserWebView *)) current->setter)(param, web_view);
+        GVariant *param = parameters->pdata[0];
+        ((void (*)(GVariant *, BrowserWebView *)) current->setter)(param, web_view);
         WebKitUserMessage *empty_msg = webkit_user_message_new("", NULL);
         webkit_user_message_send_reply(message, empty_msg);
         break;
       }
 
-      g_autoptr(JSCValue) jsc_value = ((JSCValue * (*) (BrowserWebView * web_view)) current->getter)(web_view);
-      g_autofree gchar *json_value = g_strdup("undefined");
-      if (JSC_IS_VALUE(jsc_value)) {
-        json_value = jsc_value_to_json(jsc_value, 0);
-      }
-      /*printf("JSON value: '%s'\n", json_value);*/
-
-      GVariant *value = g_variant_new_string(json_value);
+      GVariant *value = ((GVariant * (*) (BrowserWebView * web_view)) current->getter)(web_view);
       WebKitUserMessage *reply = webkit_user_message_new("reply", value);
 
       webkit_user_message_send_reply(message, reply);
@@ -171,16 +166,12 @@ bridge_object_handle_method(
     struct JSCClassMethod *current = self->methods->pdata[i];
     /*printf("Current: %d - %s\n", i, current->name);*/
 
+    if (g_strcmp0(current->name, method) == 0 && current->return_type == BRIDGE_METHOD_ASYNC) {
+      ((void (*)(GPtrArray *, BrowserWebView *, WebKitUserMessage *)) current->callback)(parameters, web_view, message);
+      break;
+    }
     if (g_strcmp0(current->name, method) == 0) {
-      g_autoptr(JSCValue) jsc_value
-          = ((JSCValue * (*) (GPtrArray *, BrowserWebView *) ) current->callback)(parameters, web_view);
-      g_autofree gchar *json_value = g_strdup("undefined");
-      if (JSC_IS_VALUE(jsc_value)) {
-        json_value = jsc_value_to_json(jsc_value, 0);
-      }
-      /*printf("JSON value: '%s'\n", json_value);*/
-
-      GVariant *value = g_variant_new_string(json_value);
+      GVariant *value = ((GVariant * (*) (GPtrArray *, BrowserWebView *) ) current->callback)(parameters, web_view);
       WebKitUserMessage *reply = webkit_user_message_new("reply", value);
 
       webkit_user_message_send_reply(message, reply);
@@ -200,40 +191,76 @@ bridge_object_handle_accessor(BridgeObject *self, BrowserWebView *web_view, WebK
   g_autoptr(WebKitUserMessage) empty_msg = webkit_user_message_new("", NULL);
   GVariant *msg_param = webkit_user_message_get_parameters(message);
 
-  if (!g_variant_is_of_type(msg_param, G_VARIANT_TYPE_ARRAY)) {
-    webkit_user_message_send_reply(message, empty_msg);
-    return;
-  }
-  int parameters_length = g_variant_n_children(msg_param);
-  if (parameters_length == 0 || parameters_length > 2) {
+  if (msg_param == NULL || !g_variant_is_of_type(msg_param, G_VARIANT_TYPE("(sav)"))) {
     webkit_user_message_send_reply(message, empty_msg);
     return;
   }
 
-  JSCContext *context = get_global_context();
-
-  GVariant *method_var = g_variant_get_child_value(msg_param, 0);
-  GVariant *params_var = g_variant_get_child_value(msg_param, 1);
-
-  const gchar *method = g_variant_to_string(method_var);
-  const gchar *json_params = g_variant_to_string(params_var);
+  const gchar *method = NULL;
+  g_autoptr(GVariant) arguments = NULL;
+  g_variant_get(msg_param, "(&s@av)", &method, &arguments);
   /*printf("Handling: '%s.%s'\n", name, method);*/
-  /*printf("JSON params: '%s'\n", json_params);*/
-
-  g_variant_unref(method_var);
-  g_variant_unref(params_var);
-  if (method == NULL) {
-    webkit_user_message_send_reply(message, empty_msg);
-    return;
-  }
-  g_autoptr(JSCValue) parameters = jsc_value_new_from_json(context, json_params);
+  WATCHDOG_SCOPE("%s.%s", name, method);
 
-  g_autoptr(GPtrArray) g_array = jsc_array_to_g_ptr_array(parameters);
+  g_autoptr(GPtrArray) g_array = g_variant_array_to_g_ptr_array(arguments);
 
   bridge_object_handle_property(self, message, method, g_array, web_view);
   bridge_object_handle_method(self, message, method, g_array, web_view);
 }
 
+/**
+ * Replies to a method call, used by BRIDGE_METHOD_ASYNC methods once they finish
+ * @param message The WebKitUserMessage received with the call
+ * @param value The reply value
+ */
+void
+bridge_object_reply(WebKitUserMessage *message, GVariant *value)
+{
+  WebKitUserMessage *reply = webkit_user_message_new("reply", value);
+  webkit_user_message_send_reply(message, reply);
+}
+
+/**
+ * Sends a signal of this object to a single web page
+ * @param self The BridgeObject
+ * @param web_view The BrowserWebView of the page
+ * @param signal The signal name
+ * @param arguments An "av" GVariant with the signal arguments, or NULL
+ */
+void
+bridge_object_send(BridgeObject *self, BrowserWebView *web_view, const gchar *signal, GVariant *arguments)
+{
+  if (arguments == NULL)
+    arguments = g_variant_new_array(G_VARIANT_TYPE_VARIANT, NULL, 0);
+
+  GVariant *parameters = g_variant_new("(s@av)", signal, arguments);
+  WebKitUserMessage *message = webkit_user_message_new(self->name, parameters);
+  webkit_web_view_send_message_to_page(WEBKIT_WEB_VIEW(web_view), message, NULL, NULL, NULL);
+}
+
+/**
+ * Emits a signal of this object to every greeter web page
+ * @param self The BridgeObject
+ * @param signal The signal name
+ * @param arguments An "av" GVariant with the signal arguments, or NULL
+ */
+void
+bridge_object_emit(BridgeObject *self, const gchar *signal, GVariant *arguments)
+{
+  if (arguments == NULL)
+    arguments = g_variant_new_array(G_VARIANT_TYPE_VARIANT, NULL, 0);
+  g_variant_ref_sink(arguments);
+
+  for (guint i = 0; i < greeter_browsers->len; i++) {
+    Browser *browser = greeter_browsers->pdata[i];
+    GVariant *parameters = g_variant_new("(s@av)", signal, arguments);
+    WebKitUserMessage *message = webkit_user_message_new(self->name, parameters);
+    webkit_web_view_send_message_to_page(WEBKIT_WEB_VIEW(browser->web_view), message, NULL, NULL, NULL);
+  }
+
+  g_variant_unref(arguments);
+}
+
 BridgeObject *
 bridge_object_new(const gchar *name)
 {
@@ -9,6 +9,12 @@
 
 G_BEGIN_DECLS
 
+/**
+ * Return type of methods that reply later with bridge_object_reply(),
+ * their callback also gets the WebKitUserMessage to reply to
+ */
+#define BRIDGE_METHOD_ASYNC G_TYPE_POINTER
+
 #define BRIDGE_TYPE_OBJECT bridge_object_get_type()
 G_DECLARE_FINAL_TYPE(BridgeObject, bridge_object, BRIDGE, OBJECT, GObject)
 
@@ -22,6 +28,11 @@ struct _BridgeObject {
 
 void bridge_object_handle_accessor(BridgeObject *self, BrowserWebView *web_view, WebKitUserMessage *message);
 
+void bridge_object_reply(WebKitUserMessage *message, GVariant *value);
+
+void bridge_object_emit(BridgeObject *self, const gchar *signal, GVariant *arguments);
+void bridge_object_send(BridgeObject *self, BrowserWebView *web_view, const gchar *signal, GVariant *arguments);
+
 BridgeObject *bridge_object_new(const gchar *name);
 
 BridgeObject *bridge_object_new_full(
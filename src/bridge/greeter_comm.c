@@ -1,6 +1,5 @@
 #include <unistd.h>
 
-#include <jsc/jsc.h>
 #include <webkit/webkit.h>
 
 #include "bridge/bridge-object.h"
@@ -8,61 +7,58 @@
 #include "browser-web-view.h"
 
 #include "browser.h"
-#include "utils/utils.h"
-
-extern GPtrArray *greeter_browsers;
 
 static BridgeObject *GreeterComm_object = NULL;
 
-static void *
+static GVariant *
 GreeterComm_broadcast_cb(GPtrArray *arguments)
 {
-  JSCContext *context = get_global_context();
-
-  for (guint i = 0; i < greeter_browsers->len; i++) {
-    GVariant *parameters = jsc_parameters_to_g_variant_array(context, "_emit", arguments);
-    WebKitUserMessage *message = webkit_user_message_new("greeter_comm", parameters);
-
-    Browser *browser = greeter_browsers->pdata[i];
-    webkit_web_view_send_message_to_page(WEBKIT_WEB_VIEW(browser->web_view), message, NULL, NULL, NULL);
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("av"));
+  for (guint i = 0; i < arguments->len; i++) {
+    g_variant_builder_add(&builder, "v", arguments->pdata[i]);
   }
 
+  bridge_object_emit(GreeterComm_object, "_emit", g_variant_builder_end(&builder));
+
   return NULL;
 }
-static JSCValue *
+static GVariant *
 GreeterComm_window_metadata_cb(GPtrArray *arguments, BrowserWebView *web_view)
 {
   (void) arguments;
-  JSCContext *context = get_global_context();
   Browser *browser = BROWSER_WINDOW(gtk_widget_get_parent(GTK_WIDGET(web_view)));
   if (browser == NULL) {
     return NULL;
   }
   WindowMetadata meta = browser->meta;
 
-  JSCValue *value = jsc_value_new_object(context, NULL, NULL);
-  jsc_value_object_set_property(value, "id", jsc_value_new_number(context, meta.id));
-  jsc_value_object_set_property(value, "is_primary", jsc_value_new_boolean(context, meta.is_primary));
-
-  JSCValue *position = jsc_value_new_object(context, NULL, NULL);
-  jsc_value_object_set_property(position, "x", jsc_value_new_number(context, meta.geometry.x));
-  jsc_value_object_set_property(position, "y", jsc_value_new_number(context, meta.geometry.y));
-
-  JSCValue *size = jsc_value_new_object(context, NULL, NULL);
-  jsc_value_object_set_property(size, "width", jsc_value_new_number(context, meta.geometry.width));
-  jsc_value_object_set_property(size, "height", jsc_value_new_number(context, meta.geometry.height));
-
-  JSCValue *overall_boundary = jsc_value_new_object(context, NULL, NULL);
-  jsc_value_object_set_property(overall_boundary, "minX", jsc_value_new_number(context, meta.overall_boundary.minX));
-  jsc_value_object_set_property(overall_boundary, "minY", jsc_value_new_number(context, meta.overall_boundary.minY));
-  jsc_value_object_set_property(overall_boundary, "maxX", jsc_value_new_number(context, meta.overall_boundary.maxX));
-  jsc_value_object_set_property(overall_boundary, "maxY", jsc_value_new_number(context, meta.overall_boundary.maxY));
-
-  jsc_value_object_set_property(value, "position", position);
-  jsc_value_object_set_property(value, "size", size);
-  jsc_value_object_set_property(value, "overallBoundary", overall_boundary);
-
-  return value;
+  GVariantBuilder position;
+  g_variant_builder_init(&position, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&position, "{sv}", "x", g_variant_new_int32(meta.geometry.x));
+  g_variant_builder_add(&position, "{sv}", "y", g_variant_new_int32(meta.geometry.y));
+
+  GVariantBuilder size;
+  g_variant_builder_init(&size, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&size, "{sv}", "width", g_variant_new_int32(meta.geometry.width));
+  g_variant_builder_add(&size, "{sv}", "height", g_variant_new_int32(meta.geometry.height));
+
+  GVariantBuilder overall_boundary;
+  g_variant_builder_init(&overall_boundary, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&overall_boundary, "{sv}", "minX", g_variant_new_int32(meta.overall_boundary.minX));
+  g_variant_builder_add(&overall_boundary, "{sv}", "minY", g_variant_new_int32(meta.overall_boundary.minY));
+  g_variant_builder_add(&overall_boundary, "{sv}", "maxX", g_variant_new_int32(meta.overall_boundary.maxX));
+  g_variant_builder_add(&overall_boundary, "{sv}", "maxY", g_variant_new_int32(meta.overall_boundary.maxY));
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&builder, "{sv}", "id", g_variant_new_uint64(meta.id));
+  g_variant_builder_add(&builder, "{sv}", "is_primary", g_variant_new_boolean(meta.is_primary));
+  g_variant_builder_add(&builder, "{sv}", "position", g_variant_builder_end(&position));
+  g_variant_builder_add(&builder, "{sv}", "size", g_variant_builder_end(&size));
+  g_variant_builder_add(&builder, "{sv}", "overallBoundary", g_variant_builder_end(&overall_boundary));
+
+  return g_variant_builder_end(&builder);
 }
 
 void
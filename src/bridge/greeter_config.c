@@ -1,6 +1,5 @@
 #include <unistd.h>
 
-#include <jsc/jsc.h>
 #include <lightdm-gobject-1/lightdm.h>
 #include <webkit/webkit.h>
 
@@ -8,82 +7,97 @@
 #include "bridge/lightdm-objects.h"
 #include "bridge/utils.h"
 
+#include "bridge/theme_utils.h"
+#include "browser.h"
+#include "logger.h"
 #include "settings.h"
+#include "theme.h"
+
+/* Wait for the configuration file to settle before reading it again */
+#define GREETER_CONFIG_RELOAD_DELAY 250
 
 static BridgeObject *GreeterConfig_object = NULL;
 
-static JSCValue *
-GreeterConfig_branding_getter_cb(void)
+static GFileMonitor *config_monitor = NULL;
+static guint reload_source_id = 0;
+static gboolean reloading = false;
+static gboolean reload_pending = false;
+
+extern GPtrArray *greeter_browsers;
+
+static GVariant *
+GreeterConfig_branding_to_GVariant(const GreeterConfig *config)
 {
-  JSCContext *context = get_global_context();
-  JSCValue *value = jsc_value_new_object(context, NULL, NULL);
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
 
-  const gchar *background_images_dir = greeter_config->branding->background_images_dir;
-  const gchar *logo_image = greeter_config->branding->logo_image;
-  const gchar *user_image = greeter_config->branding->user_image;
+  const gchar *background_images_dir = config->branding->background_images_dir;
+  const gchar *logo_image = config->branding->logo_image;
+  const gchar *user_image = config->branding->user_image;
 
-  jsc_value_object_set_property(value, "background_images_dir", jsc_value_new_string(context, background_images_dir));
-  jsc_value_object_set_property(value, "logo_image", jsc_value_new_string(context, logo_image));
-  jsc_value_object_set_property(value, "user_image", jsc_value_new_string(context, user_image));
-  return value;
+  VARDICT_ADD_STRING(&builder, "background_images_dir", background_images_dir);
+  VARDICT_ADD_STRING(&builder, "logo_image", logo_image);
+  VARDICT_ADD_STRING(&builder, "user_image", user_image);
+  return g_variant_builder_end(&builder);
 }
 
-static JSCValue *
-GreeterConfig_greeter_getter_cb(void)
+static GVariant *
+GreeterConfig_greeter_to_GVariant(const GreeterConfig *config)
 {
-  JSCContext *context = get_global_context();
-  JSCValue *value = jsc_value_new_object(context, NULL, NULL);
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
 
-  const gboolean debug_mode = greeter_config->greeter->debug_mode;
-  const gboolean detect_theme_errors = greeter_config->greeter->detect_theme_errors;
-  const gint screensaver_timeout = greeter_config->greeter->screensaver_timeout;
-  const gboolean secure_mode = greeter_config->greeter->secure_mode;
-  const gchar *theme = greeter_config->greeter->theme;
-  const gchar *icon_theme = greeter_config->greeter->icon_theme;
-  const gchar *time_language = greeter_config->greeter->time_language;
+  const gboolean debug_mode = config->greeter->debug_mode;
+  const gboolean detect_theme_errors = config->greeter->detect_theme_errors;
+  const gint screensaver_timeout = config->greeter->screensaver_timeout;
+  const gboolean secure_mode = config->greeter->secure_mode;
+  const gchar *theme = config->greeter->theme;
+  const gchar *icon_theme = config->greeter->icon_theme;
+  const gchar *time_language = config->greeter->time_language;
 
-  jsc_value_object_set_property(value, "debug_mode", jsc_value_new_boolean(context, debug_mode));
-  jsc_value_object_set_property(value, "detect_theme_errors", jsc_value_new_boolean(context, detect_theme_errors));
-  jsc_value_object_set_property(value, "screensaver_timeout", jsc_value_new_number(context, screensaver_timeout));
-  jsc_value_object_set_property(value, "secure_mode", jsc_value_new_boolean(context, secure_mode));
-  jsc_value_object_set_property(value, "theme", jsc_value_new_string(context, theme));
-  jsc_value_object_set_property(value, "icon_theme", jsc_value_new_string(context, icon_theme));
-  jsc_value_object_set_property(value, "time_language", jsc_value_new_string(context, time_language));
-  return value;
+  g_variant_builder_add(&builder, "{sv}", "debug_mode", g_variant_new_boolean(debug_mode));
+  g_variant_builder_add(&builder, "{sv}", "detect_theme_errors", g_variant_new_boolean(detect_theme_errors));
+  g_variant_builder_add(&builder, "{sv}", "screensaver_timeout", g_variant_new_int32(screensaver_timeout));
+  g_variant_builder_add(&builder, "{sv}", "secure_mode", g_variant_new_boolean(secure_mode));
+  VARDICT_ADD_STRING(&builder, "theme", theme);
+  VARDICT_ADD_STRING(&builder, "icon_theme", icon_theme);
+  VARDICT_ADD_STRING(&builder, "time_language", time_language);
+  return g_variant_builder_end(&builder);
 }
 
-static JSCValue *
-GreeterConfig_features_getter_cb(void)
+static GVariant *
+GreeterConfig_features_to_GVariant(const GreeterConfig *config)
 {
-  JSCContext *context = get_global_context();
-  JSCValue *value = jsc_value_new_object(context, NULL, NULL);
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
 
-  const gboolean battery = greeter_config->features->battery;
+  const gboolean battery = config->features->battery;
 
-  jsc_value_object_set_property(value, "battery", jsc_value_new_boolean(context, battery));
+  g_variant_builder_add(&builder, "{sv}", "battery", g_variant_new_boolean(battery));
 
-  JSCValue *backlight = jsc_value_new_object(context, NULL, NULL);
+  GVariantBuilder backlight;
+  g_variant_builder_init(&backlight, G_VARIANT_TYPE_VARDICT);
 
-  const gboolean backlight_enabled = greeter_config->features->backlight->enabled;
-  const gint backlight_value = greeter_config->features->backlight->value;
-  const gint backlight_steps = greeter_config->features->backlight->steps;
+  const gboolean backlight_enabled = config->features->backlight->enabled;
+  const gint backlight_value = config->features->backlight->value;
+  const gint backlight_steps = config->features->backlight->steps;
 
-  jsc_value_object_set_property(backlight, "enabled", jsc_value_new_boolean(context, backlight_enabled));
-  jsc_value_object_set_property(backlight, "value", jsc_value_new_number(context, backlight_value));
-  jsc_value_object_set_property(backlight, "steps", jsc_value_new_number(context, backlight_steps));
+  g_variant_builder_add(&backlight, "{sv}", "enabled", g_variant_new_boolean(backlight_enabled));
+  g_variant_builder_add(&backlight, "{sv}", "value", g_variant_new_int32(backlight_value));
+  g_variant_builder_add(&backlight, "{sv}", "steps", g_variant_new_int32(backlight_steps));
 
-  jsc_value_object_set_property(value, "backlight", backlight);
-  return value;
+  g_variant_builder_add(&builder, "{sv}", "backlight", g_variant_builder_end(&backlight));
+  return g_variant_builder_end(&builder);
 }
 
-static JSCValue *
-GreeterConfig_layouts_getter_cb(void)
+static GVariant *
+GreeterConfig_layouts_to_GVariant(const GreeterConfig *config)
 {
-  JSCContext *context = get_global_context();
-
   GList *layouts = lightdm_get_layouts();
-  GPtrArray *config_layouts = greeter_config->layouts;
-  g_autoptr(GPtrArray) final = g_ptr_array_new();
+  GPtrArray *config_layouts = config->layouts;
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
 
   GList *ldm_layout = layouts;
   while (ldm_layout != NULL) {
@@ -94,16 +108,224 @@ GreeterConfig_layouts_getter_cb(void)
 
       LightDMLayout *lay = ldm_layout->data;
       if (g_strcmp0(lightdm_layout_get_name(lay), str->str) == 0) {
-        JSCValue *val = LightDMLayout_to_JSCValue(context, lay);
+        GVariant *val = LightDMLayout_to_GVariant(lay);
         if (val != NULL)
-          g_ptr_array_add(final, val);
+          g_variant_builder_add_value(&builder, val);
       }
     }
     ldm_layout = ldm_layout->next;
   }
 
-  JSCValue *value = jsc_value_new_array_from_garray(context, final);
-  return value;
+  return g_variant_builder_end(&builder);
+}
+
+static GVariant *
+GreeterConfig_branding_getter_cb(void)
+{
+  return GreeterConfig_branding_to_GVariant(greeter_config);
+}
+static GVariant *
+GreeterConfig_greeter_getter_cb(void)
+{
+  return GreeterConfig_greeter_to_GVariant(greeter_config);
+}
+static GVariant *
+GreeterConfig_features_getter_cb(void)
+{
+  return GreeterConfig_features_to_GVariant(greeter_config);
+}
+static GVariant *
+GreeterConfig_layouts_getter_cb(void)
+{
+  return GreeterConfig_layouts_to_GVariant(greeter_config);
+}
+
+#define GREETER_CONFIG_SWAP(a, b) \
+  {                               \
+    gpointer tmp = a;             \
+    a = b;                        \
+    b = tmp;                      \
+  }
+
+/**
+ * Keep the current values of the options only read at startup
+ * secure_mode is compiled into the content filter, and cache_dir and
+ * cache_size into the network session, so changing them needs a restart
+ */
+static void
+GreeterConfig_keep_startup_options(GreeterConfig *config)
+{
+  GreeterConfigGreeter *current = greeter_config->greeter;
+  GreeterConfigGreeter *greeter = config->greeter;
+  const gchar *const no_allowlist[] = { NULL };
+  const gchar *const *current_allowlist
+      = current->secure_mode_allowlist != NULL ? (const gchar *const *) current->secure_mode_allowlist : no_allowlist;
+  const gchar *const *allowlist
+      = greeter->secure_mode_allowlist != NULL ? (const gchar *const *) greeter->secure_mode_allowlist : no_allowlist;
+
+  if (current->secure_mode != greeter->secure_mode || !g_strv_equal(current_allowlist, allowlist)
+      || g_strcmp0(current->cache_dir, greeter->cache_dir) != 0 || current->cache_size != greeter->cache_size) {
+    logger_warn("secure_mode, secure_mode_allowlist, cache_dir and cache_size changes need a restart");
+  }
+
+  greeter->secure_mode = current->secure_mode;
+  g_strfreev(greeter->secure_mode_allowlist);
+  greeter->secure_mode_allowlist = g_strdupv(current->secure_mode_allowlist);
+  g_free(greeter->cache_dir);
+  greeter->cache_dir = g_strdup(current->cache_dir);
+  greeter->cache_size = current->cache_size;
+}
+
+/**
+ * Take the sections of config that differ from the current configuration
+ * @Returns An "a{sv}" of the changed sections, with their new values
+ */
+static GVariant *
+GreeterConfig_take_changes(GreeterConfig *config, gboolean *theme_changed)
+{
+  GVariantBuilder changes;
+  g_variant_builder_init(&changes, G_VARIANT_TYPE_VARDICT);
+
+  GreeterConfig_keep_startup_options(config);
+
+  g_autoptr(GVariant) old_branding = g_variant_ref_sink(GreeterConfig_branding_to_GVariant(greeter_config));
+  g_autoptr(GVariant) new_branding = g_variant_ref_sink(GreeterConfig_branding_to_GVariant(config));
+  if (!g_variant_equal(old_branding, new_branding)) {
+    GREETER_CONFIG_SWAP(greeter_config->branding, config->branding);
+    g_variant_builder_add(&changes, "{sv}", "branding", new_branding);
+  }
+
+  g_autoptr(GVariant) old_greeter = g_variant_ref_sink(GreeterConfig_greeter_to_GVariant(greeter_config));
+  g_autoptr(GVariant) new_greeter = g_variant_ref_sink(GreeterConfig_greeter_to_GVariant(config));
+  *theme_changed = g_strcmp0(greeter_config->greeter->theme, config->greeter->theme) != 0;
+  if (!g_variant_equal(old_greeter, new_greeter)) {
+    GREETER_CONFIG_SWAP(greeter_config->greeter, config->greeter);
+    g_variant_builder_add(&changes, "{sv}", "greeter", new_greeter);
+  }
+
+  g_autoptr(GVariant) old_features = g_variant_ref_sink(GreeterConfig_features_to_GVariant(greeter_config));
+  g_autoptr(GVariant) new_features = g_variant_ref_sink(GreeterConfig_features_to_GVariant(config));
+  if (!g_variant_equal(old_features, new_features)) {
+    GREETER_CONFIG_SWAP(greeter_config->features, config->features);
+    g_variant_builder_add(&changes, "{sv}", "features", new_features);
+  }
+
+  g_autoptr(GVariant) old_layouts = g_variant_ref_sink(GreeterConfig_layouts_to_GVariant(greeter_config));
+  g_autoptr(GVariant) new_layouts = g_variant_ref_sink(GreeterConfig_layouts_to_GVariant(config));
+  if (!g_variant_equal(old_layouts, new_layouts)) {
+    GREETER_CONFIG_SWAP(greeter_config->layouts, config->layouts);
+    g_variant_builder_add(&changes, "{sv}", "layouts", new_layouts);
+  }
+
+  return g_variant_builder_end(&changes);
+}
+
+static void GreeterConfig_schedule_reload(void);
+
+static void
+GreeterConfig_read_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+  (void) source_object;
+  (void) task_data;
+  (void) cancellable;
+  g_task_return_pointer(task, read_configuration(), (GDestroyNotify) greeter_config_free);
+}
+
+/**
+ * Apply the configuration read again, and push the changed sections to every page
+ * Only a change of theme reloads the pages
+ */
+static void
+GreeterConfig_read_ready_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) source_object;
+  (void) user_data;
+  GreeterConfig *config = g_task_propagate_pointer(G_TASK(result), NULL);
+
+  reloading = false;
+  if (reload_pending) {
+    reload_pending = false;
+    GreeterConfig_schedule_reload();
+  }
+  if (config == NULL) {
+    logger_warn("Configuration was changed, but could not be read");
+    return;
+  }
+
+  gboolean theme_changed = false;
+  g_autoptr(GVariant) changes = g_variant_ref_sink(GreeterConfig_take_changes(config, &theme_changed));
+  greeter_config_free(config);
+  if (g_variant_n_children(changes) == 0)
+    return;
+  logger_debug("Configuration reloaded");
+
+  ThemeUtils_allow_dir(greeter_config->branding->background_images_dir);
+
+  GVariantBuilder arguments;
+  g_variant_builder_init(&arguments, G_VARIANT_TYPE("av"));
+  g_variant_builder_add(&arguments, "v", changes);
+  bridge_object_emit(GreeterConfig_object, "changed", g_variant_builder_end(&arguments));
+
+  if (!theme_changed)
+    return;
+
+  const ThemeDescriptor *descriptor = resolve_theme();
+  ThemeUtils_allow_dir(descriptor->dir);
+  for (guint i = 0; i < greeter_browsers->len; i++) {
+    Browser *browser = greeter_browsers->pdata[i];
+    load_theme(browser);
+  }
+}
+
+static gboolean
+GreeterConfig_reload_cb(gpointer user_data)
+{
+  (void) user_data;
+  reload_source_id = 0;
+
+  if (reloading) {
+    reload_pending = true;
+    return G_SOURCE_REMOVE;
+  }
+  reloading = true;
+
+  g_autoptr(GTask) task = g_task_new(NULL, NULL, GreeterConfig_read_ready_cb, NULL);
+  g_task_run_in_thread(task, GreeterConfig_read_thread);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+GreeterConfig_schedule_reload(void)
+{
+  if (reload_source_id != 0)
+    g_source_remove(reload_source_id);
+  reload_source_id = g_timeout_add(GREETER_CONFIG_RELOAD_DELAY, GreeterConfig_reload_cb, NULL);
+}
+
+static void
+GreeterConfig_file_changed_cb(
+    GFileMonitor *monitor,
+    GFile *file,
+    GFile *other_file,
+    GFileMonitorEvent event_type,
+    gpointer user_data)
+{
+  (void) monitor;
+  (void) file;
+  (void) other_file;
+  (void) user_data;
+
+  switch (event_type) {
+    case G_FILE_MONITOR_EVENT_CHANGED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      GreeterConfig_schedule_reload();
+      break;
+    default:
+      break;
+  }
 }
 
 void
@@ -115,6 +337,12 @@ handle_greeter_config_accessor(BrowserWebView *web_view, WebKitUserMessage *mess
 void
 GreeterConfig_destroy(void)
 {
+  if (reload_source_id != 0)
+    g_source_remove(reload_source_id);
+  if (config_monitor != NULL) {
+    g_file_monitor_cancel(config_monitor);
+    g_clear_object(&config_monitor);
+  }
   g_object_unref(GreeterConfig_object);
 }
 
@@ -122,10 +350,10 @@ void
 GreeterConfig_initialize(void)
 {
   const struct JSCClassProperty GreeterConfig_properties[] = {
-    { "branding", G_CALLBACK(GreeterConfig_branding_getter_cb), NULL, JSC_TYPE_VALUE },
-    { "greeter", G_CALLBACK(GreeterConfig_greeter_getter_cb), NULL, JSC_TYPE_VALUE },
-    { "features", G_CALLBACK(GreeterConfig_features_getter_cb), NULL, JSC_TYPE_VALUE },
-    { "layouts", G_CALLBACK(GreeterConfig_layouts_getter_cb), NULL, JSC_TYPE_VALUE },
+    { "branding", G_CALLBACK(GreeterConfig_branding_getter_cb), NULL, G_TYPE_VARIANT },
+    { "greeter", G_CALLBACK(GreeterConfig_greeter_getter_cb), NULL, G_TYPE_VARIANT },
+    { "features", G_CALLBACK(GreeterConfig_features_getter_cb), NULL, G_TYPE_VARIANT },
+    { "layouts", G_CALLBACK(GreeterConfig_layouts_getter_cb), NULL, G_TYPE_VARIANT },
   };
 
   GreeterConfig_object = bridge_object_new_full(
@@ -134,4 +362,13 @@ GreeterConfig_initialize(void)
       G_N_ELEMENTS(GreeterConfig_properties),
       NULL,
       0);
+
+  g_autoptr(GFile) config_file = g_file_new_for_path(GREETER_CONFIG_PATH);
+  g_autoptr(GError) error = NULL;
+  config_monitor = g_file_monitor_file(config_file, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+  if (config_monitor == NULL) {
+    logger_warn("Configuration changes will not be applied: %s", error->message);
+    return;
+  }
+  g_signal_connect(config_monitor, "changed", G_CALLBACK(GreeterConfig_file_changed_cb), NULL);
 }
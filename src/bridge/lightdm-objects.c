@@ -1,17 +1,21 @@
 #include <stdbool.h>
 #include <unistd.h>
 
-#include <jsc/jsc.h>
 #include <lightdm-gobject-1/lightdm.h>
 
 #include "bridge/utils.h"
 
-JSCValue *
-LightDMUser_to_JSCValue(JSCContext *context, LightDMUser *user)
+static GHashTable *layouts_index = NULL;
+
+/*
+ * LightDM objects are serialized to "a{sv}" dictionaries.
+ * Missing strings are sent as empty strings, as themes expect them to be set.
+ */
+GVariant *
+LightDMUser_to_GVariant(LightDMUser *user)
 {
   if (!LIGHTDM_IS_USER(user))
     return NULL;
-  JSCValue *value = jsc_value_new_object(context, NULL, NULL);
 
   const gchar *background = lightdm_user_get_background(user);
   const gchar *display_name = lightdm_user_get_display_name(user);
@@ -24,103 +28,133 @@ LightDMUser_to_JSCValue(JSCContext *context, LightDMUser *user)
   const gchar *session = lightdm_user_get_session(user);
   const gchar *username = lightdm_user_get_name(user);
 
-  GPtrArray *layouts_array = g_ptr_array_new();
-  int i = 0;
-  const gchar *curr;
-  while ((curr = layouts[i]) != NULL) {
-    g_ptr_array_add(layouts_array, jsc_value_new_string(context, curr));
-    i++;
-  }
-
-  jsc_value_object_set_property(value, "background", jsc_value_new_string(context, background));
-  jsc_value_object_set_property(value, "display_name", jsc_value_new_string(context, display_name));
-  jsc_value_object_set_property(value, "home_directory", jsc_value_new_string(context, home_directory));
-  jsc_value_object_set_property(value, "image", jsc_value_new_string(context, image));
-  jsc_value_object_set_property(value, "language", jsc_value_new_string(context, language));
-  jsc_value_object_set_property(value, "layout", jsc_value_new_string(context, layout));
-  jsc_value_object_set_property(value, "layouts", jsc_value_new_array_from_garray(context, layouts_array));
-  jsc_value_object_set_property(value, "logged_in", jsc_value_new_boolean(context, logged_in));
-  jsc_value_object_set_property(value, "session", jsc_value_new_string(context, session));
-  jsc_value_object_set_property(value, "username", jsc_value_new_string(context, username));
-
-  g_ptr_array_free(layouts_array, true);
-  return value;
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+  VARDICT_ADD_STRING(&builder, "background", background);
+  VARDICT_ADD_STRING(&builder, "display_name", display_name);
+  VARDICT_ADD_STRING(&builder, "home_directory", home_directory);
+  VARDICT_ADD_STRING(&builder, "image", image);
+  VARDICT_ADD_STRING(&builder, "language", language);
+  VARDICT_ADD_STRING(&builder, "layout", layout);
+  g_variant_builder_add(&builder, "{sv}", "layouts", g_variant_new_strv(layouts, -1));
+  g_variant_builder_add(&builder, "{sv}", "logged_in", g_variant_new_boolean(logged_in));
+  VARDICT_ADD_STRING(&builder, "session", session);
+  VARDICT_ADD_STRING(&builder, "username", username);
+
+  return g_variant_builder_end(&builder);
 }
 
-JSCValue *
-LightDMSession_to_JSCValue(JSCContext *context, LightDMSession *session)
+GVariant *
+LightDMSession_to_GVariant(LightDMSession *session)
 {
   if (!LIGHTDM_IS_SESSION(session))
     return NULL;
-  JSCValue *value = jsc_value_new_object(context, NULL, NULL);
 
   const gchar *comment = lightdm_session_get_comment(session);
   const gchar *key = lightdm_session_get_key(session);
   const gchar *name = lightdm_session_get_name(session);
   const gchar *type = lightdm_session_get_session_type(session);
 
-  jsc_value_object_set_property(value, "comment", jsc_value_new_string(context, comment));
-  jsc_value_object_set_property(value, "key", jsc_value_new_string(context, key));
-  jsc_value_object_set_property(value, "name", jsc_value_new_string(context, name));
-  jsc_value_object_set_property(value, "type", jsc_value_new_string(context, type));
-  return value;
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+  VARDICT_ADD_STRING(&builder, "comment", comment);
+  VARDICT_ADD_STRING(&builder, "key", key);
+  VARDICT_ADD_STRING(&builder, "name", name);
+  VARDICT_ADD_STRING(&builder, "type", type);
+
+  return g_variant_builder_end(&builder);
 }
-JSCValue *
-LightDMLanguage_to_JSCValue(JSCContext *context, LightDMLanguage *language)
+GVariant *
+LightDMLanguage_to_GVariant(LightDMLanguage *language)
 {
   if (!LIGHTDM_IS_LANGUAGE(language))
     return NULL;
-  JSCValue *value = jsc_value_new_object(context, NULL, NULL);
 
   const gchar *code = lightdm_language_get_code(language);
   const gchar *name = lightdm_language_get_name(language);
   const gchar *territory = lightdm_language_get_territory(language);
 
-  jsc_value_object_set_property(value, "code", jsc_value_new_string(context, code));
-  jsc_value_object_set_property(value, "name", jsc_value_new_string(context, name));
-  jsc_value_object_set_property(value, "territory", jsc_value_new_string(context, territory));
-  return value;
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+  VARDICT_ADD_STRING(&builder, "code", code);
+  VARDICT_ADD_STRING(&builder, "name", name);
+  VARDICT_ADD_STRING(&builder, "territory", territory);
+
+  return g_variant_builder_end(&builder);
 }
-JSCValue *
-LightDMLayout_to_JSCValue(JSCContext *context, LightDMLayout *layout)
+GVariant *
+LightDMLayout_to_GVariant(LightDMLayout *layout)
 {
   if (!LIGHTDM_IS_LAYOUT(layout))
     return NULL;
-  JSCValue *value = jsc_value_new_object(context, NULL, NULL);
 
   const gchar *name = lightdm_layout_get_name(layout);
   const gchar *description = lightdm_layout_get_description(layout);
   const gchar *short_description = lightdm_layout_get_short_description(layout);
 
-  jsc_value_object_set_property(value, "name", jsc_value_new_string(context, name));
-  jsc_value_object_set_property(value, "description", jsc_value_new_string(context, description));
-  jsc_value_object_set_property(value, "short_description", jsc_value_new_string(context, short_description));
-  return value;
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+  VARDICT_ADD_STRING(&builder, "name", name);
+  VARDICT_ADD_STRING(&builder, "description", description);
+  VARDICT_ADD_STRING(&builder, "short_description", short_description);
+
+  return g_variant_builder_end(&builder);
 }
 
+/**
+ * Get a LightDMLayout by its name
+ * The name index is built once, on first use, from lightdm_get_layouts()
+ */
 LightDMLayout *
-JSCValue_to_LightDMLayout(JSCContext *context, JSCValue *object)
+LightDMLayout_lookup(const gchar *name)
 {
-
-  if (!jsc_value_object_has_property(object, "name") || !jsc_value_object_has_property(object, "description")
-      || !jsc_value_object_has_property(object, "short_description")) {
-    jsc_context_throw(context, "Invalid LightDMLayout");
+  if (name == NULL)
     return NULL;
+
+  if (layouts_index == NULL) {
+    layouts_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    GList *curr = lightdm_get_layouts();
+    while (curr != NULL) {
+      LightDMLayout *layout = curr->data;
+      const gchar *layout_name = lightdm_layout_get_name(layout);
+      if (layout_name != NULL && !g_hash_table_contains(layouts_index, layout_name))
+        g_hash_table_insert(layouts_index, (gpointer) layout_name, layout);
+      curr = curr->next;
+    }
   }
 
-  gchar *name = js_value_to_string_or_null(jsc_value_object_get_property(object, "name"));
+  return g_hash_table_lookup(layouts_index, name);
+}
 
-  GList *layout_array = lightdm_get_layouts();
-  LightDMLayout *layout = NULL;
+void
+LightDMLayout_index_destroy(void)
+{
+  if (layouts_index == NULL)
+    return;
+  g_hash_table_destroy(layouts_index);
+  layouts_index = NULL;
+}
 
-  GList *curr = layout_array;
-  while (curr != NULL) {
-    if (g_strcmp0(lightdm_layout_get_name(curr->data), name) == 0) {
-      layout = curr->data;
-      break;
-    }
-    curr = curr->next;
+/**
+ * Get the LightDMLayout described by an "a{sv}" layout object
+ */
+LightDMLayout *
+GVariant_to_LightDMLayout(GVariant *object)
+{
+  if (object == NULL || !g_variant_is_of_type(object, G_VARIANT_TYPE_VARDICT))
+    return NULL;
+
+  g_autoptr(GVariant) name = g_variant_lookup_value(object, "name", G_VARIANT_TYPE_STRING);
+  g_autoptr(GVariant) description = g_variant_lookup_value(object, "description", G_VARIANT_TYPE_STRING);
+  g_autoptr(GVariant) short_description = g_variant_lookup_value(object, "short_description", G_VARIANT_TYPE_STRING);
+  if (name == NULL || description == NULL || short_description == NULL) {
+    return NULL;
   }
-  g_free(name);
-  return layout;
+
+  return LightDMLayout_lookup(g_variant_get_string(name, NULL));
 }
@@ -5,11 +5,13 @@
 #include <jsc/jsc.h>
 #include <lightdm-gobject-1/lightdm.h>
 
-JSCValue *LightDMSession_to_JSCValue(JSCContext *context, LightDMSession *session);
-JSCValue *LightDMUser_to_JSCValue(JSCContext *context, LightDMUser *user);
-JSCValue *LightDMLanguage_to_JSCValue(JSCContext *context, LightDMLanguage *language);
-JSCValue *LightDMLayout_to_JSCValue(JSCContext *context, LightDMLayout *layout);
-LightDMLayout *JSCValue_to_LightDMLayout(JSCContext *context, JSCValue *object);
+GVariant *LightDMSession_to_GVariant(LightDMSession *session);
+GVariant *LightDMUser_to_GVariant(LightDMUser *user);
+GVariant *LightDMLanguage_to_GVariant(LightDMLanguage *language);
+GVariant *LightDMLayout_to_GVariant(LightDMLayout *layout);
+LightDMLayout *GVariant_to_LightDMLayout(GVariant *object);
+LightDMLayout *LightDMLayout_lookup(const gchar *name);
+void LightDMLayout_index_destroy(void);
 
 typedef struct _LDMObject {
   JSCContext *context;
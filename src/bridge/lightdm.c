@@ -1,7 +1,6 @@
 #include <string.h>
 #include <unistd.h>
 
-#include <jsc/jsc.h>
 #include <lightdm-gobject-1/lightdm.h>
 #include <webkit/webkit.h>
 
@@ -10,9 +9,11 @@
 #include "bridge/utils.h"
 
 #include "browser.h"
+#include "image-cache.h"
 #include "lightdm/language.h"
 #include "logger.h"
-#include "utils/utils.h"
+#include "scheme.h"
+#include "watchdog.h"
 
 static LightDMGreeter *Greeter;
 static LightDMUserList *UserList;
@@ -20,26 +21,155 @@ extern guint64 page_id;
 
 GString *shared_data_directory;
 
-extern GPtrArray *greeter_browsers;
-
 static BridgeObject *LightDM_object = NULL;
 
+/* Thumbnail URI of each checked "<image>\n<size>", empty when the image is not readable */
+static GHashTable *LightDM_thumbnails = NULL;
+
+static void LightDM_notify_property_changes(void);
+
 /* LightDM Class definitions */
 
+typedef GVariant *(*LightDMObjectToGVariant)(gpointer object);
+
+/**
+ * Serialize a list of LightDM objects into an "aa{sv}" array
+ */
+static GVariant *
+LightDM_list_to_GVariant(GList *list, LightDMObjectToGVariant to_variant)
+{
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+
+  GList *curr = list;
+  while (curr != NULL) {
+    GVariant *value = to_variant(curr->data);
+    if (value != NULL)
+      g_variant_builder_add_value(&builder, value);
+    curr = curr->next;
+  }
+  return g_variant_builder_end(&builder);
+}
+
+static void
+LightDM_users_changed_cb(LightDMUserList *user_list, LightDMUser *user, gpointer user_data)
+{
+  (void) user_list;
+  (void) user;
+  (void) user_data;
+  g_hash_table_remove_all(LightDM_thumbnails);
+}
+
+/**
+ * Get the thumbnail URI of image, preparing it in the background the first time
+ * Images are checked again once the user list changes
+ */
+static const gchar *
+LightDM_get_thumbnail(const gchar *image, gint size)
+{
+  if (image == NULL || !g_path_is_absolute(image))
+    return "";
+
+  g_autofree gchar *key = g_strdup_printf("%s\n%d", image, size);
+  const gchar *thumbnail = g_hash_table_lookup(LightDM_thumbnails, key);
+  if (thumbnail != NULL)
+    return thumbnail;
+
+  gboolean readable = access(image, R_OK) == 0;
+  gchar *uri = readable ? scheme_avatar_uri_new(image, size) : g_strdup("");
+  if (readable)
+    image_cache_prewarm_avatar(image, size);
+  g_hash_table_insert(LightDM_thumbnails, g_steal_pointer(&key), uri);
+  return uri;
+}
+
+/**
+ * Serialize a user, adding a "thumbnail" URI for its image
+ * The thumbnail is prepared in the background so it is cached when the theme loads it
+ */
+static GVariant *
+LightDM_user_to_GVariant(LightDMUser *user)
+{
+  g_autoptr(GVariant) record = LightDMUser_to_GVariant(user);
+  if (record == NULL)
+    return NULL;
+  g_variant_ref_sink(record);
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+  g_variant_iter_init(&iter, record);
+  while (g_variant_iter_next(&iter, "{&sv}", &key, &value)) {
+    g_variant_builder_add(&builder, "{sv}", key, value);
+    g_variant_unref(value);
+  }
+
+  const gchar *thumbnail = LightDM_get_thumbnail(lightdm_user_get_image(user), IMAGE_CACHE_AVATAR_SIZE);
+  g_variant_builder_add(&builder, "{sv}", "thumbnail", g_variant_new_string(thumbnail));
+
+  return g_variant_builder_end(&builder);
+}
+
+/**
+ * Get a single image with the avatars of every user with an image,
+ * so a user grid is decoded once
+ * Returns { url, size, columns, offsets: { <username>: { x, y } } }
+ */
+static GVariant *
+LightDM_avatar_atlas_cb(GPtrArray *arguments)
+{
+  gint size = IMAGE_CACHE_AVATAR_SIZE;
+  if (arguments->len > 0 && g_variant_to_int32(arguments->pdata[0]) > 0)
+    size = MIN(g_variant_to_int32(arguments->pdata[0]), IMAGE_CACHE_MAX_AVATAR_SIZE);
+
+  g_autoptr(GPtrArray) paths = g_ptr_array_new();
+  g_autoptr(GPtrArray) usernames = g_ptr_array_new();
+  for (GList *curr = lightdm_user_list_get_users(UserList); curr != NULL; curr = curr->next) {
+    const gchar *image = lightdm_user_get_image(curr->data);
+    if (image == NULL || !g_path_is_absolute(image) || access(image, R_OK) != 0)
+      continue;
+    g_ptr_array_add(paths, (gpointer) image);
+    g_ptr_array_add(usernames, (gpointer) lightdm_user_get_name(curr->data));
+  }
+  g_ptr_array_add(paths, NULL);
+
+  g_autofree gchar *id = image_cache_atlas_new((const gchar *const *) paths->pdata, size);
+  g_autofree gchar *url = scheme_avatar_atlas_uri_new(id);
+  guint columns = image_cache_atlas_get_columns(usernames->len);
+
+  GVariantBuilder offsets;
+  g_variant_builder_init(&offsets, G_VARIANT_TYPE_VARDICT);
+  for (guint i = 0; i < usernames->len; i++) {
+    GVariantBuilder offset;
+    g_variant_builder_init(&offset, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&offset, "{sv}", "x", g_variant_new_int32((gint) (i % columns) * size));
+    g_variant_builder_add(&offset, "{sv}", "y", g_variant_new_int32((gint) (i / columns) * size));
+    g_variant_builder_add(&offsets, "{sv}", usernames->pdata[i], g_variant_builder_end(&offset));
+  }
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&builder, "{sv}", "url", g_variant_new_string(url));
+  g_variant_builder_add(&builder, "{sv}", "size", g_variant_new_int32(size));
+  g_variant_builder_add(&builder, "{sv}", "columns", g_variant_new_int32((gint) columns));
+  g_variant_builder_add(&builder, "{sv}", "offsets", g_variant_builder_end(&offsets));
+  return g_variant_builder_end(&builder);
+}
 /**
  * Starts the authentication procedure for a user
  * Provide a string to prompt for the password
  * Provide an empty string or NULL to prompt for the user
  */
-static JSCValue *
+static GVariant *
 LightDM_authenticate_cb(GPtrArray *arguments)
 {
-  JSCContext *context = get_global_context();
-
   gchar *user = NULL;
   if (arguments->len > 0) {
-    JSCValue *v = arguments->pdata[0];
-    user = js_value_to_string_or_null(v);
+    GVariant *v = arguments->pdata[0];
+    user = g_variant_to_string_or_null(v);
   }
   if (user && strcmp(user, "") == 0)
     user = NULL;
@@ -48,184 +178,197 @@ LightDM_authenticate_cb(GPtrArray *arguments)
   if (!lightdm_greeter_authenticate(Greeter, user, &err)) {
     logger_error("%s", err != NULL ? err->message : "Could not authenticate");
     g_free(user);
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
   g_free(user);
-  return jsc_value_new_boolean(context, true);
+  LightDM_notify_property_changes();
+  return g_variant_new_boolean(true);
 }
 /**
  * Starts the authentication procedure for the guest user
  */
-static JSCValue *
+static GVariant *
 LightDM_authenticate_as_guest_cb(GPtrArray *arguments)
 {
   (void) arguments;
-  JSCContext *context = get_global_context();
   GError *err = NULL;
   if (!lightdm_greeter_authenticate_as_guest(Greeter, &err)) {
     logger_error("%s", err != NULL ? err->message : "Could not authenticate as guest");
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
-  return jsc_value_new_boolean(context, true);
+  LightDM_notify_property_changes();
+  return g_variant_new_boolean(true);
 }
 /**
  * Cancel user authentication that is currently in progress
  */
-static JSCValue *
+static GVariant *
 LightDM_cancel_authentication_cb(GPtrArray *arguments)
 {
   (void) arguments;
-  JSCContext *context = get_global_context();
   GError *err = NULL;
   if (!lightdm_greeter_cancel_authentication(Greeter, &err)) {
     logger_error("%s", err != NULL ? err->message : "Could not cancel authentication");
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
-  return jsc_value_new_boolean(context, true);
+  LightDM_notify_property_changes();
+  return g_variant_new_boolean(true);
 }
 /**
  * Cancel the automatic login
  */
-static JSCValue *
+static GVariant *
 LightDM_cancel_autologin_cb(GPtrArray *arguments)
 {
   (void) arguments;
-  JSCContext *context = get_global_context();
   lightdm_greeter_cancel_autologin(Greeter);
-  return jsc_value_new_boolean(context, true);
+  return g_variant_new_boolean(true);
 }
 /**
  * Triggers the system to hibernate
  */
-static JSCValue *
+static GVariant *
 LightDM_hibernate_cb(GPtrArray *arguments)
 {
   (void) arguments;
-  JSCContext *context = get_global_context();
   GError *err = NULL;
   if (!lightdm_hibernate(&err)) {
     logger_error("%s", err != NULL ? err->message : "Could not hibernate");
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
-  return jsc_value_new_boolean(context, true);
+  return g_variant_new_boolean(true);
 }
 /**
  * Provides a response to a LightDM prompt
  * This could be either the user or the password
  * @param instance The lightdm object instance
- * @param arguments A pointer array to all JSCValue arguments
+ * @param arguments A pointer array to all GVariant arguments
  */
-static JSCValue *
+static GVariant *
 LightDM_respond_cb(GPtrArray *arguments)
 {
-  JSCContext *context = get_global_context();
-
   gchar *response = NULL;
   if (arguments->len == 0)
-    return jsc_value_new_boolean(context, false);
-  JSCValue *v = arguments->pdata[0];
-  response = js_value_to_string_or_null(v);
+    return g_variant_new_boolean(false);
+  GVariant *v = arguments->pdata[0];
+  response = g_variant_to_string_or_null(v);
 
   GError *err = NULL;
   if (!lightdm_greeter_respond(Greeter, response, &err)) {
     logger_error("%s", err != NULL ? err->message : "Could not provide a response");
     g_free(response);
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
   g_free(response);
-  return jsc_value_new_boolean(context, true);
+  LightDM_notify_property_changes();
+  return g_variant_new_boolean(true);
 }
 /**
  * Triggers the system to restart
  */
-static JSCValue *
+static GVariant *
 LightDM_restart_cb(GPtrArray *arguments)
 {
   (void) arguments;
-  JSCContext *context = get_global_context();
   GError *err = NULL;
   if (!lightdm_restart(&err)) {
     logger_error("%s", err != NULL ? err->message : "Could not restart");
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
-  return jsc_value_new_boolean(context, true);
+  return g_variant_new_boolean(true);
 }
 /**
  * Set the language for the currently authenticated user
  */
-static JSCValue *
+static GVariant *
 LightDM_set_language_cb(GPtrArray *arguments)
 {
-  JSCContext *context = get_global_context();
-
   gchar *language = NULL;
   if (arguments->len == 0)
-    return jsc_value_new_boolean(context, false);
-  JSCValue *v = arguments->pdata[0];
-  language = js_value_to_string_or_null(v);
+    return g_variant_new_boolean(false);
+  GVariant *v = arguments->pdata[0];
+  language = g_variant_to_string_or_null(v);
 
   GError *err = NULL;
   if (!lightdm_greeter_set_language(Greeter, language, &err)) {
     logger_error("%s", err != NULL ? err->message : "Could not set language");
     g_free(language);
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
   g_free(language);
-  return jsc_value_new_boolean(context, true);
+  LightDM_notify_property_changes();
+  return g_variant_new_boolean(true);
+}
+/**
+ * Set the currently active layout by its name
+ * Avoids marshaling a whole layout object just to select it
+ */
+static GVariant *
+LightDM_set_layout_by_name_cb(GPtrArray *arguments)
+{
+  if (arguments->len == 0)
+    return g_variant_new_boolean(false);
+  GVariant *v = arguments->pdata[0];
+  g_autofree gchar *name = g_variant_to_string_or_null(v);
+
+  LightDMLayout *layout = LightDMLayout_lookup(name);
+  if (layout == NULL) {
+    logger_error("Layout \"%s\" does not exist", name);
+    return g_variant_new_boolean(false);
+  }
+  lightdm_set_layout(layout);
+  LightDM_notify_property_changes();
+  return g_variant_new_boolean(true);
 }
 /**
  * Triggers the system to shutdown
  */
-static JSCValue *
+static GVariant *
 LightDM_shutdown_cb(GPtrArray *arguments)
 {
   (void) arguments;
-  JSCContext *context = get_global_context();
   GError *err = NULL;
   if (!lightdm_shutdown(&err)) {
     logger_error("%s", err != NULL ? err->message : "Could not shutdown");
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
-  return jsc_value_new_boolean(context, true);
+  return g_variant_new_boolean(true);
 }
 /**
  * Start a session for the authenticated user
  */
-static JSCValue *
+static GVariant *
 LightDM_start_session_cb(GPtrArray *arguments)
 {
-  JSCContext *context = get_global_context();
-
   gchar *session = NULL;
   if (arguments->len == 0)
-    return jsc_value_new_boolean(context, false);
-  JSCValue *v = arguments->pdata[0];
-  session = js_value_to_string_or_null(v);
+    return g_variant_new_boolean(false);
+  GVariant *v = arguments->pdata[0];
+  session = g_variant_to_string_or_null(v);
 
   GError *err = NULL;
   if (!lightdm_greeter_start_session_sync(Greeter, session, &err)) {
     logger_error("%s", err != NULL ? err->message : "Could not start session");
     g_free(session);
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
   // reset_screensaver();
   g_free(session);
-  return jsc_value_new_boolean(context, true);
+  return g_variant_new_boolean(true);
 }
 /**
  * Triggers the system to suspend/sleep
  */
-static JSCValue *
+static GVariant *
 LightDM_suspend_cb(GPtrArray *arguments)
 {
   (void) arguments;
-  JSCContext *context = get_global_context();
   GError *err = NULL;
   if (!lightdm_suspend(&err)) {
     logger_error("%s", err != NULL ? err->message : "Could not suspend");
-    return jsc_value_new_boolean(context, false);
+    return g_variant_new_boolean(false);
   }
-  return jsc_value_new_boolean(context, true);
+  return g_variant_new_boolean(true);
 }
 
 /* LightDM properties */
@@ -235,397 +378,378 @@ LightDM_suspend_cb(GPtrArray *arguments)
  * or NULL if no authentication is in progress
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_authentication_user_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   const gchar *user = lightdm_greeter_get_authentication_user(Greeter);
   if (user == NULL)
-    return jsc_value_new_null(context);
-  return jsc_value_new_string(context, user);
+    return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+  return g_variant_new_string(user);
 }
 /**
  * Get whether or not the guest account should be automatically logged
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_autologin_guest_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_greeter_get_autologin_guest_hint(Greeter);
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Get the number of seconds to wait before automatically loggin in
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_autologin_timeout_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gint value = lightdm_greeter_get_autologin_timeout_hint(Greeter);
-  return jsc_value_new_number(context, value);
+  return g_variant_new_int32(value);
 }
 /**
  * Get the username with which to automatically log in when the timer expires
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_autologin_user_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   const gchar *value = lightdm_greeter_get_autologin_user_hint(Greeter);
   if (value == NULL)
-    return jsc_value_new_null(context);
-  return jsc_value_new_string(context, value);
+    return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+  return g_variant_new_string(value);
 }
 /**
  * Get whether or not the greeter can make the system hibernate
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_can_hibernate_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_get_can_hibernate();
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Get whether or not the greeter can make the system restart
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_can_restart_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_get_can_restart();
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Get whether or not the greeter can make the system shutdown
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_can_shutdown_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_get_can_shutdown();
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Get whether or not the greeter can make the system suspend/sleep
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_can_suspend_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_get_can_suspend();
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 static int brightness = 85;
-static JSCValue *
+static GVariant *
 LightDM_brightness_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
-  return jsc_value_new_number(context, brightness);
+  return g_variant_new_int32(brightness);
 }
 static void *
-LightDM_brightness_setter_cb(JSCValue *object)
+LightDM_brightness_setter_cb(GVariant *object)
 {
-  brightness = jsc_value_to_int32(object);
+  brightness = g_variant_to_int32(object);
+  LightDM_notify_property_changes();
   return NULL;
 }
 /**
  * Get the name of the default session
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_default_session_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   const gchar *session = lightdm_greeter_get_default_session_hint(Greeter);
   if (session == NULL)
-    return jsc_value_new_null(context);
-  return jsc_value_new_string(context, session);
+    return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+  return g_variant_new_string(session);
 }
 /**
  * Get whether or not guest accounts are supported
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_has_guest_account_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean has_guest_account = lightdm_greeter_get_has_guest_account_hint(Greeter);
-  return jsc_value_new_boolean(context, has_guest_account);
+  return g_variant_new_boolean(has_guest_account);
 }
 /**
  * Get whether or not user accounts should be hidden
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_hide_users_hint_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean hide_users = lightdm_greeter_get_hide_users_hint(Greeter);
-  return jsc_value_new_boolean(context, hide_users);
+  return g_variant_new_boolean(hide_users);
 }
 /**
  * Get the system's hostname
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_hostname_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   const gchar *hostname = lightdm_get_hostname();
   if (hostname == NULL)
-    return jsc_value_new_null(context);
-  return jsc_value_new_string(context, hostname);
+    return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+  return g_variant_new_string(hostname);
 }
 /**
  * Get whether or not the greeter is in the process of authenticating
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_in_authentication_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_greeter_get_in_authentication(Greeter);
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Get whether or not the greeter has successfully authenticated
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_is_authenticated_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_greeter_get_is_authenticated(Greeter);
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Get the current language or NULL if no language
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_language_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   LightDMLanguage *language = lightdm_get_language();
 
   if (language == NULL) {
     GList *languages = lightdm_get_languages();
-    language = languages->data;
+    if (languages != NULL)
+      language = languages->data;
   }
   if (language == NULL) {
-    return jsc_value_new_string(context, "undefined");
+    return g_variant_new_string("undefined");
   }
 
-  JSCValue *object = LightDMLanguage_to_JSCValue(context, language);
-  return object;
+  return LightDMLanguage_to_GVariant(language);
 }
 /**
  * Get a list of languages to present to the user
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_languages_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   GList *languages = lightdm_get_languages();
-  GPtrArray *arr = g_ptr_array_new();
-  GList *curr = languages;
-  while (curr != NULL) {
-    JSCValue *language = LightDMLanguage_to_JSCValue(context, curr->data);
-    if (language != NULL)
-      g_ptr_array_add(arr, language);
-    curr = curr->next;
-  }
-  JSCValue *value = jsc_value_new_array_from_garray(context, arr);
-  g_ptr_array_free(arr, true);
-  return value;
+  return LightDM_list_to_GVariant(languages, (LightDMObjectToGVariant) LightDMLanguage_to_GVariant);
 }
 /**
  * Get the currently active layout for the selected user
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_layout_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   LightDMLayout *layout = lightdm_get_layout();
 
-  JSCValue *object = LightDMLayout_to_JSCValue(context, layout);
-  return object;
+  return LightDMLayout_to_GVariant(layout);
 }
 /**
  * Set the currently active layout for the selected user
  * @param instance The lightdm object instance
  */
 static void *
-LightDM_layout_setter_cb(JSCValue *object)
+LightDM_layout_setter_cb(GVariant *object)
 {
-  lightdm_get_layout();
-  JSCContext *context = get_global_context();
-  LightDMLayout *layout = JSCValue_to_LightDMLayout(context, object);
+  LightDMLayout *layout = GVariant_to_LightDMLayout(object);
+  if (layout == NULL) {
+    logger_error("Invalid LightDMLayout");
+    return NULL;
+  }
   lightdm_set_layout(layout);
+  LightDM_notify_property_changes();
   return NULL;
 }
 /**
  * Get a list of keyboard layouts to present to the user
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_layouts_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   GList *layouts = lightdm_get_layouts();
-  GPtrArray *arr = g_ptr_array_new();
-  GList *curr = layouts;
-  while (curr != NULL) {
-    JSCValue *layout = LightDMLayout_to_JSCValue(context, curr->data);
-    if (layout != NULL)
-      g_ptr_array_add(arr, layout);
-    curr = curr->next;
-  }
-  JSCValue *value = jsc_value_new_array_from_garray(context, arr);
-  g_ptr_array_free(arr, true);
-  return value;
+  return LightDM_list_to_GVariant(layouts, (LightDMObjectToGVariant) LightDMLayout_to_GVariant);
 }
 /**
  * Get whether or not the greeter was started as a lock screen
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_lock_hint_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_greeter_get_lock_hint(Greeter);
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Get a list of remote sessions
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_remote_sessions_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   GList *sessions = lightdm_get_remote_sessions();
-  GPtrArray *arr = g_ptr_array_new();
-  GList *curr = sessions;
-  while (curr != NULL) {
-    JSCValue *session = LightDMSession_to_JSCValue(context, curr->data);
-    if (session != NULL)
-      g_ptr_array_add(arr, session);
-    curr = curr->next;
-  }
-  JSCValue *value = jsc_value_new_array_from_garray(context, arr);
-  g_ptr_array_free(arr, true);
-  return value;
+  return LightDM_list_to_GVariant(sessions, (LightDMObjectToGVariant) LightDMSession_to_GVariant);
 }
 /**
  * Get whether or not the guest account should be selected by default
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_select_guest_hint_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_greeter_get_select_guest_hint(Greeter);
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Get the username to select by default
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_select_user_hint_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   const gchar *value = lightdm_greeter_get_select_user_hint(Greeter);
   if (value == NULL)
-    return jsc_value_new_null(context);
-  return jsc_value_new_string(context, value);
+    return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+  return g_variant_new_string(value);
 }
 /**
  * Get a list of available sessions
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_sessions_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   GList *sessions = lightdm_get_sessions();
-  GPtrArray *arr = g_ptr_array_new();
-  GList *curr = sessions;
-  while (curr != NULL) {
-    JSCValue *session = LightDMSession_to_JSCValue(context, curr->data);
-    if (session != NULL)
-      g_ptr_array_add(arr, session);
-    curr = curr->next;
-  }
-  JSCValue *value = jsc_value_new_array_from_garray(context, arr);
-  g_ptr_array_free(arr, true);
-  return value;
+  return LightDM_list_to_GVariant(sessions, (LightDMObjectToGVariant) LightDMSession_to_GVariant);
 }
 /**
  * Get the LightDM shared data directory
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_shared_data_directory_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   if (shared_data_directory->len == 0 || shared_data_directory->str == NULL)
-    return jsc_value_new_null(context);
-  return jsc_value_new_string(context, shared_data_directory->str);
+    return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+  return g_variant_new_string(shared_data_directory->str);
 }
 /**
  * Check if a manual login option should be shown
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_show_manual_login_hint_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_greeter_get_show_manual_login_hint(Greeter);
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Check if a remote login option should be shown
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_show_remote_login_hint_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   gboolean value = lightdm_greeter_get_show_remote_login_hint(Greeter);
-  return jsc_value_new_boolean(context, value);
+  return g_variant_new_boolean(value);
 }
 /**
  * Get a list of available users
  * @param instance The lightdm object instance
  */
-static JSCValue *
+static GVariant *
 LightDM_users_getter_cb(void)
 {
-  JSCContext *context = get_global_context();
   GList *users = lightdm_user_list_get_users(UserList);
-  GPtrArray *arr = g_ptr_array_new();
-  GList *curr = users;
-  while (curr != NULL) {
-    JSCValue *user = LightDMUser_to_JSCValue(context, curr->data);
-    if (user != NULL)
-      g_ptr_array_add(arr, user);
-    curr = curr->next;
+  return LightDM_list_to_GVariant(users, (LightDMObjectToGVariant) LightDM_user_to_GVariant);
+}
+
+/* LightDM property changes */
+
+typedef struct {
+  const gchar *name;
+  GVariant *(*getter)(void);
+  GVariant *value;
+} LightDMWatchedProperty;
+
+/**
+ * Properties themes used to poll, notified through "property_changed"
+ */
+static LightDMWatchedProperty LightDM_watched_properties[] = {
+  { "in_authentication", LightDM_in_authentication_getter_cb, NULL },
+  { "is_authenticated", LightDM_is_authenticated_getter_cb, NULL },
+  { "authentication_user", LightDM_authentication_user_getter_cb, NULL },
+  { "layout", LightDM_layout_getter_cb, NULL },
+  { "brightness", LightDM_brightness_getter_cb, NULL },
+  { "language", LightDM_language_getter_cb, NULL },
+};
+
+/**
+ * Compare the watched properties against their last known value
+ * and emit "property_changed" with the name and new value of each one that changed
+ */
+static void
+LightDM_notify_property_changes(void)
+{
+  for (guint i = 0; i < G_N_ELEMENTS(LightDM_watched_properties); i++) {
+    LightDMWatchedProperty *property = &LightDM_watched_properties[i];
+    GVariant *value = property->getter();
+    if (value == NULL)
+      value = g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+    g_variant_ref_sink(value);
+
+    if (property->value != NULL && g_variant_equal(property->value, value)) {
+      g_variant_unref(value);
+      continue;
+    }
+    gboolean first_snapshot = property->value == NULL;
+    g_clear_pointer(&property->value, g_variant_unref);
+    property->value = value;
+
+    if (first_snapshot || LightDM_object == NULL)
+      continue;
+
+    GVariant *arguments[] = {
+      g_variant_new_variant(g_variant_new_string(property->name)),
+      g_variant_new_variant(value),
+    };
+    bridge_object_emit(
+        LightDM_object,
+        "property_changed",
+        g_variant_new_array(G_VARIANT_TYPE_VARIANT, arguments, G_N_ELEMENTS(arguments)));
   }
-  JSCValue *value = jsc_value_new_array_from_garray(context, arr);
-  g_ptr_array_free(arr, true);
-  return value;
 }
 
 /* LightDM callbacks */
@@ -634,67 +758,46 @@ static void
 authentication_complete_cb(LightDMGreeter *greeter)
 {
   (void) greeter;
-  JSCContext *context = get_global_context();
-
-  for (guint i = 0; i < greeter_browsers->len; i++) {
-    GVariant *parameters = jsc_parameters_to_g_variant_array(context, "authentication_complete", NULL);
-    WebKitUserMessage *message = webkit_user_message_new("lightdm", parameters);
-
-    Browser *browser = greeter_browsers->pdata[i];
-    webkit_web_view_send_message_to_page(WEBKIT_WEB_VIEW(browser->web_view), message, NULL, NULL, NULL);
-  }
+  WATCHDOG_SCOPE("lightdm authentication-complete");
+  LightDM_notify_property_changes();
+  bridge_object_emit(LightDM_object, "authentication_complete", NULL);
 }
 static void
 autologin_timer_expired_cb(LightDMGreeter *greeter)
 {
   (void) greeter;
-  JSCContext *context = get_global_context();
-
-  for (guint i = 0; i < greeter_browsers->len; i++) {
-    GVariant *parameters = jsc_parameters_to_g_variant_array(context, "autologin_timer_expired", NULL);
-    WebKitUserMessage *message = webkit_user_message_new("lightdm", parameters);
-
-    Browser *browser = greeter_browsers->pdata[i];
-    webkit_web_view_send_message_to_page(WEBKIT_WEB_VIEW(browser->web_view), message, NULL, NULL, NULL);
-  }
+  WATCHDOG_SCOPE("lightdm autologin-timer-expired");
+  bridge_object_emit(LightDM_object, "autologin_timer_expired", NULL);
 }
 static void
 show_prompt_cb(LightDMGreeter *greeter, const gchar *text, LightDMPromptType type)
 {
   (void) greeter;
-  JSCContext *context = get_global_context();
-
-  GPtrArray *arr = g_ptr_array_new();
-  g_ptr_array_add(arr, jsc_value_new_string(context, text));
-  g_ptr_array_add(arr, jsc_value_new_number(context, type));
-
-  for (guint i = 0; i < greeter_browsers->len; i++) {
-    GVariant *parameters = jsc_parameters_to_g_variant_array(context, "show_prompt", arr);
-    WebKitUserMessage *message = webkit_user_message_new("lightdm", parameters);
-
-    Browser *browser = greeter_browsers->pdata[i];
-    webkit_web_view_send_message_to_page(WEBKIT_WEB_VIEW(browser->web_view), message, NULL, NULL, NULL);
-  }
-  g_ptr_array_free(arr, true);
+  WATCHDOG_SCOPE("lightdm show-prompt");
+  GVariant *arguments[] = {
+    g_variant_new_variant(g_variant_new_string(text)),
+    g_variant_new_variant(g_variant_new_int32(type)),
+  };
+  bridge_object_emit(
+      LightDM_object,
+      "show_prompt",
+      g_variant_new_array(G_VARIANT_TYPE_VARIANT, arguments, G_N_ELEMENTS(arguments)));
+  LightDM_notify_property_changes();
 }
 static void
 show_message_cb(LightDMGreeter *greeter, const gchar *text, LightDMMessageType type)
 {
   (void) greeter;
-  JSCContext *context = get_global_context();
-
-  GPtrArray *arr = g_ptr_array_new();
-  g_ptr_array_add(arr, jsc_value_new_string(context, text));
-  g_ptr_array_add(arr, jsc_value_new_number(context, type));
-
-  for (guint i = 0; i < greeter_browsers->len; i++) {
-    GVariant *parameters = jsc_parameters_to_g_variant_array(context, "show_message", arr);
-    WebKitUserMessage *message = webkit_user_message_new("lightdm", parameters);
-
-    Browser *browser = greeter_browsers->pdata[i];
-    webkit_web_view_send_message_to_page(WEBKIT_WEB_VIEW(browser->web_view), message, NULL, NULL, NULL);
-  }
-  g_ptr_array_free(arr, true);
+  WATCHDOG_SCOPE("lightdm show-message");
+  GVariant *arguments[] = {
+    g_variant_new_variant(g_variant_new_string(text)),
+    g_variant_new_variant(g_variant_new_int32(type)),
+  };
+  bridge_object_emit(
+      LightDM_object,
+      "show_message",
+      g_variant_new_array(G_VARIANT_TYPE_VARIANT, arguments, G_N_ELEMENTS(arguments)));
+  LightDM_notify_property_changes();
 }
 
 /**
@@ -754,9 +857,15 @@ handle_lightdm_accessor(BrowserWebView *web_view, WebKitUserMessage *message)
 void
 LightDM_destroy(void)
 {
+  g_signal_handlers_disconnect_by_func(UserList, LightDM_users_changed_cb, NULL);
+  g_clear_pointer(&LightDM_thumbnails, g_hash_table_unref);
   g_object_unref(Greeter);
   g_object_unref(LightDM_object);
+  LightDMLayout_index_destroy();
   g_string_free(shared_data_directory, true);
+  for (guint i = 0; i < G_N_ELEMENTS(LightDM_watched_properties); i++) {
+    g_clear_pointer(&LightDM_watched_properties[i].value, g_variant_unref);
+  }
 }
 
 /**
@@ -768,11 +877,16 @@ LightDM_initialize(void)
   UserList = lightdm_user_list_get_instance();
   Greeter = lightdm_greeter_new();
 
+  LightDM_thumbnails = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_signal_connect(UserList, "user-added", G_CALLBACK(LightDM_users_changed_cb), NULL);
+  g_signal_connect(UserList, "user-changed", G_CALLBACK(LightDM_users_changed_cb), NULL);
+  g_signal_connect(UserList, "user-removed", G_CALLBACK(LightDM_users_changed_cb), NULL);
+
   LightDM_constructor();
 
   /**
    * The property type value is not being used in the main process.
-   * It just serves as a help.
+   * It just serves as a help; G_TYPE_VARIANT marks object values.
    */
   struct JSCClassProperty LightDM_properties[] = {
     { "authentication_user", G_CALLBACK(LightDM_authentication_user_getter_cb), NULL, G_TYPE_BOOLEAN },
@@ -795,23 +909,24 @@ LightDM_initialize(void)
     { "in_authentication", G_CALLBACK(LightDM_in_authentication_getter_cb), NULL, G_TYPE_BOOLEAN },
     { "is_authenticated", G_CALLBACK(LightDM_is_authenticated_getter_cb), NULL, G_TYPE_BOOLEAN },
 
-    { "language", G_CALLBACK(LightDM_language_getter_cb), NULL, JSC_TYPE_VALUE },
-    { "languages", G_CALLBACK(LightDM_languages_getter_cb), NULL, JSC_TYPE_VALUE },
-    { "layout", G_CALLBACK(LightDM_layout_getter_cb), G_CALLBACK(LightDM_layout_setter_cb), JSC_TYPE_VALUE },
-    { "layouts", G_CALLBACK(LightDM_layouts_getter_cb), NULL, JSC_TYPE_VALUE },
+    { "language", G_CALLBACK(LightDM_language_getter_cb), NULL, G_TYPE_VARIANT },
+    { "languages", G_CALLBACK(LightDM_languages_getter_cb), NULL, G_TYPE_VARIANT },
+    { "layout", G_CALLBACK(LightDM_layout_getter_cb), G_CALLBACK(LightDM_layout_setter_cb), G_TYPE_VARIANT },
+    { "layouts", G_CALLBACK(LightDM_layouts_getter_cb), NULL, G_TYPE_VARIANT },
 
     { "lock_hint", G_CALLBACK(LightDM_lock_hint_getter_cb), NULL, G_TYPE_BOOLEAN },
-    { "remote_sessions", G_CALLBACK(LightDM_remote_sessions_getter_cb), NULL, JSC_TYPE_VALUE },
+    { "remote_sessions", G_CALLBACK(LightDM_remote_sessions_getter_cb), NULL, G_TYPE_VARIANT },
     { "select_guest_hint", G_CALLBACK(LightDM_select_guest_hint_getter_cb), NULL, G_TYPE_BOOLEAN },
     { "select_user_hint", G_CALLBACK(LightDM_select_user_hint_getter_cb), NULL, G_TYPE_STRING },
-    { "sessions", G_CALLBACK(LightDM_sessions_getter_cb), NULL, JSC_TYPE_VALUE },
+    { "sessions", G_CALLBACK(LightDM_sessions_getter_cb), NULL, G_TYPE_VARIANT },
     { "shared_data_directory", G_CALLBACK(LightDM_shared_data_directory_getter_cb), NULL, G_TYPE_STRING },
     { "show_manual_login_hint", G_CALLBACK(LightDM_show_manual_login_hint_getter_cb), NULL, G_TYPE_BOOLEAN },
     { "show_remote_login_hint", G_CALLBACK(LightDM_show_remote_login_hint_getter_cb), NULL, G_TYPE_BOOLEAN },
-    { "users", G_CALLBACK(LightDM_users_getter_cb), NULL, JSC_TYPE_VALUE },
+    { "users", G_CALLBACK(LightDM_users_getter_cb), NULL, G_TYPE_VARIANT },
   };
   struct JSCClassMethod LightDM_methods[] = {
     { "authenticate", G_CALLBACK(LightDM_authenticate_cb), G_TYPE_BOOLEAN },
+    { "avatar_atlas", G_CALLBACK(LightDM_avatar_atlas_cb), G_TYPE_NONE },
     { "authenticate_as_guest", G_CALLBACK(LightDM_authenticate_as_guest_cb), G_TYPE_BOOLEAN },
     { "cancel_authentication", G_CALLBACK(LightDM_cancel_authentication_cb), G_TYPE_BOOLEAN },
     { "cancel_autologin", G_CALLBACK(LightDM_cancel_autologin_cb), G_TYPE_BOOLEAN },
@@ -819,6 +934,7 @@ LightDM_initialize(void)
     { "respond", G_CALLBACK(LightDM_respond_cb), G_TYPE_BOOLEAN },
     { "restart", G_CALLBACK(LightDM_restart_cb), G_TYPE_BOOLEAN },
     { "set_language", G_CALLBACK(LightDM_set_language_cb), G_TYPE_BOOLEAN },
+    { "set_layout_by_name", G_CALLBACK(LightDM_set_layout_by_name_cb), G_TYPE_BOOLEAN },
     { "shutdown", G_CALLBACK(LightDM_shutdown_cb), G_TYPE_BOOLEAN },
     { "start_session", G_CALLBACK(LightDM_start_session_cb), G_TYPE_BOOLEAN },
     { "suspend", G_CALLBACK(LightDM_suspend_cb), G_TYPE_BOOLEAN },
@@ -830,4 +946,6 @@ LightDM_initialize(void)
       G_N_ELEMENTS(LightDM_properties),
       LightDM_methods,
       G_N_ELEMENTS(LightDM_methods));
+
+  LightDM_notify_property_changes();
 }
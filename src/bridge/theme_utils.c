@@ -1,117 +1,541 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-#include <jsc/jsc.h>
 #include <webkit/webkit.h>
 
 #include "bridge/bridge-object.h"
 #include "bridge/utils.h"
 
+#include "browser.h"
+#include "image-cache.h"
 #include "logger.h"
 #include "settings.h"
+#include "theme.h"
+
+/* Files sent to a streaming dirlist callback at once */
+#define DIRLIST_CHUNK_SIZE 64
+/* Directory listings kept at once, the least recently used goes first */
+#define DIRLIST_CACHE_MAX_ENTRIES 32
 
 static GPtrArray *allowed_dirs = NULL;
+static GMutex allowed_dirs_mutex;
 extern GString *shared_data_directory;
 
 static BridgeObject *ThemeUtils_object = NULL;
 
-static void *
-ThemeUtils_dirlist_cb(GPtrArray *arguments)
+/**
+ * A dirlist reply, kept until its directory changes
+ * The directory mtime is read before the scan, so a change during the scan
+ * makes the entry stale as well
+ */
+typedef struct {
+  gchar *key;
+  GVariant *files;
+  gint64 mtime;
+  GList *link;
+} DirlistCacheEntry;
+
+typedef enum {
+  DIRLIST_SORT_NONE,
+  DIRLIST_SORT_NAME,
+  DIRLIST_SORT_MTIME,
+} DirlistSort;
+
+/**
+ * A dirlist call, scanned in a worker thread
+ */
+typedef struct {
+  gchar *path;
+  gboolean only_images;
+  gboolean stream;
+  DirlistSort sort;
+  gboolean reverse;
+  guint offset;
+  guint limit;
+  guint random;
+  gboolean dimensions;
+  guint id;
+  BrowserWebView *web_view;
+  WebKitUserMessage *message;
+
+  gchar *resolved_path;
+  gint64 mtime;
+  GVariant *scanned;
+  guint sent;
+} DirlistRequest;
+
+typedef struct {
+  gchar *path;
+  gint64 mtime;
+} DirlistFile;
+
+/**
+ * Files of a streamed chunk, sent from the main thread
+ */
+typedef struct {
+  BrowserWebView *web_view;
+  guint id;
+  GVariant *files;
+} DirlistChunk;
+
+static GHashTable *dirlist_cache = NULL;
+static GQueue dirlist_cache_lru = G_QUEUE_INIT;
+static GMutex dirlist_cache_mutex;
+
+static const gchar *const image_suffixes[] = {
+  ".jpg",
+  ".jpeg",
+  ".png",
+  ".gif",
+  ".bmp",
+  ".webp",
+  NULL,
+};
+
+static gboolean
+ThemeUtils_is_image_name(const gchar *name)
 {
-  JSCContext *context = get_global_context();
-  if (arguments->len < 2) {
-    return NULL;
+  const gchar *dot = strrchr(name, '.');
+  if (dot == NULL || dot == name)
+    return false;
+  for (guint i = 0; image_suffixes[i] != NULL; i++) {
+    if (g_ascii_strcasecmp(dot, image_suffixes[i]) == 0)
+      return true;
   }
+  return false;
+}
 
-  JSCValue *jsc_path = arguments->pdata[0];
-  JSCValue *jsc_only_images = arguments->pdata[1];
+static void
+ThemeUtils_dirlist_cache_entry_free(gpointer data)
+{
+  DirlistCacheEntry *entry = data;
+  g_queue_delete_link(&dirlist_cache_lru, entry->link);
+  g_variant_unref(entry->files);
+  g_free(entry->key);
+  g_free(entry);
+}
 
-  JSCValue *value = jsc_value_new_array(context, G_TYPE_NONE);
+static gchar *
+ThemeUtils_dirlist_cache_key(DirlistRequest *request)
+{
+  return g_strdup_printf("%s\n%d", request->resolved_path, request->only_images);
+}
 
-  g_autofree gchar *path = js_value_to_string_or_null(jsc_path);
-  path = g_strstrip(path);
-  if (path == NULL || g_strcmp0(path, "") == 0) {
-    return value;
+static gint64
+ThemeUtils_dirlist_get_mtime(const gchar *path)
+{
+  struct stat path_stat;
+  if (stat(path, &path_stat) != 0)
+    return -1;
+  return (gint64) path_stat.st_mtim.tv_sec * G_USEC_PER_SEC + path_stat.st_mtim.tv_nsec / 1000;
+}
+
+/**
+ * Keep the files of a directory, along with its mtime from before the scan
+ */
+static void
+ThemeUtils_dirlist_cache_add(DirlistRequest *request, GVariant *files)
+{
+  if (request->mtime < 0)
+    return;
+
+  DirlistCacheEntry *entry = g_new0(DirlistCacheEntry, 1);
+  entry->key = ThemeUtils_dirlist_cache_key(request);
+  entry->files = g_variant_ref(files);
+  entry->mtime = request->mtime;
+
+  g_mutex_lock(&dirlist_cache_mutex);
+  g_hash_table_remove(dirlist_cache, entry->key);
+  while (dirlist_cache_lru.length >= DIRLIST_CACHE_MAX_ENTRIES) {
+    DirlistCacheEntry *oldest = g_queue_peek_tail(&dirlist_cache_lru);
+    g_hash_table_remove(dirlist_cache, oldest->key);
   }
+  g_queue_push_head(&dirlist_cache_lru, entry);
+  entry->link = dirlist_cache_lru.head;
+  g_hash_table_insert(dirlist_cache, entry->key, entry);
+  g_mutex_unlock(&dirlist_cache_mutex);
+}
+
+static void
+ThemeUtils_dirlist_request_free(gpointer data)
+{
+  DirlistRequest *request = data;
+  g_free(request->path);
+  g_free(request->resolved_path);
+  g_clear_pointer(&request->scanned, g_variant_unref);
+  g_object_unref(request->web_view);
+  g_object_unref(request->message);
+  g_free(request);
+}
+
+static void
+ThemeUtils_dirlist_chunk_free(gpointer data)
+{
+  DirlistChunk *chunk = data;
+  g_object_unref(chunk->web_view);
+  g_variant_unref(chunk->files);
+  g_free(chunk);
+}
+
+static gboolean
+ThemeUtils_dirlist_send_chunk(gpointer data)
+{
+  DirlistChunk *chunk = data;
+
+  GVariantBuilder arguments;
+  g_variant_builder_init(&arguments, G_VARIANT_TYPE("av"));
+  g_variant_builder_add(&arguments, "v", g_variant_new_uint32(chunk->id));
+  g_variant_builder_add(&arguments, "v", chunk->files);
+  bridge_object_send(ThemeUtils_object, chunk->web_view, "_dirlist_chunk", g_variant_builder_end(&arguments));
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * Whether the listing is changed after the scan, so it cannot be streamed while scanning
+ */
+static gboolean
+ThemeUtils_dirlist_is_query(DirlistRequest *request)
+{
+  return request->sort != DIRLIST_SORT_NONE || request->offset > 0 || request->limit > 0 || request->random > 0
+      || request->dimensions;
+}
+
+/**
+ * Serialize files[from, to) as paths, or as { path, width, height } objects
+ * when dimensions were asked for
+ */
+static GVariant *
+ThemeUtils_dirlist_files_to_variant(DirlistRequest *request, GPtrArray *files, guint from, guint to)
+{
+  if (!request->dimensions)
+    return g_variant_new_strv((const gchar *const *) files->pdata + from, to - from);
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+  for (guint i = from; i < to; i++) {
+    const gchar *file_path = files->pdata[i];
+    gint width = 0;
+    gint height = 0;
+
+    g_variant_builder_open(&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&builder, "{sv}", "path", g_variant_new_string(file_path));
+    if (image_cache_read_size(file_path, &width, &height)) {
+      g_variant_builder_add(&builder, "{sv}", "width", g_variant_new_int32(width));
+      g_variant_builder_add(&builder, "{sv}", "height", g_variant_new_int32(height));
+    }
+    g_variant_builder_close(&builder);
+  }
+  return g_variant_builder_end(&builder);
+}
+
+/**
+ * Hand files over to the main thread, from the last chunk up to *to*
+ */
+static void
+ThemeUtils_dirlist_stream(DirlistRequest *request, GPtrArray *files, guint to)
+{
+  DirlistChunk *chunk = g_new0(DirlistChunk, 1);
+  chunk->web_view = g_object_ref(request->web_view);
+  chunk->id = request->id;
+  chunk->files = g_variant_ref_sink(ThemeUtils_dirlist_files_to_variant(request, files, request->sent, to));
+  request->sent = to;
+
+  g_main_context_invoke_full(
+      NULL,
+      G_PRIORITY_DEFAULT,
+      ThemeUtils_dirlist_send_chunk,
+      chunk,
+      ThemeUtils_dirlist_chunk_free);
+}
+
+static gint
+ThemeUtils_dirlist_compare_name(gconstpointer a, gconstpointer b)
+{
+  return g_strcmp0(*(const gchar *const *) a, *(const gchar *const *) b);
+}
+
+static gint
+ThemeUtils_dirlist_compare_mtime(gconstpointer a, gconstpointer b)
+{
+  const DirlistFile *file_a = a;
+  const DirlistFile *file_b = b;
+  if (file_a->mtime != file_b->mtime)
+    return file_a->mtime < file_b->mtime ? -1 : 1;
+  return g_strcmp0(file_a->path, file_b->path);
+}
+
+static void
+ThemeUtils_dirlist_sort_mtime(GPtrArray *files)
+{
+  g_autoptr(GArray) entries = g_array_sized_new(false, false, sizeof(DirlistFile), files->len);
+  for (guint i = 0; i < files->len; i++) {
+    struct stat file_stat;
+    DirlistFile file = { files->pdata[i], 0 };
+    if (stat(file.path, &file_stat) == 0)
+      file.mtime = (gint64) file_stat.st_mtim.tv_sec * G_USEC_PER_SEC + file_stat.st_mtim.tv_nsec / 1000;
+    g_array_append_val(entries, file);
+  }
+  g_array_sort(entries, ThemeUtils_dirlist_compare_mtime);
+  for (guint i = 0; i < files->len; i++) {
+    files->pdata[i] = g_array_index(entries, DirlistFile, i).path;
+  }
+}
+
+/**
+ * Apply sort, offset, limit and random, in this order
+ * A random sample is drawn from what is left after offset and limit
+ */
+static void
+ThemeUtils_dirlist_query(DirlistRequest *request, GPtrArray *files)
+{
+  if (request->sort == DIRLIST_SORT_NAME)
+    g_ptr_array_sort(files, ThemeUtils_dirlist_compare_name);
+  else if (request->sort == DIRLIST_SORT_MTIME)
+    ThemeUtils_dirlist_sort_mtime(files);
 
-  if (g_strcmp0(path, "/") == 0) {
-    return value;
+  if (request->reverse) {
+    for (guint i = 0; i < files->len / 2; i++) {
+      gpointer file = files->pdata[i];
+      files->pdata[i] = files->pdata[files->len - 1 - i];
+      files->pdata[files->len - 1 - i] = file;
+    }
   }
-  g_autofree gchar *substring = g_utf8_substring(path, 0, 1);
-  if (g_strcmp0(substring, "./") == 0) {
-    return value;
+
+  if (request->offset > 0)
+    g_ptr_array_remove_range(files, 0, MIN(request->offset, files->len));
+  if (request->limit > 0 && files->len > request->limit)
+    g_ptr_array_remove_range(files, request->limit, files->len - request->limit);
+
+  if (request->random > 0 && files->len > 0) {
+    guint count = MIN(request->random, files->len);
+    for (guint i = 0; i < count; i++) {
+      guint j = g_random_int_range(i, files->len);
+      gpointer file = files->pdata[i];
+      files->pdata[i] = files->pdata[j];
+      files->pdata[j] = file;
+    }
+    g_ptr_array_remove_range(files, count, files->len - count);
   }
+}
+
+/**
+ * Resolve the requested path, returning NULL when it is not an allowed directory
+ */
+static gchar *
+ThemeUtils_dirlist_resolve(const gchar *path)
+{
+  if (path == NULL)
+    return NULL;
+  if (g_strcmp0(path, "") == 0 || g_strcmp0(path, "/") == 0)
+    return NULL;
+  if (g_str_has_prefix(path, "./"))
+    return NULL;
 
   char resolved_path[PATH_MAX];
   if (realpath(path, resolved_path) == NULL) {
     /*printf("Path normalize error: '%s'\n", strerror(errno));*/
-    return value;
+    return NULL;
   }
 
   struct stat path_stat;
-  stat(resolved_path, &path_stat);
-  if (!g_path_is_absolute(resolved_path) || !(S_ISDIR(path_stat.st_mode))) {
+  if (stat(resolved_path, &path_stat) != 0 || !g_path_is_absolute(resolved_path) || !(S_ISDIR(path_stat.st_mode))) {
     /*printf("Not absolute nor a directory\n");*/
-    return value;
+    return NULL;
   }
 
-  gboolean allowed = false;
-
+  g_mutex_lock(&allowed_dirs_mutex);
   for (guint i = 0; i < allowed_dirs->len; i++) {
     char *allowed_dir = allowed_dirs->pdata[i];
     if (strncmp(resolved_path, allowed_dir, strlen(allowed_dir)) == 0) {
-      allowed = true;
-      break;
+      g_mutex_unlock(&allowed_dirs_mutex);
+      return g_strdup(resolved_path);
     }
   }
+  g_mutex_unlock(&allowed_dirs_mutex);
 
-  if (!allowed) {
-    logger_error("Path \"%s\" is not allowed", resolved_path);
-    return value;
-  }
+  logger_error("Path \"%s\" is not allowed", resolved_path);
+  return NULL;
+}
 
-  DIR *dir;
-  struct dirent *ent;
-  dir = opendir(resolved_path);
+/**
+ * Scan a directory in a worker thread
+ * d_type tells regular files apart without a stat, which is only needed
+ * for symlinks and filesystems that do not fill it in
+ */
+static GPtrArray *
+ThemeUtils_dirlist_scan(DirlistRequest *request)
+{
+  DIR *dir = opendir(request->resolved_path);
   if (dir == NULL) {
-    printf("Opendir error: '%s'\n", strerror(errno));
-    return value;
+    logger_error("Opendir error: '%s'", strerror(errno));
+    return NULL;
   }
-  g_object_unref(value);
-
-  g_autoptr(GPtrArray) files = g_ptr_array_new();
-
-  g_autoptr(GRegex) regex = g_regex_new(".+\\.(jpe?g|png|gif|bmp|webp)", G_REGEX_CASELESS, 0, NULL);
 
+  gboolean stream = request->stream && !ThemeUtils_dirlist_is_query(request);
+  GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+  struct dirent *ent;
   while ((ent = readdir(dir)) != NULL) {
     char *file_name = ent->d_name;
     if (g_strcmp0(file_name, ".") == 0 || g_strcmp0(file_name, "..") == 0) {
       continue;
     }
 
-    g_autofree char *file_path = g_build_path("/", resolved_path, file_name, NULL);
-    g_autoptr(JSCValue) file_element = jsc_value_new_string(context, file_path);
-    /*printf("-> '%s'\n", file_name);*/
+    if (request->only_images) {
+      if (!ThemeUtils_is_image_name(file_name))
+        continue;
 
-    if (jsc_value_is_boolean(jsc_only_images) && jsc_value_to_boolean(jsc_only_images)) {
-      struct stat file_stat;
-      stat(file_path, &file_stat);
-      if (S_ISREG(file_stat.st_mode) && g_regex_match(regex, file_name, 0, NULL)) {
-        /*printf("\tFile match!\n");*/
-        g_ptr_array_add(files, g_steal_pointer(&file_element));
+      gboolean is_regular = ent->d_type == DT_REG;
+      if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+        struct stat file_stat;
+        is_regular = fstatat(dirfd(dir), file_name, &file_stat, 0) == 0 && S_ISREG(file_stat.st_mode);
       }
-    } else {
-      g_ptr_array_add(files, g_steal_pointer(&file_element));
+      if (!is_regular)
+        continue;
     }
+
+    g_ptr_array_add(files, g_build_path("/", request->resolved_path, file_name, NULL));
+    if (stream && files->len - request->sent >= DIRLIST_CHUNK_SIZE)
+      ThemeUtils_dirlist_stream(request, files, files->len);
   }
   closedir(dir);
 
-  value = jsc_value_new_array_from_garray(context, files);
+  request->scanned = g_variant_ref_sink(g_variant_new_strv((const gchar *const *) files->pdata, files->len));
+  return files;
+}
 
-  return value;
+static void
+ThemeUtils_dirlist_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+  (void) source_object;
+  (void) cancellable;
+  DirlistRequest *request = task_data;
+
+  request->resolved_path = ThemeUtils_dirlist_resolve(request->path);
+  if (request->resolved_path == NULL) {
+    g_task_return_pointer(task, g_variant_ref_sink(g_variant_new_strv(NULL, 0)), (GDestroyNotify) g_variant_unref);
+    return;
+  }
+
+  request->mtime = ThemeUtils_dirlist_get_mtime(request->resolved_path);
+
+  g_autofree gchar *cache_key = ThemeUtils_dirlist_cache_key(request);
+  g_autoptr(GPtrArray) files = NULL;
+  g_mutex_lock(&dirlist_cache_mutex);
+  DirlistCacheEntry *cached = g_hash_table_lookup(dirlist_cache, cache_key);
+  if (cached != NULL && cached->mtime != request->mtime) {
+    g_hash_table_remove(dirlist_cache, cache_key);
+    cached = NULL;
+  }
+  if (cached != NULL) {
+    g_queue_unlink(&dirlist_cache_lru, cached->link);
+    g_queue_push_head_link(&dirlist_cache_lru, cached->link);
+    files = g_ptr_array_new_full(g_variant_n_children(cached->files), g_free);
+    GVariantIter iter;
+    const gchar *file_path;
+    g_variant_iter_init(&iter, cached->files);
+    while (g_variant_iter_next(&iter, "&s", &file_path)) {
+      g_ptr_array_add(files, g_strdup(file_path));
+    }
+  }
+  g_mutex_unlock(&dirlist_cache_mutex);
+
+  if (files == NULL)
+    files = ThemeUtils_dirlist_scan(request);
+  if (files == NULL) {
+    g_task_return_pointer(task, g_variant_ref_sink(g_variant_new_strv(NULL, 0)), (GDestroyNotify) g_variant_unref);
+    return;
+  }
+
+  ThemeUtils_dirlist_query(request, files);
+
+  // Streamed files go out in chunks, the reply carries the rest
+  while (request->stream && files->len - request->sent > DIRLIST_CHUNK_SIZE) {
+    ThemeUtils_dirlist_stream(request, files, request->sent + DIRLIST_CHUNK_SIZE);
+  }
+
+  GVariant *result = ThemeUtils_dirlist_files_to_variant(request, files, request->sent, files->len);
+  g_task_return_pointer(task, g_variant_ref_sink(result), (GDestroyNotify) g_variant_unref);
+}
+
+static void
+ThemeUtils_dirlist_ready_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) source_object;
+  (void) user_data;
+  DirlistRequest *request = g_task_get_task_data(G_TASK(result));
+  g_autoptr(GVariant) files = g_task_propagate_pointer(G_TASK(result), NULL);
+
+  if (request->scanned != NULL)
+    ThemeUtils_dirlist_cache_add(request, request->scanned);
+
+  bridge_object_reply(request->message, files);
+}
+
+/**
+ * List a directory
+ * Arguments are the path and either an only_images boolean or an options object:
+ * - only_images: only list image files
+ * - stream: send the files in "_dirlist_chunk" messages, a request id follows the options then
+ * - sort: "name" or "mtime", and reverse to reverse it
+ * - offset and limit: a window of the listing
+ * - random: pick this many files at random
+ * - dimensions: list { path, width, height } objects, read from the image headers
+ */
+static void
+ThemeUtils_dirlist_cb(GPtrArray *arguments, BrowserWebView *web_view, WebKitUserMessage *message)
+{
+  if (arguments->len < 2) {
+    bridge_object_reply(message, NULL);
+    return;
+  }
+
+  DirlistRequest *request = g_new0(DirlistRequest, 1);
+  request->path = g_variant_to_string_or_null(arguments->pdata[0]);
+  if (request->path != NULL)
+    request->path = g_strstrip(request->path);
+
+  GVariant *options = arguments->pdata[1];
+  if (g_variant_is_of_type(options, G_VARIANT_TYPE_VARDICT)) {
+    g_autoptr(GVariant) only_images = g_variant_lookup_value(options, "only_images", NULL);
+    g_autoptr(GVariant) stream = g_variant_lookup_value(options, "stream", NULL);
+    g_autoptr(GVariant) sort = g_variant_lookup_value(options, "sort", NULL);
+    g_autoptr(GVariant) reverse = g_variant_lookup_value(options, "reverse", NULL);
+    g_autoptr(GVariant) offset = g_variant_lookup_value(options, "offset", NULL);
+    g_autoptr(GVariant) limit = g_variant_lookup_value(options, "limit", NULL);
+    g_autoptr(GVariant) random = g_variant_lookup_value(options, "random", NULL);
+    g_autoptr(GVariant) dimensions = g_variant_lookup_value(options, "dimensions", NULL);
+    g_autofree gchar *sort_name = g_variant_to_string_or_null(sort);
+
+    request->only_images = g_variant_to_boolean(only_images);
+    request->stream = g_variant_to_boolean(stream) && arguments->len > 2;
+    if (g_strcmp0(sort_name, "name") == 0)
+      request->sort = DIRLIST_SORT_NAME;
+    else if (g_strcmp0(sort_name, "mtime") == 0)
+      request->sort = DIRLIST_SORT_MTIME;
+    request->reverse = g_variant_to_boolean(reverse);
+    request->offset = MAX(g_variant_to_int32(offset), 0);
+    request->limit = MAX(g_variant_to_int32(limit), 0);
+    request->random = MAX(g_variant_to_int32(random), 0);
+    request->dimensions = g_variant_to_boolean(dimensions);
+  } else {
+    request->only_images = g_variant_to_boolean(options);
+  }
+  if (request->stream)
+    request->id = g_variant_to_int32(arguments->pdata[2]);
+
+  request->web_view = g_object_ref(web_view);
+  request->message = g_object_ref(message);
+
+  g_autoptr(GTask) task = g_task_new(NULL, NULL, ThemeUtils_dirlist_ready_cb, NULL);
+  g_task_set_task_data(task, request, ThemeUtils_dirlist_request_free);
+  g_task_run_in_thread(task, ThemeUtils_dirlist_thread);
 }
 
 void
@@ -120,32 +544,59 @@ handle_theme_utils_accessor(BrowserWebView *web_view, WebKitUserMessage *message
   bridge_object_handle_accessor(ThemeUtils_object, web_view, message);
 }
 
+/**
+ * Allow dirlist to read inside dir, such as a directory of a reloaded configuration
+ */
+void
+ThemeUtils_allow_dir(const gchar *dir)
+{
+  if (dir == NULL || dir[0] == '\0')
+    return;
+
+  g_mutex_lock(&allowed_dirs_mutex);
+  gboolean found = false;
+  for (guint i = 0; i < allowed_dirs->len && !found; i++)
+    found = g_strcmp0(allowed_dirs->pdata[i], dir) == 0;
+  if (!found)
+    g_ptr_array_add(allowed_dirs, g_strdup(dir));
+  g_mutex_unlock(&allowed_dirs_mutex);
+}
+
 void
 ThemeUtils_destroy(void)
 {
   g_object_unref(ThemeUtils_object);
   g_ptr_array_free(allowed_dirs, true);
+  g_hash_table_unref(dirlist_cache);
 }
 
 void
 ThemeUtils_initialize(void)
 {
   const struct JSCClassMethod ThemeUtils_methods[] = {
-    { "dirlist", G_CALLBACK(ThemeUtils_dirlist_cb), G_TYPE_NONE },
+    { "dirlist", G_CALLBACK(ThemeUtils_dirlist_cb), BRIDGE_METHOD_ASYNC },
   };
 
   ThemeUtils_object
       = bridge_object_new_full("theme_utils", NULL, 0, ThemeUtils_methods, G_N_ELEMENTS(ThemeUtils_methods));
 
-  allowed_dirs = g_ptr_array_new();
+  allowed_dirs = g_ptr_array_new_with_free_func(g_free);
+
+  dirlist_cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, ThemeUtils_dirlist_cache_entry_free);
 
+  // A theme inside a bundle has no real path, use the bundle path then
+  const ThemeDescriptor *descriptor = get_theme_descriptor();
   char resolved_path[PATH_MAX];
-  realpath(greeter_config->greeter->theme, resolved_path);
-  char *theme_dir = g_path_get_dirname(resolved_path);
-
-  g_ptr_array_add(allowed_dirs, greeter_config->app->theme_dir);
-  g_ptr_array_add(allowed_dirs, greeter_config->branding->background_images_dir);
-  g_ptr_array_add(allowed_dirs, shared_data_directory);
-  g_ptr_array_add(allowed_dirs, theme_dir);
-  g_ptr_array_add(allowed_dirs, g_strdup(g_get_tmp_dir()));
+  char *theme_dir = NULL;
+  if (realpath(descriptor->primary_path, resolved_path) != NULL)
+    theme_dir = g_path_get_dirname(resolved_path);
+  else
+    theme_dir = g_strdup(descriptor->dir);
+
+  ThemeUtils_allow_dir(greeter_config->app->theme_dir);
+  ThemeUtils_allow_dir(greeter_config->branding->background_images_dir);
+  ThemeUtils_allow_dir(shared_data_directory->str);
+  ThemeUtils_allow_dir(theme_dir);
+  ThemeUtils_allow_dir(g_get_tmp_dir());
+  g_free(theme_dir);
 }
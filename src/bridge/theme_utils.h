@@ -7,6 +7,7 @@
 
 void ThemeUtils_initialize(void);
 void ThemeUtils_destroy(void);
+void ThemeUtils_allow_dir(const gchar *dir);
 void handle_theme_utils_accessor(BrowserWebView *web_view, WebKitUserMessage *message);
 
 #endif
@@ -1,18 +1,9 @@
+#include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "bridge/utils.h"
 
-static JSCContext *Context = NULL;
-
-JSCContext *
-get_global_context(void)
-{
-  if (Context == NULL)
-    Context = jsc_context_new();
-  return Context;
-}
-
 /**
  * Converts a JSCValue to a string
  */
@@ -24,6 +15,96 @@ js_value_to_string_or_null(JSCValue *value)
   return jsc_value_to_string(value);
 }
 
+/**
+ * Converts a GVariant argument to a newly allocated string
+ * Returns NULL if the argument is not a string
+ */
+gchar *
+g_variant_to_string_or_null(GVariant *value)
+{
+  if (value == NULL)
+    return NULL;
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_VARIANT)) {
+    g_autoptr(GVariant) inner = g_variant_get_variant(value);
+    return g_variant_to_string_or_null(inner);
+  }
+  if (!g_variant_is_of_type(value, G_VARIANT_TYPE_STRING))
+    return NULL;
+  return g_variant_dup_string(value, NULL);
+}
+
+/**
+ * Converts a numeric GVariant argument to an integer
+ * Returns 0 if the argument is not a number
+ */
+gint
+g_variant_to_int32(GVariant *value)
+{
+  if (value == NULL)
+    return 0;
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_VARIANT)) {
+    g_autoptr(GVariant) inner = g_variant_get_variant(value);
+    return g_variant_to_int32(inner);
+  }
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_DOUBLE))
+    return (gint) g_variant_get_double(value);
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT32))
+    return g_variant_get_int32(value);
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32))
+    return (gint) g_variant_get_uint32(value);
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT64))
+    return (gint) g_variant_get_int64(value);
+  return 0;
+}
+
+/**
+ * Converts a GVariant argument to a boolean
+ * Returns FALSE if the argument is not a boolean
+ */
+gboolean
+g_variant_to_boolean(GVariant *value)
+{
+  if (value == NULL)
+    return false;
+  if (g_variant_is_of_type(value, G_VARIANT_TYPE_VARIANT)) {
+    g_autoptr(GVariant) inner = g_variant_get_variant(value);
+    return g_variant_to_boolean(inner);
+  }
+  if (!g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN))
+    return false;
+  return g_variant_get_boolean(value);
+}
+
+/**
+ * Creates a GVariant from a string, or an empty maybe value for NULL
+ */
+GVariant *
+g_variant_new_string_or_null(const gchar *value)
+{
+  if (value == NULL)
+    return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+  return g_variant_new_string(value);
+}
+
+/**
+ * Converts an "av" GVariant to a GPtrArray of its unboxed children
+ */
+GPtrArray *
+g_variant_array_to_g_ptr_array(GVariant *array)
+{
+  GPtrArray *values = g_ptr_array_new_with_free_func((GDestroyNotify) g_variant_unref);
+  if (array == NULL || !g_variant_is_of_type(array, G_VARIANT_TYPE("av")))
+    return values;
+
+  gsize length = g_variant_n_children(array);
+  for (gsize i = 0; i < length; i++) {
+    GVariant *value = NULL;
+    g_variant_get_child(array, i, "v", &value);
+    g_ptr_array_add(values, value);
+  }
+  return values;
+}
+
 /**
  * Get index position of *find* inside *source*
  */
@@ -21,10 +21,18 @@ struct JSCClassSignal {
   const gchar *name;
 };
 
-JSCContext *get_global_context(void);
-
 gchar *js_value_to_string_or_null(JSCValue *value);
 
+gchar *g_variant_to_string_or_null(GVariant *value);
+gint g_variant_to_int32(GVariant *value);
+gboolean g_variant_to_boolean(GVariant *value);
+GVariant *g_variant_new_string_or_null(const gchar *value);
+GPtrArray *g_variant_array_to_g_ptr_array(GVariant *array);
+
+/* Add a string to an "a{sv}" builder, NULL being added as "" */
+#define VARDICT_ADD_STRING(builder, key, value) \
+  g_variant_builder_add(builder, "{sv}", key, g_variant_new_string((value) != NULL ? (value) : ""))
+
 int string_get_index_of(const char *source, const char *find);
 
 int string_get_last_index_of(const char *source, const char *find);
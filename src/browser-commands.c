@@ -2,6 +2,7 @@
 
 #include "browser-commands.h"
 #include "browser.h"
+#include "scheme.h"
 
 static float zoom_steps[] = {
   0.30f, 0.50f, 0.75f, 0.85f, 1.00f,
@@ -262,6 +263,7 @@ browser_force_reload_cb(GSimpleAction *action, GVariant *parameter, gpointer use
   (void) action;
   (void) parameter;
   Browser *browser = user_data;
+  scheme_cache_clear();
   webkit_web_view_reload_bypass_cache(WEBKIT_WEB_VIEW(browser->web_view));
 }
 void
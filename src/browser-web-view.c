@@ -7,6 +7,7 @@
 #include "browser-web-view.h"
 #include "browser.h"
 #include "logger.h"
+#include "network-cache.h"
 #include "settings.h"
 #include "theme.h"
 
@@ -28,32 +29,21 @@ typedef enum {
   ERROR_PROMPT_RELOAD_THEME,
 } ErrorPromptResponseType;
 
-static void
-show_console_error_prompt(BrowserWebView *web_view, WebKitUserMessage *user_message)
-{
-  GVariant *params = webkit_user_message_get_parameters(user_message);
-
-  char *type = NULL;
-  char *message = NULL;
-  char *source_id = NULL;
-  guint line = 0;
-
-  g_variant_get(params, "(sssu)", &type, &message, &source_id, &line);
-
-  // TODO: haven't test
-  GtkRoot *root = gtk_widget_get_root(GTK_WIDGET(web_view));
-  GtkAlertDialog *adialog = gtk_alert_dialog_new("An error ocurred. Do you want to change to default theme? (gruvbox)");
-  gtk_widget_set_name(GTK_WIDGET(adialog), "error-prompt");
+/* Errors listed in the prompt, the rest are only counted */
+#define ERROR_PROMPT_MAX_DETAILS 8
 
-  const char *buttons[] = { "_Cancel", "_Use default theme", "_Reload theme" };
-  gtk_alert_dialog_set_buttons(adialog, buttons);
-
-  char *error_message = g_strdup_printf("%s %d: %s", source_id, line, message);
-  gtk_alert_dialog_set_detail(adialog, error_message);
-
-  gtk_alert_dialog_choose(adialog, GTK_WINDOW(root), NULL, NULL, NULL);
+typedef struct {
+  BrowserWebView *web_view;
+  WebKitUserMessage *message;
+} ErrorPrompt;
 
-  int response = gtk_alert_dialog_choose_finish(adialog, NULL, NULL);
+static void
+console_error_prompt_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  ErrorPrompt *prompt = user_data;
+  GtkAlertDialog *adialog = GTK_ALERT_DIALOG(source_object);
+  int response = gtk_alert_dialog_choose_finish(adialog, result, NULL);
+  GtkRoot *root = gtk_widget_get_root(GTK_WIDGET(prompt->web_view));
 
   gboolean stop_prompts = false;
 
@@ -64,8 +54,7 @@ show_console_error_prompt(BrowserWebView *web_view, WebKitUserMessage *user_mess
       if (!BROWSER_IS_WINDOW(root))
         break;
       stop_prompts = true;
-      g_free(greeter_config->greeter->theme);
-      greeter_config->greeter->theme = g_strdup("gruvbox");
+      use_fallback_theme();
       for (guint i = 0; i < greeter_browsers->len; i++) {
         Browser *browser = greeter_browsers->pdata[i];
         load_theme(browser);
@@ -84,7 +73,66 @@ show_console_error_prompt(BrowserWebView *web_view, WebKitUserMessage *user_mess
   }
   g_autoptr(GVariant) reply_params = g_variant_new("(b)", stop_prompts);
   WebKitUserMessage *reply = webkit_user_message_new("console-done", g_steal_pointer(&reply_params));
-  webkit_user_message_send_reply(user_message, reply);
+  webkit_user_message_send_reply(prompt->message, reply);
+
+  g_object_unref(adialog);
+  g_object_unref(prompt->web_view);
+  g_object_unref(prompt->message);
+  g_free(prompt);
+}
+
+/**
+ * Show the theme errors reported by the web extension, as "(a(susu)u)"
+ * The reply is sent once the prompt is answered
+ */
+static void
+show_console_error_prompt(BrowserWebView *web_view, WebKitUserMessage *user_message)
+{
+  GVariant *params = webkit_user_message_get_parameters(user_message);
+  if (params == NULL || !g_variant_is_of_type(params, G_VARIANT_TYPE("(a(susu)u)"))) {
+    g_autoptr(GVariant) reply_params = g_variant_new("(b)", false);
+    WebKitUserMessage *reply = webkit_user_message_new("console-done", g_steal_pointer(&reply_params));
+    webkit_user_message_send_reply(user_message, reply);
+    return;
+  }
+
+  g_autoptr(GVariantIter) errors = NULL;
+  guint dropped = 0;
+  g_variant_get(params, "(a(susu)u)", &errors, &dropped);
+
+  GString *detail = g_string_new(NULL);
+  const char *source_id = NULL;
+  guint line = 0;
+  const char *message = NULL;
+  guint count = 0;
+  guint shown = 0;
+  while (g_variant_iter_next(errors, "(&su&su)", &source_id, &line, &message, &count)) {
+    if (shown++ >= ERROR_PROMPT_MAX_DETAILS) {
+      dropped++;
+      continue;
+    }
+    if (detail->len > 0)
+      g_string_append_c(detail, '\n');
+    g_string_append_printf(detail, "%s %u: %s", source_id, line, message);
+    if (count > 1)
+      g_string_append_printf(detail, " (x%u)", count);
+  }
+  if (dropped > 0)
+    g_string_append_printf(detail, "\n...and %u more errors", dropped);
+
+  GtkRoot *root = gtk_widget_get_root(GTK_WIDGET(web_view));
+  GtkAlertDialog *adialog = gtk_alert_dialog_new("An error ocurred. Do you want to change to the fallback theme?");
+
+  const char *buttons[] = { "_Cancel", "_Use fallback theme", "_Reload theme", NULL };
+  gtk_alert_dialog_set_buttons(adialog, buttons);
+  gtk_alert_dialog_set_cancel_button(adialog, ERROR_PROMPT_CANCEL);
+  gtk_alert_dialog_set_detail(adialog, detail->str);
+  g_string_free(detail, true);
+
+  ErrorPrompt *prompt = g_new0(ErrorPrompt, 1);
+  prompt->web_view = g_object_ref(web_view);
+  prompt->message = g_object_ref(user_message);
+  gtk_alert_dialog_choose(adialog, GTK_WINDOW(root), NULL, console_error_prompt_cb, prompt);
 }
 
 /*
@@ -98,12 +146,14 @@ browser_web_view_user_message_received_cb(BrowserWebView *web_view, WebKitUserMe
 
   if (g_strcmp0(name, "ready-to-show") == 0) {
     BrowserWebViewPrivate *priv = browser_web_view_get_instance_private(web_view);
+    GtkRoot *root = gtk_widget_get_root(GTK_WIDGET(web_view));
+    if (BROWSER_IS_WINDOW(root))
+      browser_show_live_page(BROWSER_WINDOW(root));
     if (priv->loaded)
       return;
 
     gtk_widget_grab_focus(GTK_WIDGET(web_view));
 
-    GtkRoot *root = gtk_widget_get_root(GTK_WIDGET(web_view));
     gtk_window_present(GTK_WINDOW(root));
 
     priv->loaded = true;
@@ -168,7 +218,11 @@ browser_web_view_constructed(GObject *object)
   g_object_set(G_OBJECT(settings), "hardware-acceleration-policy", WEBKIT_HARDWARE_ACCELERATION_POLICY_ALWAYS, NULL);
 
   WebKitWebContext *context = webkit_web_view_get_context(WEBKIT_WEB_VIEW(web_view));
-  webkit_web_context_set_cache_model(context, WEBKIT_CACHE_MODEL_DOCUMENT_VIEWER);
+  const char *cache_dir = greeter_config->greeter->cache_dir;
+  if (cache_dir != NULL && cache_dir[0] != '\0')
+    webkit_web_context_set_cache_model(context, WEBKIT_CACHE_MODEL_DOCUMENT_BROWSER);
+  else
+    webkit_web_context_set_cache_model(context, WEBKIT_CACHE_MODEL_DOCUMENT_VIEWER);
 
   g_autoptr(GdkRGBA) rgba = malloc(sizeof *rgba);
   gdk_rgba_parse(rgba, "#000000");
@@ -195,6 +249,7 @@ browser_web_view_init(BrowserWebView *self)
 BrowserWebView *
 browser_web_view_new(void)
 {
-  BrowserWebView *web_view = g_object_new(BROWSER_WEB_VIEW_TYPE, NULL);
+  BrowserWebView *web_view
+      = g_object_new(BROWSER_WEB_VIEW_TYPE, "network-session", network_cache_get_session(), NULL);
   return web_view;
 }
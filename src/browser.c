@@ -1,13 +1,31 @@
+#include <errno.h>
+#include <sys/stat.h>
 #include <webkit/webkit.h>
 
 #include "browser-commands.h"
 #include "browser-web-view.h"
 #include "browser.h"
+#include "logger.h"
 
 extern GPtrArray *greeter_browsers;
 
+/*
+ * A snapshot of the rendered theme is saved for each monitor and theme,
+ * and shown above the web view on the next start until the page paints.
+ * It is taken on the first paint of the live page, and never saved once the
+ * window got any input, so nothing typed in the page ends up on disk.
+ * Snapshots are keyed on the theme file as well, and only taken when there
+ * is none for the current theme and geometry yet.
+ */
+
 typedef struct {
   guint64 id;
+  GtkWidget *snapshot;
+  gchar *snapshot_path;
+  GdkFrameClock *frame_clock;
+  gulong after_paint_id;
+  gboolean received_input;
+  gboolean snapshot_saved;
 } BrowserPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(Browser, browser, GTK_TYPE_APPLICATION_WINDOW)
@@ -25,6 +43,13 @@ static GParamSpec *browser_properties[N_PROPERTIES] = { NULL };
 static void
 browser_dispose(GObject *gobject)
 {
+  BrowserPrivate *priv = browser_get_instance_private(BROWSER_WINDOW(gobject));
+  if (priv->after_paint_id != 0) {
+    g_signal_handler_disconnect(priv->frame_clock, priv->after_paint_id);
+    priv->after_paint_id = 0;
+  }
+  g_clear_object(&priv->frame_clock);
+
   G_OBJECT_CLASS(browser_parent_class)->dispose(gobject);
   // remove the reference of browser in greeter_browsers
   g_ptr_array_remove(greeter_browsers, gobject);
@@ -32,6 +57,9 @@ browser_dispose(GObject *gobject)
 static void
 browser_finalize(GObject *gobject)
 {
+  BrowserPrivate *priv = browser_get_instance_private(BROWSER_WINDOW(gobject));
+  g_free(priv->snapshot_path);
+
   G_OBJECT_CLASS(browser_parent_class)->finalize(gobject);
 }
 
@@ -234,13 +262,64 @@ browser_class_init(BrowserClass *klass)
   g_object_class_install_properties(object_class, N_PROPERTIES, browser_properties);
 }
 
+static gboolean
+browser_key_pressed_cb(
+    GtkEventControllerKey *controller,
+    guint keyval,
+    guint keycode,
+    GdkModifierType state,
+    gpointer user_data)
+{
+  (void) controller;
+  (void) keyval;
+  (void) keycode;
+  (void) state;
+  BrowserPrivate *priv = browser_get_instance_private(user_data);
+  priv->received_input = true;
+  return false;
+}
+
+static void
+browser_pressed_cb(GtkGestureClick *gesture, gint n_press, gdouble x, gdouble y, gpointer user_data)
+{
+  (void) gesture;
+  (void) n_press;
+  (void) x;
+  (void) y;
+  BrowserPrivate *priv = browser_get_instance_private(user_data);
+  priv->received_input = true;
+}
+
 static void
 browser_init(Browser *self)
 {
+  BrowserPrivate *priv = browser_get_instance_private(self);
+
   self->web_view = browser_web_view_new();
   self->is_primary = true;
 
-  gtk_window_set_child(GTK_WINDOW(self), GTK_WIDGET(self->web_view));
+  priv->snapshot = gtk_picture_new();
+  gtk_picture_set_content_fit(GTK_PICTURE(priv->snapshot), GTK_CONTENT_FIT_COVER);
+  gtk_widget_set_can_target(priv->snapshot, false);
+  gtk_widget_set_visible(priv->snapshot, false);
+
+  GtkWidget *overlay = gtk_overlay_new();
+  gtk_overlay_set_child(GTK_OVERLAY(overlay), GTK_WIDGET(self->web_view));
+  gtk_overlay_add_overlay(GTK_OVERLAY(overlay), priv->snapshot);
+
+  gtk_window_set_child(GTK_WINDOW(self), overlay);
+
+  // Input is only watched, the web view still gets it
+  GtkEventController *key_controller = gtk_event_controller_key_new();
+  gtk_event_controller_set_propagation_phase(key_controller, GTK_PHASE_CAPTURE);
+  g_signal_connect(key_controller, "key-pressed", G_CALLBACK(browser_key_pressed_cb), self);
+  gtk_widget_add_controller(GTK_WIDGET(self), key_controller);
+
+  GtkGesture *click_gesture = gtk_gesture_click_new();
+  gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(click_gesture), 0);
+  gtk_event_controller_set_propagation_phase(GTK_EVENT_CONTROLLER(click_gesture), GTK_PHASE_CAPTURE);
+  g_signal_connect(click_gesture, "pressed", G_CALLBACK(browser_pressed_cb), self);
+  gtk_widget_add_controller(GTK_WIDGET(self), GTK_EVENT_CONTROLLER(click_gesture));
 }
 
 Browser *
@@ -265,3 +344,136 @@ browser_new_full(GtkApplication *app, GdkMonitor *monitor, gboolean debug_mode,
       NULL);
   return browser;
 }
+
+static gchar *
+browser_get_snapshot_path(Browser *self, const char *uri, const char *theme_path)
+{
+  struct stat theme_stat = { 0 };
+  if (theme_path != NULL)
+    stat(theme_path, &theme_stat);
+
+  g_autofree gchar *key = g_strdup_printf(
+      "%s\n%ld.%09ld\n%ld\n%dx%d@%d",
+      uri,
+      (long) theme_stat.st_mtim.tv_sec,
+      (long) theme_stat.st_mtim.tv_nsec,
+      (long) theme_stat.st_size,
+      self->meta.geometry.width,
+      self->meta.geometry.height,
+      gdk_monitor_get_scale_factor(self->monitor));
+  g_autofree gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+  g_autofree gchar *name = g_strconcat(checksum, ".png", NULL);
+  return g_build_filename(g_get_user_cache_dir(), "sea-greeter", "snapshots", name, NULL);
+}
+
+/**
+ * Show the saved snapshot of uri above the web view, and present the window right away
+ * The snapshot is hidden by browser_show_live_page
+ */
+void
+browser_show_snapshot(Browser *self, const char *uri, const char *theme_path)
+{
+  BrowserPrivate *priv = browser_get_instance_private(self);
+
+  g_free(priv->snapshot_path);
+  priv->snapshot_path = browser_get_snapshot_path(self, uri, theme_path);
+
+  g_autoptr(GFile) file = g_file_new_for_path(priv->snapshot_path);
+  g_autoptr(GdkTexture) texture = gdk_texture_new_from_file(file, NULL);
+  priv->snapshot_saved = texture != NULL;
+  if (texture == NULL)
+    return;
+
+  gtk_picture_set_paintable(GTK_PICTURE(priv->snapshot), GDK_PAINTABLE(texture));
+  gtk_widget_set_visible(priv->snapshot, true);
+  gtk_window_present(GTK_WINDOW(self));
+}
+
+static void
+browser_snapshot_ready_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  Browser *self = user_data;
+  BrowserPrivate *priv = browser_get_instance_private(self);
+
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GdkTexture) texture = webkit_web_view_get_snapshot_finish(WEBKIT_WEB_VIEW(source_object), result, &error);
+  if (texture == NULL) {
+    logger_debug("Snapshot was not taken: %s", error->message);
+    g_object_unref(self);
+    return;
+  }
+  if (priv->received_input) {
+    g_object_unref(self);
+    return;
+  }
+
+  g_autoptr(GBytes) png = gdk_texture_save_to_png_bytes(texture);
+  g_autofree gchar *dir = g_path_get_dirname(priv->snapshot_path);
+  gsize size = 0;
+  const gchar *data = g_bytes_get_data(png, &size);
+  if (g_mkdir_with_parents(dir, 0700) != 0 || chmod(dir, 0700) != 0
+      || !g_file_set_contents_full(
+          priv->snapshot_path,
+          data,
+          size,
+          G_FILE_SET_CONTENTS_CONSISTENT,
+          0600,
+          &error)) {
+    logger_debug("Snapshot was not saved: %s", error != NULL ? error->message : g_strerror(errno));
+  }
+  g_object_unref(self);
+}
+
+static void
+browser_save_snapshot(Browser *self)
+{
+  BrowserPrivate *priv = browser_get_instance_private(self);
+  if (priv->snapshot_path == NULL || priv->snapshot_saved || priv->received_input)
+    return;
+  priv->snapshot_saved = true;
+
+  webkit_web_view_get_snapshot(
+      WEBKIT_WEB_VIEW(self->web_view),
+      WEBKIT_SNAPSHOT_REGION_VISIBLE,
+      WEBKIT_SNAPSHOT_OPTIONS_NONE,
+      NULL,
+      browser_snapshot_ready_cb,
+      g_object_ref(self));
+}
+
+static void
+browser_after_paint_cb(GdkFrameClock *frame_clock, gpointer user_data)
+{
+  Browser *self = user_data;
+  BrowserPrivate *priv = browser_get_instance_private(self);
+
+  g_signal_handler_disconnect(frame_clock, priv->after_paint_id);
+  priv->after_paint_id = 0;
+  g_clear_object(&priv->frame_clock);
+
+  gtk_widget_set_visible(priv->snapshot, false);
+  gtk_picture_set_paintable(GTK_PICTURE(priv->snapshot), NULL);
+
+  browser_save_snapshot(self);
+}
+
+/**
+ * Swap the snapshot for the live page once the page is ready, on its next paint
+ */
+void
+browser_show_live_page(Browser *self)
+{
+  BrowserPrivate *priv = browser_get_instance_private(self);
+  if (priv->after_paint_id != 0)
+    return;
+
+  GdkFrameClock *frame_clock = gtk_widget_get_frame_clock(GTK_WIDGET(self->web_view));
+  if (frame_clock == NULL) {
+    gtk_widget_set_visible(priv->snapshot, false);
+    return;
+  }
+
+  priv->frame_clock = g_object_ref(frame_clock);
+  priv->after_paint_id = g_signal_connect(frame_clock, "after-paint", G_CALLBACK(browser_after_paint_cb), self);
+  gtk_widget_queue_draw(GTK_WIDGET(self->web_view));
+}
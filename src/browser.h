@@ -38,6 +38,8 @@ void browser_set_overall_boundary(GPtrArray *browsers);
 Browser *browser_new(GtkApplication *app, GdkMonitor *monitor);
 Browser *browser_new_full(GtkApplication *app, GdkMonitor *monitor, gboolean debug_mode, gboolean is_primary);
 void browser_show_menu_bar(Browser *browser, gboolean show);
+void browser_show_snapshot(Browser *browser, const char *uri, const char *theme_path);
+void browser_show_live_page(Browser *browser);
 
 G_END_DECLS
 
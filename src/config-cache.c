@@ -0,0 +1,219 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config-cache.h"
+#include "logger.h"
+#include "settings.h"
+
+/*
+ * The parsed greeter configuration is kept in
+ * $XDG_CACHE_HOME/sea-greeter/config.cache as a serialized GVariant, keyed
+ * by the device, inode, mtime and size of the configuration file. When the
+ * file did not change, the cache is mapped and read without running the
+ * YAML parser.
+ * The configuration itself is stored as a variant, so a cache written with
+ * other configuration fields is told apart by its type.
+ * The cache carries secure_mode, so it is only trusted when it is a regular
+ * file owned by the greeter user that nobody else can write.
+ */
+#define CONFIG_CACHE_VERSION 1
+#define CONFIG_CACHE_KEY_TYPE "(ttxt)"
+#define CONFIG_CACHE_TYPE "(u" CONFIG_CACHE_KEY_TYPE "v)"
+#define CONFIG_CACHE_CONFIG_TYPE "((msmsms)(bbib^asmsmsmsmsi)as(bbii))"
+
+static gchar *
+config_cache_get_path(void)
+{
+  return g_build_filename(g_get_user_cache_dir(), "sea-greeter", "config.cache", NULL);
+}
+
+static GVariant *
+config_cache_key_new(const gchar *config_path)
+{
+  struct stat file_stat;
+  if (stat(config_path, &file_stat) != 0)
+    return NULL;
+
+  gint64 mtime = (gint64) file_stat.st_mtim.tv_sec * G_USEC_PER_SEC + file_stat.st_mtim.tv_nsec / 1000;
+  return g_variant_ref_sink(g_variant_new(
+      CONFIG_CACHE_KEY_TYPE,
+      (guint64) file_stat.st_dev,
+      (guint64) file_stat.st_ino,
+      mtime,
+      (guint64) file_stat.st_size));
+}
+
+static void
+config_cache_take_string(char **field, gchar *value)
+{
+  g_free(*field);
+  *field = value;
+}
+
+static GMappedFile *
+config_cache_open(const gchar *cache_path)
+{
+  int fd = open(cache_path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  if (fd < 0)
+    return NULL;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_uid != geteuid()
+      || (file_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    logger_warn("Ignoring config cache \"%s\", it is not private to the greeter user", cache_path);
+    close(fd);
+    return NULL;
+  }
+
+  GMappedFile *mapped = g_mapped_file_new_from_fd(fd, false, NULL);
+  close(fd);
+  return mapped;
+}
+
+/**
+ * Load the cached configuration of config_path into config
+ * @return Whether the cache was up to date, config is left untouched otherwise
+ */
+gboolean
+config_cache_load(const gchar *config_path, GreeterConfig *config)
+{
+  g_autoptr(GVariant) key = config_cache_key_new(config_path);
+  if (key == NULL)
+    return false;
+
+  g_autofree gchar *cache_path = config_cache_get_path();
+  GMappedFile *mapped = config_cache_open(cache_path);
+  if (mapped == NULL)
+    return false;
+  g_autoptr(GBytes) bytes = g_mapped_file_get_bytes(mapped);
+  g_mapped_file_unref(mapped);
+
+  g_autoptr(GVariant) cache
+      = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(CONFIG_CACHE_TYPE), bytes, false));
+
+  guint32 version = 0;
+  g_autoptr(GVariant) cached_key = NULL;
+  g_autoptr(GVariant) value = NULL;
+  g_variant_get(cache, "(u@" CONFIG_CACHE_KEY_TYPE "v)", &version, &cached_key, &value);
+  if (version != CONFIG_CACHE_VERSION || !g_variant_equal(key, cached_key)
+      || !g_variant_is_of_type(value, G_VARIANT_TYPE(CONFIG_CACHE_CONFIG_TYPE)))
+    return false;
+
+  GreeterConfigBranding *branding = config->branding;
+  GreeterConfigGreeter *greeter = config->greeter;
+  GreeterConfigFeatures *features = config->features;
+  gchar *background_images_dir, *logo_image, *user_image;
+  gchar *theme, *icon_theme, *time_language, *cache_dir;
+  g_autoptr(GVariantIter) layouts = NULL;
+  gchar **secure_mode_allowlist;
+  gboolean debug_mode, detect_theme_errors, secure_mode, battery, backlight_enabled;
+
+  g_variant_get(
+      value,
+      CONFIG_CACHE_CONFIG_TYPE,
+      &background_images_dir,
+      &logo_image,
+      &user_image,
+      &debug_mode,
+      &detect_theme_errors,
+      &greeter->screensaver_timeout,
+      &secure_mode,
+      &secure_mode_allowlist,
+      &theme,
+      &icon_theme,
+      &time_language,
+      &cache_dir,
+      &greeter->cache_size,
+      &layouts,
+      &battery,
+      &backlight_enabled,
+      &features->backlight->steps,
+      &features->backlight->value);
+
+  config_cache_take_string(&branding->background_images_dir, background_images_dir);
+  config_cache_take_string(&branding->logo_image, logo_image);
+  config_cache_take_string(&branding->user_image, user_image);
+  greeter->debug_mode = debug_mode;
+  greeter->detect_theme_errors = detect_theme_errors;
+  greeter->secure_mode = secure_mode;
+  g_strfreev(greeter->secure_mode_allowlist);
+  greeter->secure_mode_allowlist = secure_mode_allowlist;
+  config_cache_take_string(&greeter->theme, theme);
+  config_cache_take_string(&greeter->icon_theme, icon_theme);
+  config_cache_take_string(&greeter->time_language, time_language);
+  config_cache_take_string(&greeter->cache_dir, cache_dir);
+  features->battery = battery;
+  features->backlight->enabled = backlight_enabled;
+
+  gchar *layout;
+  while (g_variant_iter_next(layouts, "s", &layout)) {
+    g_ptr_array_add(config->layouts, layout);
+  }
+
+  return true;
+}
+
+/**
+ * Save config as the parsed configuration of config_path
+ */
+void
+config_cache_save(const gchar *config_path, const GreeterConfig *config)
+{
+  g_autoptr(GVariant) key = config_cache_key_new(config_path);
+  if (key == NULL)
+    return;
+
+  GVariantBuilder layouts;
+  g_variant_builder_init(&layouts, G_VARIANT_TYPE_STRING_ARRAY);
+  for (guint i = 0; i < config->layouts->len; i++) {
+    g_variant_builder_add(&layouts, "s", config->layouts->pdata[i]);
+  }
+
+  GreeterConfigBranding *branding = config->branding;
+  GreeterConfigGreeter *greeter = config->greeter;
+  GreeterConfigFeatures *features = config->features;
+  const gchar *const no_allowlist[] = { NULL };
+  const gchar *const *allowlist
+      = greeter->secure_mode_allowlist != NULL ? (const gchar *const *) greeter->secure_mode_allowlist : no_allowlist;
+  GVariant *value = g_variant_new(
+      CONFIG_CACHE_CONFIG_TYPE,
+      branding->background_images_dir,
+      branding->logo_image,
+      branding->user_image,
+      (gboolean) greeter->debug_mode,
+      (gboolean) greeter->detect_theme_errors,
+      greeter->screensaver_timeout,
+      (gboolean) greeter->secure_mode,
+      allowlist,
+      greeter->theme,
+      greeter->icon_theme,
+      greeter->time_language,
+      greeter->cache_dir,
+      greeter->cache_size,
+      &layouts,
+      (gboolean) features->battery,
+      (gboolean) features->backlight->enabled,
+      features->backlight->steps,
+      features->backlight->value);
+
+  g_autoptr(GVariant) cache
+      = g_variant_ref_sink(g_variant_new("(u@" CONFIG_CACHE_KEY_TYPE "v)", CONFIG_CACHE_VERSION, key, value));
+
+  g_autofree gchar *cache_path = config_cache_get_path();
+  g_autofree gchar *cache_dir = g_path_get_dirname(cache_path);
+  g_autoptr(GError) error = NULL;
+  if (g_mkdir_with_parents(cache_dir, 0700) != 0
+      || !g_file_set_contents_full(
+          cache_path,
+          g_variant_get_data(cache),
+          g_variant_get_size(cache),
+          G_FILE_SET_CONTENTS_CONSISTENT,
+          0600,
+          &error)) {
+    logger_debug("Config cache was not saved: %s", error != NULL ? error->message : g_strerror(errno));
+  }
+}
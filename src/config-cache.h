@@ -0,0 +1,11 @@
+#ifndef CONFIG_CACHE_H
+#define CONFIG_CACHE_H 1
+
+#include <glib.h>
+
+#include "settings.h"
+
+gboolean config_cache_load(const gchar *config_path, GreeterConfig *config);
+void config_cache_save(const gchar *config_path, const GreeterConfig *config);
+
+#endif
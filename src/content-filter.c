@@ -0,0 +1,187 @@
+#include <glib.h>
+#include <string.h>
+#include <webkit/webkit.h>
+
+#include "content-filter.h"
+#include "logger.h"
+#include "settings.h"
+#include "theme.h"
+
+extern GreeterConfig *greeter_config;
+
+/*
+ * In secure mode, every request but those of the local schemes and of the
+ * "secure_mode_allowlist" prefixes is blocked by a WebKit content filter.
+ * The rules are compiled once and kept in
+ * $XDG_CACHE_HOME/sea-greeter/content-filters, under an identifier derived
+ * from the rules, so a changed allowlist compiles new rules.
+ */
+static const char *const content_filter_schemes[] = { "file", "data", "web-greeter" };
+
+static WebKitUserContentFilterStore *filter_store = NULL;
+static WebKitUserContentFilter *content_filter = NULL;
+static gchar *filter_identifier = NULL;
+static GBytes *filter_rules = NULL;
+static gboolean filter_failed = false;
+
+static void
+content_filter_append_json_string(GString *json, const char *value)
+{
+  g_string_append_c(json, '"');
+  for (const char *c = value; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\')
+      g_string_append_c(json, '\\');
+    if ((guchar) *c < 0x20)
+      g_string_append_printf(json, "\\u%04x", (guchar) *c);
+    else
+      g_string_append_c(json, *c);
+  }
+  g_string_append_c(json, '"');
+}
+
+static void
+content_filter_append_allow_rule(GString *json, const char *url_filter)
+{
+  g_string_append(json, ",{\"trigger\":{\"url-filter\":");
+  content_filter_append_json_string(json, url_filter);
+  g_string_append(json, "},\"action\":{\"type\":\"ignore-previous-rules\"}}");
+}
+
+/**
+ * Build the rules in the content blocker JSON format
+ * Everything is blocked first, then the allowed URLs are let through
+ */
+static GBytes *
+content_filter_rules_new(const char *const *allowlist)
+{
+  GString *json = g_string_new("[{\"trigger\":{\"url-filter\":\".*\"},\"action\":{\"type\":\"block\"}}");
+
+  for (guint i = 0; i < G_N_ELEMENTS(content_filter_schemes); i++) {
+    g_autofree gchar *url_filter = g_strdup_printf("^%s:", content_filter_schemes[i]);
+    content_filter_append_allow_rule(json, url_filter);
+  }
+
+  for (guint i = 0; allowlist != NULL && allowlist[i] != NULL; i++) {
+    if (allowlist[i][0] == '\0')
+      continue;
+    // The allowlist holds plain prefixes, escape them for the url-filter regex
+    GString *url_filter = g_string_new("^");
+    for (const char *c = allowlist[i]; *c != '\0'; c++) {
+      if (strchr("\\^$.*+?()[]{}|", *c) != NULL)
+        g_string_append_c(url_filter, '\\');
+      g_string_append_c(url_filter, *c);
+    }
+    content_filter_append_allow_rule(json, url_filter->str);
+    g_string_free(url_filter, true);
+  }
+
+  g_string_append_c(json, ']');
+  return g_string_free_to_bytes(json);
+}
+
+static void
+content_filter_remove_stale_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) user_data;
+  WebKitUserContentFilterStore *store = WEBKIT_USER_CONTENT_FILTER_STORE(source_object);
+  g_auto(GStrv) identifiers = webkit_user_content_filter_store_fetch_identifiers_finish(store, result);
+
+  for (guint i = 0; identifiers != NULL && identifiers[i] != NULL; i++) {
+    if (g_strcmp0(identifiers[i], filter_identifier) != 0)
+      webkit_user_content_filter_store_remove(store, identifiers[i], NULL, NULL, NULL);
+  }
+}
+
+static void
+content_filter_save_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) user_data;
+  WebKitUserContentFilterStore *store = WEBKIT_USER_CONTENT_FILTER_STORE(source_object);
+  g_autoptr(GError) error = NULL;
+
+  content_filter = webkit_user_content_filter_store_save_finish(store, result, &error);
+  g_clear_pointer(&filter_rules, g_bytes_unref);
+  release_theme_loads();
+
+  if (content_filter == NULL) {
+    filter_failed = true;
+    logger_error("Secure mode content filter could not be compiled: %s", error->message);
+    return;
+  }
+  logger_debug("Secure mode content filter compiled");
+  webkit_user_content_filter_store_fetch_identifiers(store, NULL, content_filter_remove_stale_cb, NULL);
+}
+
+static void
+content_filter_load_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) user_data;
+  WebKitUserContentFilterStore *store = WEBKIT_USER_CONTENT_FILTER_STORE(source_object);
+
+  content_filter = webkit_user_content_filter_store_load_finish(store, result, NULL);
+  if (content_filter != NULL) {
+    g_clear_pointer(&filter_rules, g_bytes_unref);
+    release_theme_loads();
+    logger_debug("Secure mode content filter loaded from cache");
+    return;
+  }
+
+  webkit_user_content_filter_store_save(store, filter_identifier, filter_rules, NULL, content_filter_save_cb, NULL);
+}
+
+/**
+ * Start loading the secure mode filter, compiling it when it is not cached
+ * Themes are not loaded until the filter is ready
+ */
+void
+content_filter_prepare(void)
+{
+  if (!greeter_config->greeter->secure_mode || filter_store != NULL)
+    return;
+
+  filter_rules = content_filter_rules_new((const char *const *) greeter_config->greeter->secure_mode_allowlist);
+  g_autofree gchar *checksum = g_compute_checksum_for_bytes(G_CHECKSUM_SHA256, filter_rules);
+  filter_identifier = g_strdup_printf("secure-mode-%s", checksum);
+
+  g_autofree gchar *store_path = g_build_filename(g_get_user_cache_dir(), "sea-greeter", "content-filters", NULL);
+  filter_store = webkit_user_content_filter_store_new(store_path);
+  hold_theme_loads();
+  webkit_user_content_filter_store_load(filter_store, filter_identifier, NULL, content_filter_load_cb, NULL);
+}
+
+/**
+ * Add the secure mode filter to manager, once
+ * Called before a page is loaded, as load_theme waits for the filter to be ready
+ * @Returns Whether the requests of manager are filtered
+ */
+gboolean
+content_filter_attach(WebKitUserContentManager *manager)
+{
+  if (content_filter == NULL)
+    return false;
+
+  if (g_object_get_data(G_OBJECT(manager), "content-filter") == NULL) {
+    webkit_user_content_manager_add_filter(manager, content_filter);
+    g_object_set_data(G_OBJECT(manager), "content-filter", content_filter);
+  }
+  return true;
+}
+
+/**
+ * Whether the secure mode filter could not be compiled
+ * Web processes started while it is being prepared do not load themes yet
+ */
+gboolean
+content_filter_has_failed(void)
+{
+  return filter_failed;
+}
+
+void
+content_filter_destroy(void)
+{
+  g_clear_pointer(&content_filter, webkit_user_content_filter_unref);
+  g_clear_pointer(&filter_rules, g_bytes_unref);
+  g_clear_pointer(&filter_identifier, g_free);
+  g_clear_object(&filter_store);
+}
@@ -0,0 +1,11 @@
+#ifndef CONTENT_FILTER_H
+#define CONTENT_FILTER_H 1
+
+#include <webkit/webkit.h>
+
+void content_filter_prepare(void);
+gboolean content_filter_attach(WebKitUserContentManager *manager);
+gboolean content_filter_has_failed(void);
+void content_filter_destroy(void);
+
+#endif
@@ -63,32 +63,26 @@ handle_comm_broadcast(WebKitWebPage *web_page, WebKitUserMessage *message)
     return false;
 
   GVariant *msg_param = webkit_user_message_get_parameters(message);
-  if (!g_variant_is_of_type(msg_param, G_VARIANT_TYPE_ARRAY)) {
-    return false;
-  }
-  int parameters_length = g_variant_n_children(msg_param);
-  if (parameters_length == 0 || parameters_length > 2) {
+  if (msg_param == NULL || !g_variant_is_of_type(msg_param, G_VARIANT_TYPE("(sav)"))) {
     return false;
   }
 
   JSCContext *context = global_context;
-  JSCValue *parameters = NULL;
-
-  GVariant *method_var = g_variant_get_child_value(msg_param, 0);
-  GVariant *params_var = g_variant_get_child_value(msg_param, 1);
 
-  const gchar *method = g_variant_to_string(method_var);
-  const gchar *json_params = g_variant_to_string(params_var);
+  const gchar *method = NULL;
+  g_autoptr(GVariant) arguments = NULL;
+  g_variant_get(msg_param, "(&s@av)", &method, &arguments);
 
-  if (method == NULL) {
-    return false;
-  }
   if (g_strcmp0(method, "_emit") != 0) {
     return false;
   }
-  parameters = jsc_value_new_from_json(context, json_params);
-  JSCValue *data = jsc_value_object_get_property_at_index(parameters, 0);
-  g_object_unref(parameters);
+  JSCValue *data = NULL;
+  if (g_variant_n_children(arguments) > 0) {
+    g_autoptr(GVariant) first = g_variant_get_child_value(arguments, 0);
+    data = g_variant_to_jsc_value(context, first);
+  } else {
+    data = jsc_value_new_undefined(context);
+  }
 
   JSCValue *global_object = jsc_context_get_global_object(context);
   JSCValue *dispatch_event = jsc_value_object_get_property(global_object, "dispatchEvent");
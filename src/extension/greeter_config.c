@@ -7,13 +7,20 @@
 #include "bridge/lightdm-objects.h"
 #include "bridge/utils.h"
 
+#include "extension/lightdm-signal.h"
 #include "utils/ipc-renderer.h"
 #include "utils/utils.h"
+#include "watchdog.h"
 
 static WebKitWebPage *WebPage;
 static JSCClass *GreeterConfig_class;
 static ldm_object *GreeterConfig_object;
 
+static const struct JSCClassSignal GreeterConfig_signals[] = {
+  { "changed" },
+  { NULL },
+};
+
 static JSCValue *
 GreeterConfig_branding_getter_cb(ldm_object *instance)
 {
@@ -71,6 +78,47 @@ GreeterConfig_layouts_getter_cb(ldm_object *instance)
   return value;
 }
 
+/**
+ * Emit the "changed" signal with the sections of web-greeter.yml that were reloaded
+ */
+static gboolean
+handle_greeter_config_signal(WebKitWebPage *web_page, WebKitUserMessage *message, gpointer user_data)
+{
+  (void) web_page;
+  (void) user_data;
+  const char *name = webkit_user_message_get_name(message);
+  if (g_strcmp0(name, "greeter_config") != 0)
+    return false;
+
+  GVariant *msg_param = webkit_user_message_get_parameters(message);
+  if (msg_param == NULL || !g_variant_is_of_type(msg_param, G_VARIANT_TYPE("(sav)"))) {
+    return false;
+  }
+
+  JSCContext *context = GreeterConfig_object->context;
+
+  const gchar *signal = NULL;
+  g_autoptr(GVariant) arguments = NULL;
+  g_variant_get(msg_param, "(&s@av)", &signal, &arguments);
+  WATCHDOG_SCOPE("greeter_config.%s signal", signal);
+
+  g_autoptr(JSCValue) jsc_signal = jsc_value_object_get_property(GreeterConfig_object->value, signal);
+  if (jsc_signal == NULL || !jsc_value_is_object(jsc_signal)) {
+    return false;
+  }
+
+  gsize length = g_variant_n_children(arguments);
+  g_autoptr(GPtrArray) g_array = g_ptr_array_new_full(length, g_object_unref);
+  for (gsize i = 0; i < length; i++) {
+    g_autoptr(GVariant) argument = g_variant_get_child_value(arguments, i);
+    g_ptr_array_add(g_array, g_variant_to_jsc_value(context, argument));
+  }
+  g_autoptr(JSCValue) result
+      = jsc_value_object_invoke_methodv(jsc_signal, "emit", g_array->len, (JSCValue **) g_array->pdata);
+
+  return true;
+}
+
 static JSCValue *
 GreeterConfig_constructor(JSCContext *context)
 {
@@ -91,10 +139,13 @@ GreeterConfig_initialize(
   JSCValue *global_object = jsc_context_get_global_object(js_context);
 
   if (GreeterConfig_object != NULL) {
+    reset_object_signals(js_context, GreeterConfig_object->value, GreeterConfig_signals);
     jsc_value_object_set_property(global_object, "greeter_config", GreeterConfig_object->value);
     return;
   }
 
+  g_signal_connect(web_page, "user-message-received", G_CALLBACK(handle_greeter_config_signal), NULL);
+
   GreeterConfig_class = jsc_context_register_class(js_context, "__GreeterConfig", NULL, NULL, NULL);
   JSCValue *gc_constructor = jsc_class_add_constructor(
       GreeterConfig_class,
@@ -122,6 +173,7 @@ GreeterConfig_initialize(
   GreeterConfig_object->context = js_context;
 
   JSCValue *greeter_config_object = jsc_value_new_object(js_context, GreeterConfig_object, GreeterConfig_class);
+  initialize_object_signals(js_context, greeter_config_object, GreeterConfig_signals);
   GreeterConfig_object->value = greeter_config_object;
 
   jsc_value_object_set_property(global_object, "greeter_config", greeter_config_object);
@@ -4,8 +4,7 @@
 #include <jsc/jsc.h>
 #include <webkit/webkit-web-process-extension.h>
 
-#include "bridge/lightdm-objects.h"
-#include "bridge/utils.h"
+#include "extension/lightdm-signal.h"
 
 static JSCClass *LightDM_signal_class;
 static JSCValue *ldm_signal_constructor;
@@ -15,8 +14,26 @@ LightDM_signal_constructor(void)
 {
 }
 
+static void
+LightDM_signal_free(gpointer data)
+{
+  ldm_signal *instance = data;
+  g_object_unref(instance->value);
+  g_ptr_array_unref(instance->pending);
+  g_free(instance);
+}
+
+static JSCValue *
+LightDM_signal_get_callbacks(ldm_signal *instance)
+{
+  g_autoptr(JSCValue) object = jsc_weak_value_get_value(instance->value);
+  if (object == NULL)
+    return NULL;
+  return jsc_value_object_get_property(object, "_callbacks");
+}
+
 void
-LightDM_signal_connect(ldm_object *instance, GPtrArray *arguments)
+LightDM_signal_connect(ldm_signal *instance, GPtrArray *arguments)
 {
   if (arguments->len <= 0)
     return;
@@ -25,25 +42,14 @@ LightDM_signal_connect(ldm_object *instance, GPtrArray *arguments)
   if (!jsc_value_is_function(function))
     return;
 
-  JSCValue *value = instance->value;
-  JSCValue *array = jsc_value_object_get_property(value, "_callbacks");
-  gchar **properties = jsc_value_object_enumerate_properties(array);
-
-  int i = 0;
-  if (properties != NULL) {
-    gchar *curr = properties[i];
-    while (curr != NULL) {
-      i++;
-      curr = properties[i];
-    }
-  }
-
-  jsc_value_object_set_property_at_index(array, i, function);
-
-  g_strfreev(properties);
+  g_autoptr(JSCValue) callbacks = LightDM_signal_get_callbacks(instance);
+  if (callbacks == NULL)
+    return;
+  g_autoptr(JSCValue) result
+      = jsc_value_object_invoke_method(callbacks, "push", JSC_TYPE_VALUE, function, G_TYPE_NONE);
 }
 void
-LightDM_signal_disconnect(ldm_object *instance, GPtrArray *arguments)
+LightDM_signal_disconnect(ldm_signal *instance, GPtrArray *arguments)
 {
   if (arguments->len <= 0)
     return;
@@ -52,81 +58,117 @@ LightDM_signal_disconnect(ldm_object *instance, GPtrArray *arguments)
   if (!jsc_value_is_function(function))
     return;
 
-  JSCContext *js_context = instance->context;
-  JSCValue *value = instance->value;
-  JSCValue *array = jsc_value_object_get_property(value, "_callbacks");
-  gchar **properties = jsc_value_object_enumerate_properties(array);
-
-  if (properties == NULL)
+  g_autoptr(JSCValue) callbacks = LightDM_signal_get_callbacks(instance);
+  if (callbacks == NULL)
     return;
+  g_autoptr(JSCValue) length = jsc_value_object_get_property(callbacks, "length");
+  guint n_callbacks = jsc_value_to_int32(length);
+  for (guint i = 0; i < n_callbacks; i++) {
+    g_autoptr(JSCValue) callback = jsc_value_object_get_property_at_index(callbacks, i);
+    if (jsc_value_is_strict_equal(callback, function)) {
+      g_autoptr(JSCValue) result
+          = jsc_value_object_invoke_method(callbacks, "splice", G_TYPE_UINT, i, G_TYPE_UINT, 1, G_TYPE_NONE);
+      break;
+    }
+  }
+}
 
-  JSCValue *new_array = jsc_value_new_array(js_context, G_TYPE_NONE);
+/**
+ * Call every callback connected when the emission starts,
+ * so callbacks connecting or disconnecting do not change this emission
+ */
+static void
+LightDM_signal_dispatch(ldm_signal *instance, guint length, JSCValue **parameters)
+{
+  g_autoptr(JSCValue) callbacks = LightDM_signal_get_callbacks(instance);
+  if (callbacks == NULL)
+    return;
+  g_autoptr(JSCValue) snapshot = jsc_value_object_invoke_method(callbacks, "slice", G_TYPE_NONE);
+  g_autoptr(JSCValue) length_value = jsc_value_object_get_property(snapshot, "length");
+  gint n_callbacks = jsc_value_to_int32(length_value);
 
-  int i = 0;
-  int j = 0;
-  while (properties[i] != NULL) {
-    JSCValue *obtained = jsc_value_object_get_property_at_index(array, i);
-    if (obtained != function) {
-      jsc_value_object_set_property_at_index(new_array, j, obtained);
-      j++;
-    }
-    i++;
+  for (gint i = 0; i < n_callbacks; i++) {
+    g_autoptr(JSCValue) callback = jsc_value_object_get_property_at_index(snapshot, i);
+    g_autoptr(JSCValue) result = jsc_value_function_callv(callback, length, parameters);
   }
+}
+
+/**
+ * Dispatch every emission queued while the signal is deferred
+ */
+static void
+LightDM_signal_flush(ldm_signal *instance)
+{
+  instance->flush_scheduled = false;
 
-  jsc_value_object_set_property(value, "_callbacks", new_array);
+  g_autoptr(GPtrArray) pending = g_steal_pointer(&instance->pending);
+  instance->pending = g_ptr_array_new_with_free_func((GDestroyNotify) g_ptr_array_unref);
 
-  g_strfreev(properties);
+  for (guint i = 0; i < pending->len; i++) {
+    GPtrArray *arguments = pending->pdata[i];
+    LightDM_signal_dispatch(instance, arguments->len, (JSCValue **) arguments->pdata);
+  }
 }
+
 void
-LightDM_signal_emit(ldm_object *instance, GPtrArray *arguments)
+LightDM_signal_emit(ldm_signal *instance, GPtrArray *arguments)
 {
-  JSCValue *value = instance->value;
-  JSCValue *array = jsc_value_object_get_property(value, "_callbacks");
-  gchar **properties = jsc_value_object_enumerate_properties(array);
-
-  if (properties == NULL)
+  if (!instance->deferred) {
+    LightDM_signal_dispatch(instance, arguments->len, (JSCValue **) arguments->pdata);
     return;
+  }
 
-  int i = 0;
-  while (properties[i] != NULL) {
-    JSCValue *obtained = jsc_value_object_get_property_at_index(array, i);
-    int length = arguments->len;
-    JSCValue **parameters = (JSCValue **) arguments->pdata;
-    (void) jsc_value_function_callv(obtained, length, parameters);
-    i++;
+  GPtrArray *queued = g_ptr_array_new_full(arguments->len, g_object_unref);
+  for (guint i = 0; i < arguments->len; i++) {
+    g_ptr_array_add(queued, g_object_ref(arguments->pdata[i]));
   }
+  g_ptr_array_add(instance->pending, queued);
+
+  if (instance->flush_scheduled)
+    return;
+  instance->flush_scheduled = true;
+
+  JSCContext *context = instance->context;
+  g_autoptr(JSCValue) queue_microtask = jsc_context_get_value(context, "queueMicrotask");
+  g_autoptr(JSCValue) flush = jsc_value_new_function(
+      context,
+      NULL,
+      G_CALLBACK(LightDM_signal_flush),
+      instance,
+      NULL,
+      G_TYPE_NONE,
+      0);
+  g_autoptr(JSCValue) result = jsc_value_function_call(queue_microtask, JSC_TYPE_VALUE, flush, G_TYPE_NONE);
+}
+
+static gboolean
+LightDM_signal_deferred_getter(ldm_signal *instance)
+{
+  return instance->deferred;
+}
+static void
+LightDM_signal_deferred_setter(ldm_signal *instance, gboolean deferred)
+{
+  instance->deferred = deferred;
 }
 
 JSCValue *
 LightDM_signal_new(JSCContext *js_context, const gchar *name)
 {
-  JSCValue *value = jsc_value_constructor_callv(ldm_signal_constructor, 0, NULL);
-  ldm_object *instance = malloc(sizeof *instance);
-  instance->value = value;
+  ldm_signal *instance = g_malloc(sizeof *instance);
   instance->context = js_context;
+  instance->pending = g_ptr_array_new_with_free_func((GDestroyNotify) g_ptr_array_unref);
+  instance->deferred = false;
+  instance->flush_scheduled = false;
 
   JSCValue *ldm_signal_object = jsc_value_new_object(js_context, instance, LightDM_signal_class);
 
-  instance->value = ldm_signal_object;
-
-  JSCValue *signal_name = jsc_value_new_string(js_context, name);
-  JSCValue *signal_callbacks = jsc_value_new_array(js_context, G_TYPE_NONE);
+  instance->value = jsc_weak_value_new(ldm_signal_object);
 
+  g_autoptr(JSCValue) signal_name = jsc_value_new_string(js_context, name);
   jsc_value_object_set_property(ldm_signal_object, "_name", signal_name);
-  jsc_value_object_set_property(ldm_signal_object, "_callbacks", signal_callbacks);
-
-  gchar **properties = jsc_value_object_enumerate_properties(ldm_signal_object);
-
-  int i = 0;
-  if (properties != NULL) {
-    gchar *curr = properties[i];
-    while (curr != NULL) {
-      /*printf("%d: %s\n", i, curr);*/
-      i++;
-      curr = properties[i];
-    }
-  }
-  /*printf("PROPERTIES: %d\n", i);*/
+  g_autoptr(JSCValue) callbacks = jsc_value_new_array(js_context, G_TYPE_NONE);
+  jsc_value_object_set_property(ldm_signal_object, "_callbacks", callbacks);
 
   return ldm_signal_object;
 }
@@ -142,7 +184,7 @@ LightDM_signal_initialize(
   (void) extension;
 
   JSCContext *js_context = webkit_frame_get_js_context_for_script_world(web_frame, world);
-  LightDM_signal_class = jsc_context_register_class(js_context, "__LightDMSignal", NULL, NULL, NULL);
+  LightDM_signal_class = jsc_context_register_class(js_context, "__LightDMSignal", NULL, NULL, LightDM_signal_free);
   ldm_signal_constructor = jsc_class_add_constructor(
       LightDM_signal_class,
       NULL,
@@ -166,6 +208,14 @@ LightDM_signal_initialize(
       NULL,
       G_TYPE_NONE);
   jsc_class_add_method_variadic(LightDM_signal_class, "emit", G_CALLBACK(LightDM_signal_emit), NULL, NULL, G_TYPE_NONE);
+  jsc_class_add_property(
+      LightDM_signal_class,
+      "deferred",
+      G_TYPE_BOOLEAN,
+      G_CALLBACK(LightDM_signal_deferred_getter),
+      G_CALLBACK(LightDM_signal_deferred_setter),
+      NULL,
+      NULL);
 }
 
 /**
@@ -177,9 +227,23 @@ initialize_object_signals(JSCContext *js_context, JSCValue *object, const struct
   int i = 0;
   struct JSCClassSignal current = signals[i];
   while (current.name != NULL) {
-    JSCValue *signal = LightDM_signal_new(js_context, current.name);
+    g_autoptr(JSCValue) signal = LightDM_signal_new(js_context, current.name);
     jsc_value_object_set_property(object, current.name, signal);
     i++;
     current = signals[i];
   }
 }
+
+/**
+ * Disconnect every callback of the object signals
+ * The object outlives the page, so callbacks of the previous page are dropped when a new one loads
+ */
+void
+reset_object_signals(JSCContext *js_context, JSCValue *object, const struct JSCClassSignal signals[])
+{
+  for (guint i = 0; signals[i].name != NULL; i++) {
+    g_autoptr(JSCValue) signal = jsc_value_object_get_property(object, signals[i].name);
+    g_autoptr(JSCValue) callbacks = jsc_value_new_array(js_context, G_TYPE_NONE);
+    jsc_value_object_set_property(signal, "_callbacks", callbacks);
+  }
+}
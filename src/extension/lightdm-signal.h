@@ -7,7 +7,20 @@
 #include "bridge/lightdm-objects.h"
 #include "bridge/utils.h"
 
-void LightDM_signal_connect(ldm_object *instance, GPtrArray *arguments);
+/**
+ * Native state of a __LightDMSignal instance
+ * Callbacks live in the "_callbacks" array of the JS object, so they are
+ * collected along with the page. The object itself is only weakly referenced.
+ */
+typedef struct _LDMSignal {
+  JSCContext *context;
+  JSCWeakValue *value;
+  GPtrArray *pending;
+  gboolean deferred;
+  gboolean flush_scheduled;
+} ldm_signal;
+
+void LightDM_signal_connect(ldm_signal *instance, GPtrArray *arguments);
 
 JSCValue *LightDM_signal_new(JSCContext *js_context, const gchar *name);
 
@@ -17,5 +30,6 @@ void LightDM_signal_initialize(
     WebKitFrame *web_frame,
     WebKitWebProcessExtension *extension);
 void initialize_object_signals(JSCContext *js_context, JSCValue *object, const struct JSCClassSignal signals[]);
+void reset_object_signals(JSCContext *js_context, JSCValue *object, const struct JSCClassSignal signals[]);
 
 #endif
@@ -7,6 +7,7 @@
 #include "extension/lightdm-signal.h"
 #include "utils/ipc-renderer.h"
 #include "utils/utils.h"
+#include "watchdog.h"
 
 static WebKitWebPage *WebPage;
 
@@ -14,8 +15,165 @@ static JSCClass *LightDM_class;
 static ldm_object *LightDM_object;
 static JSCValue *ready_event;
 
+/**
+ * Cache of a LightDM object list, like users or sessions.
+ * Each JS object wraps its "a{sv}" record, which is a slice of the reply
+ * buffer, and only materializes a field when a theme reads it.
+ * The JS objects belong to the context of the page, so the cache is dropped
+ * when the page gets a new one.
+ */
+typedef struct {
+  JSCClass *class;
+  GVariant *records;
+  GPtrArray *items;
+} LightDMObjectList;
+
+static LightDMObjectList users_list;
+static LightDMObjectList sessions_list;
+static LightDMObjectList remote_sessions_list;
+
+static const gchar *const LightDMUser_fields[] = {
+  "background",
+  "display_name",
+  "home_directory",
+  "image",
+  "language",
+  "layout",
+  "layouts",
+  "logged_in",
+  "session",
+  "thumbnail",
+  "username",
+  NULL,
+};
+static const gchar *const LightDMSession_fields[] = {
+  "comment",
+  "key",
+  "name",
+  "type",
+  NULL,
+};
+
+/**
+ * Data of a LightDM object wrapper: its record, and the fields read so far,
+ * so reading a field twice gives the same value
+ */
+typedef struct {
+  GVariant *record;
+  GHashTable *fields;
+} LightDMObjectRecord;
+
+static const struct JSCClassSignal LightDM_signals[] = {
+  { "authentication_complete" },
+  { "autologin_timer_expired" },
+  { "show_prompt" },
+  { "show_message" },
+  { "property_changed" },
+  { NULL },
+};
+
 /*static GString *shared_data_directory;*/
 
+/* LightDM object lists */
+
+static LightDMObjectRecord *
+LightDMObject_record_new(GVariant *record)
+{
+  LightDMObjectRecord *object = g_new0(LightDMObjectRecord, 1);
+  object->record = record;
+  object->fields = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_object_unref);
+  return object;
+}
+
+static void
+LightDMObject_record_free(gpointer data)
+{
+  LightDMObjectRecord *object = data;
+  g_variant_unref(object->record);
+  g_hash_table_unref(object->fields);
+  g_free(object);
+}
+
+static JSCValue *
+LightDMObject_field_getter_cb(LightDMObjectRecord *object, const gchar *field)
+{
+  JSCValue *cached = g_hash_table_lookup(object->fields, field);
+  if (cached != NULL)
+    return g_object_ref(cached);
+
+  JSCContext *context = jsc_context_get_current();
+  g_autoptr(GVariant) value = g_variant_lookup_value(object->record, field, NULL);
+  JSCValue *js_value = g_variant_to_jsc_value(context, value);
+  g_hash_table_insert(object->fields, (gpointer) field, g_object_ref(js_value));
+  return js_value;
+}
+
+static void
+LightDMObject_list_clear(LightDMObjectList *list)
+{
+  g_clear_pointer(&list->records, g_variant_unref);
+  g_clear_pointer(&list->items, g_ptr_array_unref);
+}
+
+static JSCClass *
+LightDMObject_register_class(JSCContext *context, const gchar *name, const gchar *const fields[])
+{
+  JSCClass *class = jsc_context_register_class(context, name, NULL, NULL, LightDMObject_record_free);
+  for (guint i = 0; fields[i] != NULL; i++) {
+    jsc_class_add_property(
+        class,
+        fields[i],
+        JSC_TYPE_VALUE,
+        G_CALLBACK(LightDMObject_field_getter_cb),
+        NULL,
+        (gpointer) fields[i],
+        NULL);
+  }
+  return class;
+}
+
+/**
+ * Returns a JS array for the "aa{sv}" records, reusing the previous JS
+ * objects when the records did not change
+ */
+static JSCValue *
+LightDMObject_list_to_jsc_value(JSCContext *context, LightDMObjectList *list, GVariant *records)
+{
+  if (records == NULL || !g_variant_is_of_type(records, G_VARIANT_TYPE("aa{sv}")))
+    return jsc_value_new_array(context, G_TYPE_NONE);
+
+  if (list->records == NULL || !g_variant_equal(list->records, records)) {
+    LightDMObject_list_clear(list);
+
+    gsize length = g_variant_n_children(records);
+    list->records = g_variant_ref(records);
+    list->items = g_ptr_array_new_full(length, g_object_unref);
+    for (gsize i = 0; i < length; i++) {
+      GVariant *record = g_variant_get_child_value(records, i);
+      g_ptr_array_add(list->items, jsc_value_new_object(context, LightDMObject_record_new(record), list->class));
+    }
+  }
+
+  return jsc_value_new_array_from_garray(context, list->items);
+}
+
+static JSCValue *
+LightDMObject_list_getter(ldm_object *instance, LightDMObjectList *list, const gchar *property)
+{
+  JSCContext *context = instance->context;
+
+  WebKitUserMessage *reply
+      = ipc_renderer_send_message_sync_with_arguments(WebPage, context, "lightdm", property, NULL);
+  if (reply == NULL) {
+    return jsc_value_new_array(context, G_TYPE_NONE);
+  }
+  GVariant *reply_param = webkit_user_message_get_parameters(reply);
+  JSCValue *value = LightDMObject_list_to_jsc_value(context, list, reply_param);
+
+  g_object_unref(reply);
+  return value;
+}
+
 /* LightDM Class definitions */
 
 static JSCValue *
@@ -34,6 +192,21 @@ LightDM_authenticate_cb(ldm_object *instance, GPtrArray *arguments)
   return value;
 }
 static JSCValue *
+LightDM_avatar_atlas_cb(ldm_object *instance, GPtrArray *arguments)
+{
+  JSCContext *context = instance->context;
+
+  WebKitUserMessage *reply
+      = ipc_renderer_send_message_sync_with_arguments(WebPage, context, "lightdm", "avatar_atlas", arguments);
+  if (reply == NULL) {
+    return jsc_value_new_null(context);
+  }
+  GVariant *reply_param = webkit_user_message_get_parameters(reply);
+  JSCValue *value = g_variant_reply_to_jsc_value(context, reply_param);
+
+  return value;
+}
+static JSCValue *
 LightDM_authenticate_as_guest_cb(ldm_object *instance, GPtrArray *arguments)
 {
   JSCContext *context = instance->context;
@@ -139,6 +312,21 @@ LightDM_set_language_cb(ldm_object *instance, GPtrArray *arguments)
   return value;
 }
 static JSCValue *
+LightDM_set_layout_by_name_cb(ldm_object *instance, GPtrArray *arguments)
+{
+  JSCContext *context = instance->context;
+
+  WebKitUserMessage *reply
+      = ipc_renderer_send_message_sync_with_arguments(WebPage, context, "lightdm", "set_layout_by_name", arguments);
+  if (reply == NULL) {
+    return jsc_value_new_boolean(context, false);
+  }
+  GVariant *reply_param = webkit_user_message_get_parameters(reply);
+  JSCValue *value = g_variant_reply_to_jsc_value(context, reply_param);
+
+  return value;
+}
+static JSCValue *
 LightDM_shutdown_cb(ldm_object *instance, GPtrArray *arguments)
 {
   JSCContext *context = instance->context;
@@ -470,6 +658,12 @@ static JSCValue *
 LightDM_layout_setter_cb(ldm_object *instance, JSCValue *object)
 {
   JSCContext *context = instance->context;
+  if (!jsc_value_is_object(object) || !jsc_value_object_has_property(object, "name")
+      || !jsc_value_object_has_property(object, "description")
+      || !jsc_value_object_has_property(object, "short_description")) {
+    jsc_context_throw(context, "Invalid LightDMLayout");
+    return NULL;
+  }
   GPtrArray *arguments = g_ptr_array_new();
   g_ptr_array_add(arguments, object);
 
@@ -517,17 +711,7 @@ LightDM_lock_hint_getter_cb(ldm_object *instance)
 static JSCValue *
 LightDM_remote_sessions_getter_cb(ldm_object *instance)
 {
-  JSCContext *context = instance->context;
-
-  WebKitUserMessage *reply
-      = ipc_renderer_send_message_sync_with_arguments(WebPage, context, "lightdm", "remote_sessions", NULL);
-  if (reply == NULL) {
-    return jsc_value_new_array(context, G_TYPE_NONE);
-  }
-  GVariant *reply_param = webkit_user_message_get_parameters(reply);
-  JSCValue *value = g_variant_reply_to_jsc_value(context, reply_param);
-
-  return value;
+  return LightDMObject_list_getter(instance, &remote_sessions_list, "remote_sessions");
 }
 static JSCValue *
 LightDM_select_guest_hint_getter_cb(ldm_object *instance)
@@ -562,17 +746,7 @@ LightDM_select_user_hint_getter_cb(ldm_object *instance)
 static JSCValue *
 LightDM_sessions_getter_cb(ldm_object *instance)
 {
-  JSCContext *context = instance->context;
-
-  WebKitUserMessage *reply
-      = ipc_renderer_send_message_sync_with_arguments(WebPage, context, "lightdm", "sessions", NULL);
-  if (reply == NULL) {
-    return jsc_value_new_array(context, G_TYPE_NONE);
-  }
-  GVariant *reply_param = webkit_user_message_get_parameters(reply);
-  JSCValue *value = g_variant_reply_to_jsc_value(context, reply_param);
-
-  return value;
+  return LightDMObject_list_getter(instance, &sessions_list, "sessions");
 }
 static JSCValue *
 LightDM_shared_data_directory_getter_cb(ldm_object *instance)
@@ -622,16 +796,7 @@ LightDM_show_remote_login_hint_getter_cb(ldm_object *instance)
 static JSCValue *
 LightDM_users_getter_cb(ldm_object *instance)
 {
-  JSCContext *context = instance->context;
-
-  WebKitUserMessage *reply = ipc_renderer_send_message_sync_with_arguments(WebPage, context, "lightdm", "users", NULL);
-  if (reply == NULL) {
-    return jsc_value_new_array(context, G_TYPE_NONE);
-  }
-  GVariant *reply_param = webkit_user_message_get_parameters(reply);
-  JSCValue *value = g_variant_reply_to_jsc_value(context, reply_param);
-
-  return value;
+  return LightDMObject_list_getter(instance, &users_list, "users");
 }
 
 static gboolean
@@ -643,39 +808,31 @@ handle_lightdm_signal(WebKitWebPage *web_page, WebKitUserMessage *message)
     return false;
 
   GVariant *msg_param = webkit_user_message_get_parameters(message);
-  if (!g_variant_is_of_type(msg_param, G_VARIANT_TYPE_ARRAY)) {
-    return false;
-  }
-  int parameters_length = g_variant_n_children(msg_param);
-  if (parameters_length == 0 || parameters_length > 2) {
+  if (msg_param == NULL || !g_variant_is_of_type(msg_param, G_VARIANT_TYPE("(sav)"))) {
     return false;
   }
 
   JSCContext *context = LightDM_object->context;
-  JSCValue *parameters = NULL;
-
-  GVariant *method_var = g_variant_get_child_value(msg_param, 0);
-  GVariant *params_var = g_variant_get_child_value(msg_param, 1);
 
-  const gchar *signal = g_variant_to_string(method_var);
-  const gchar *json_params = g_variant_to_string(params_var);
+  const gchar *signal = NULL;
+  g_autoptr(GVariant) arguments = NULL;
+  g_variant_get(msg_param, "(&s@av)", &signal, &arguments);
+  WATCHDOG_SCOPE("lightdm.%s signal", signal);
 
-  g_variant_unref(method_var);
-  g_variant_unref(params_var);
-  if (signal == NULL) {
+  g_autoptr(JSCValue) jsc_signal = jsc_value_object_get_property(LightDM_object->value, signal);
+  if (jsc_signal == NULL || !jsc_value_is_object(jsc_signal)) {
     return false;
   }
 
-  JSCValue *jsc_signal = jsc_value_object_get_property(LightDM_object->value, signal);
-  if (jsc_signal == NULL) {
-    return false;
+  gsize length = g_variant_n_children(arguments);
+  g_autoptr(GPtrArray) g_array = g_ptr_array_new_full(length, g_object_unref);
+  for (gsize i = 0; i < length; i++) {
+    g_autoptr(GVariant) argument = g_variant_get_child_value(arguments, i);
+    g_ptr_array_add(g_array, g_variant_to_jsc_value(context, argument));
   }
-  parameters = jsc_value_new_from_json(context, json_params);
-  GPtrArray *g_array = jsc_array_to_g_ptr_array(parameters);
-  (void) jsc_value_object_invoke_methodv(jsc_signal, "emit", g_array->len, (JSCValue **) g_array->pdata);
+  g_autoptr(JSCValue) result
+      = jsc_value_object_invoke_methodv(jsc_signal, "emit", g_array->len, (JSCValue **) g_array->pdata);
 
-  g_ptr_array_free(g_array, true);
-  g_object_unref(parameters);
   return true;
 }
 
@@ -723,7 +880,13 @@ LightDM_initialize(
   JSCContext *js_context = webkit_frame_get_js_context_for_script_world(web_frame, world);
   JSCValue *global_object = jsc_context_get_global_object(js_context);
 
+  // The cached JS objects belong to the previous page
+  LightDMObject_list_clear(&users_list);
+  LightDMObject_list_clear(&sessions_list);
+  LightDMObject_list_clear(&remote_sessions_list);
+
   if (LightDM_object != NULL) {
+    reset_object_signals(js_context, LightDM_object->value, LightDM_signals);
     jsc_value_object_set_property(global_object, "lightdm", LightDM_object->value);
 
     jsc_value_object_set_property(global_object, "_ready_event", ready_event);
@@ -786,6 +949,7 @@ LightDM_initialize(
   };
   const struct JSCClassMethod LightDM_methods[] = {
     { "authenticate", G_CALLBACK(LightDM_authenticate_cb), JSC_TYPE_VALUE },
+    { "avatar_atlas", G_CALLBACK(LightDM_avatar_atlas_cb), JSC_TYPE_VALUE },
     { "authenticate_as_guest", G_CALLBACK(LightDM_authenticate_as_guest_cb), JSC_TYPE_VALUE },
     { "cancel_authentication", G_CALLBACK(LightDM_cancel_authentication_cb), JSC_TYPE_VALUE },
     { "cancel_autologin", G_CALLBACK(LightDM_cancel_autologin_cb), JSC_TYPE_VALUE },
@@ -793,19 +957,22 @@ LightDM_initialize(
     { "respond", G_CALLBACK(LightDM_respond_cb), JSC_TYPE_VALUE },
     { "restart", G_CALLBACK(LightDM_restart_cb), JSC_TYPE_VALUE },
     { "set_language", G_CALLBACK(LightDM_set_language_cb), JSC_TYPE_VALUE },
+    { "set_layout_by_name", G_CALLBACK(LightDM_set_layout_by_name_cb), JSC_TYPE_VALUE },
     { "shutdown", G_CALLBACK(LightDM_shutdown_cb), JSC_TYPE_VALUE },
     { "start_session", G_CALLBACK(LightDM_start_session_cb), JSC_TYPE_VALUE },
     { "suspend", G_CALLBACK(LightDM_suspend_cb), JSC_TYPE_VALUE },
 
     { NULL, NULL, 0 },
   };
-  const struct JSCClassSignal LightDM_signals[] = {
-    { "authentication_complete" }, { "autologin_timer_expired" }, { "show_prompt" }, { "show_message" }, { NULL },
-  };
-
   initialize_class_properties(LightDM_class, LightDM_properties);
   initialize_class_methods(LightDM_class, LightDM_methods);
 
+  JSCClass *user_class = LightDMObject_register_class(js_context, "__LightDMUser", LightDMUser_fields);
+  JSCClass *session_class = LightDMObject_register_class(js_context, "__LightDMSession", LightDMSession_fields);
+  users_list.class = user_class;
+  sessions_list.class = session_class;
+  remote_sessions_list.class = session_class;
+
   JSCValue *value = jsc_value_constructor_callv(ldm_constructor, 0, NULL);
   LightDM_object = malloc(sizeof *LightDM_object);
   LightDM_object->value = value;
@@ -13,6 +13,17 @@
 static WebKitWebPage *WebPage = NULL;
 ldm_object *ThemeUtils_object = NULL;
 
+/**
+ * A dirlist call waiting for its files
+ */
+typedef struct {
+  JSCValue *callback;
+  gboolean stream;
+} DirlistCall;
+
+static GHashTable *dirlist_calls = NULL;
+static guint dirlist_last_id = 0;
+
 static void *
 jsc_callback_call(JSCContext *context, JSCValue *callback, JSCValue *value)
 {
@@ -32,6 +43,56 @@ jsc_callback_call(JSCContext *context, JSCValue *callback, JSCValue *value)
   return NULL;
 }
 
+static void
+ThemeUtils_dirlist_call_free(gpointer data)
+{
+  DirlistCall *call = data;
+  g_object_unref(call->callback);
+  g_free(call);
+}
+
+/**
+ * Give files to a dirlist callback
+ * Streaming callbacks get every chunk, along with whether it is the last one
+ */
+static void
+ThemeUtils_dirlist_call_files(DirlistCall *call, GVariant *files, gboolean done)
+{
+  JSCContext *context = jsc_value_get_context(call->callback);
+  JSCValue *value = files != NULL ? g_variant_reply_to_jsc_value(context, files) : NULL;
+  if (value == NULL)
+    value = jsc_value_new_array(context, G_TYPE_NONE);
+
+  if (call->stream)
+    (void) jsc_value_function_call(call->callback, JSC_TYPE_VALUE, value, G_TYPE_BOOLEAN, done, G_TYPE_NONE);
+  else
+    (void) jsc_value_function_call(call->callback, JSC_TYPE_VALUE, value, G_TYPE_NONE);
+  g_object_unref(value);
+}
+
+static void
+ThemeUtils_dirlist_reply_cb(GObject *web_page, GAsyncResult *res, gpointer user_data)
+{
+  guint id = GPOINTER_TO_UINT(user_data);
+  g_autoptr(WebKitUserMessage) reply
+      = webkit_web_page_send_message_to_view_finish(WEBKIT_WEB_PAGE(web_page), res, NULL);
+
+  DirlistCall *call = g_hash_table_lookup(dirlist_calls, GUINT_TO_POINTER(id));
+  if (call == NULL)
+    return;
+
+  GVariant *files = reply != NULL ? webkit_user_message_get_parameters(reply) : NULL;
+  ThemeUtils_dirlist_call_files(call, files, true);
+  g_hash_table_remove(dirlist_calls, GUINT_TO_POINTER(id));
+}
+
+/**
+ * theme_utils.dirlist(path, only_images, callback)
+ * only_images may also be an options object, with only_images, stream, sort,
+ * reverse, offset, limit, random and dimensions. The directory is read in the
+ * UI process without blocking either process; with stream the callback gets
+ * the files in chunks
+ */
 static void *
 ThemeUtils_dirlist_cb(ldm_object *instance, GPtrArray *arguments)
 {
@@ -42,12 +103,14 @@ ThemeUtils_dirlist_cb(ldm_object *instance, GPtrArray *arguments)
   JSCValue *jsc_console = jsc_context_get_value(context, "console");
 
   JSCValue *jsc_path = arguments->pdata[0];
+  JSCValue *jsc_options = arguments->pdata[1];
   JSCValue *jsc_callback = arguments->pdata[2];
 
   JSCValue *empty_value = jsc_value_new_array(context, G_TYPE_NONE);
 
   g_autofree gchar *path = js_value_to_string_or_null(jsc_path);
-  path = g_strstrip(path);
+  if (path != NULL)
+    path = g_strstrip(path);
   if (path == NULL || g_strcmp0(path, "") == 0) {
     (void) jsc_value_object_invoke_method(
         jsc_console,
@@ -57,16 +120,83 @@ ThemeUtils_dirlist_cb(ldm_object *instance, GPtrArray *arguments)
         G_TYPE_NONE);
     return jsc_callback_call(context, jsc_callback, empty_value);
   }
-
-  WebKitUserMessage *reply
-      = ipc_renderer_send_message_sync_with_arguments(WebPage, context, "theme_utils", "dirlist", arguments);
-  if (reply == NULL) {
+  if (!jsc_value_is_function(jsc_callback)) {
     return jsc_callback_call(context, jsc_callback, empty_value);
   }
-  GVariant *reply_param = webkit_user_message_get_parameters(reply);
-  JSCValue *value = g_variant_reply_to_jsc_value(context, reply_param);
 
-  return jsc_callback_call(context, jsc_callback, value);
+  gboolean stream = false;
+  if (jsc_value_is_object(jsc_options) && !jsc_value_is_array(jsc_options)
+      && jsc_value_object_has_property(jsc_options, "stream")) {
+    g_autoptr(JSCValue) jsc_stream = jsc_value_object_get_property(jsc_options, "stream");
+    stream = jsc_value_to_boolean(jsc_stream);
+  }
+
+  guint id = ++dirlist_last_id;
+  DirlistCall *call = g_new0(DirlistCall, 1);
+  call->callback = g_object_ref(jsc_callback);
+  call->stream = stream;
+  g_hash_table_insert(dirlist_calls, GUINT_TO_POINTER(id), call);
+
+  g_autoptr(JSCValue) jsc_id = jsc_value_new_number(context, id);
+  g_autoptr(GPtrArray) parameters = g_ptr_array_new();
+  g_ptr_array_add(parameters, jsc_path);
+  g_ptr_array_add(parameters, jsc_options);
+  g_ptr_array_add(parameters, jsc_id);
+
+  ipc_renderer_send_message_with_arguments(
+      WebPage,
+      context,
+      "theme_utils",
+      "dirlist",
+      parameters,
+      ThemeUtils_dirlist_reply_cb,
+      GUINT_TO_POINTER(id));
+
+  return NULL;
+}
+
+/**
+ * Handle the chunks of a streaming dirlist
+ */
+static gboolean
+handle_dirlist_chunk(WebKitWebPage *web_page, WebKitUserMessage *message)
+{
+  (void) web_page;
+
+  const char *name = webkit_user_message_get_name(message);
+  if (g_strcmp0(name, "theme_utils") != 0)
+    return false;
+
+  GVariant *msg_param = webkit_user_message_get_parameters(message);
+  if (msg_param == NULL || !g_variant_is_of_type(msg_param, G_VARIANT_TYPE("(sav)")))
+    return false;
+
+  const gchar *method = NULL;
+  g_autoptr(GVariant) arguments = NULL;
+  g_variant_get(msg_param, "(&s@av)", &method, &arguments);
+  if (g_strcmp0(method, "_dirlist_chunk") != 0 || g_variant_n_children(arguments) < 2)
+    return false;
+
+  guint id = 0;
+  g_autoptr(GVariant) files = NULL;
+  g_variant_get_child(arguments, 0, "v", &files);
+  if (g_variant_is_of_type(files, G_VARIANT_TYPE_UINT32))
+    id = g_variant_get_uint32(files);
+  g_clear_pointer(&files, g_variant_unref);
+  g_variant_get_child(arguments, 1, "v", &files);
+
+  DirlistCall *call = g_hash_table_lookup(dirlist_calls, GUINT_TO_POINTER(id));
+  if (call != NULL && call->stream)
+    ThemeUtils_dirlist_call_files(call, files, false);
+
+  return true;
+}
+
+static gboolean
+web_page_user_message_received(WebKitWebPage *web_page, WebKitUserMessage *message, gpointer user_data)
+{
+  (void) user_data;
+  return handle_dirlist_chunk(web_page, message);
 }
 
 char *time_language = NULL;
@@ -176,6 +306,9 @@ ThemeUtils_initialize(
     return;
   }
 
+  dirlist_calls = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, ThemeUtils_dirlist_call_free);
+  g_signal_connect(web_page, "user-message-received", G_CALLBACK(web_page_user_message_received), NULL);
+
   JSCClass *ThemeUtils_class = jsc_context_register_class(js_context, "__GreeterConfig", NULL, NULL, NULL);
 
   JSCValue *gc_constructor = jsc_class_add_constructor(
@@ -1,6 +1,8 @@
 #include <webkit/webkit-web-process-extension.h>
 
 #include "lightdm-extension.h"
+#include "logger.h"
+#include "watchdog.h"
 
 #include "utils/ipc-renderer.h"
 
@@ -9,6 +11,9 @@ gboolean detect_theme_errors = false;
 
 guint64 page_id;
 
+/* URL prefixes let through in secure mode, besides the local schemes */
+static gchar **secure_mode_allowlist = NULL;
+
 static void
 web_page_document_loaded(WebKitWebPage *web_page, gpointer user_data)
 {
@@ -41,41 +46,176 @@ web_page_send_request_cb(
   gboolean not_webg_uri = g_strcmp0(scheme, "web-greeter") != 0;
 
   gboolean deny_request = not_local_file && not_data_uri && not_webg_uri;
+  for (guint i = 0; deny_request && secure_mode_allowlist != NULL && secure_mode_allowlist[i] != NULL; i++) {
+    if (secure_mode_allowlist[i][0] != '\0' && g_str_has_prefix(uri, secure_mode_allowlist[i]))
+      deny_request = false;
+  }
 
   /*printf("Allow: %d\n", deny_request);*/
 
   return deny_request;
 }
 
-#define WEB_PAGE_LOG() fprintf(stderr, "%s [ %s ] %s %d: %s\n", timestamp, type, source_id, line, message);
+#define WEB_PAGE_LOG(level)                                   \
+  {                                                           \
+    if ((level) >= logger_level)                              \
+      logger_log(type, source_id, (int) line, "%s", message); \
+  }
+
+/*
+ * Theme errors are not sent one by one: the same error is counted while a
+ * report waits to be sent, and at most one report per interval is sent,
+ * never while the previous one is still shown.
+ */
+#define CONSOLE_REPORT_INTERVAL 1000
+#define CONSOLE_REPORT_MAX_ERRORS 32
+
+typedef struct {
+  gchar *source_id;
+  guint line;
+  gchar *message;
+  guint count;
+} ConsoleError;
+
+/**
+ * Errors of a page waiting to be reported, attached to it as "console-report"
+ */
+typedef struct {
+  WebKitWebPage *page;
+  GHashTable *errors;
+  GPtrArray *order;
+  guint dropped;
+  guint source_id;
+  gboolean in_flight;
+} ConsoleReport;
 
 static void
-web_page_send_console_message_to_view(
-    WebKitWebPage *web_page,
-    const char *type,
-    const char *message,
-    const char *source_id,
-    guint line)
+console_error_free(gpointer data)
+{
+  ConsoleError *error = data;
+  g_free(error->source_id);
+  g_free(error->message);
+  g_free(error);
+}
+
+static ConsoleReport *
+console_report_new(WebKitWebPage *page)
+{
+  ConsoleReport *report = g_new0(ConsoleReport, 1);
+  report->page = page;
+  report->errors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  report->order = g_ptr_array_new_with_free_func(console_error_free);
+  return report;
+}
+
+static void
+console_report_free(gpointer data)
+{
+  ConsoleReport *report = data;
+  g_clear_handle_id(&report->source_id, g_source_remove);
+  g_hash_table_unref(report->errors);
+  g_ptr_array_free(report->order, true);
+  g_free(report);
+}
+
+static void
+console_report_clear(ConsoleReport *report)
 {
-  g_autoptr(GVariant) params = g_variant_new("(sssu)", type, message, source_id, line);
-  WebKitUserMessage *user_message = webkit_user_message_new("console", g_steal_pointer(&params));
-  WebKitUserMessage *reply = ipc_renderer_send_message_sync(web_page, user_message);
-  if (reply == NULL)
+  g_hash_table_remove_all(report->errors);
+  g_ptr_array_set_size(report->order, 0);
+  report->dropped = 0;
+}
+
+static void console_report_schedule(ConsoleReport *report);
+
+static void
+console_report_reply_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) user_data;
+  // The page keeps its report, and the pending message keeps the page
+  ConsoleReport *report = g_object_get_data(source_object, "console-report");
+  report->in_flight = false;
+
+  g_autoptr(WebKitUserMessage) reply
+      = webkit_web_page_send_message_to_view_finish(WEBKIT_WEB_PAGE(source_object), result, NULL);
+  GVariant *reply_params = reply != NULL ? webkit_user_message_get_parameters(reply) : NULL;
+  if (reply_params != NULL && g_variant_is_of_type(reply_params, G_VARIANT_TYPE("(b)")))
+    g_variant_get(reply_params, "(b)", &stop_prompts);
+
+  if (stop_prompts) {
+    console_report_clear(report);
     return;
+  }
+  console_report_schedule(report);
+}
+
+/**
+ * Send the errors gathered since the last report, as "(a(susu)u)":
+ * each error with its count, and the number of errors left out
+ */
+static gboolean
+console_report_send_cb(gpointer user_data)
+{
+  ConsoleReport *report = user_data;
+  report->source_id = 0;
+  if (report->order->len == 0)
+    return G_SOURCE_REMOVE;
 
-  g_autoptr(GVariant) reply_params = webkit_user_message_get_parameters(reply);
+  GVariantBuilder errors;
+  g_variant_builder_init(&errors, G_VARIANT_TYPE("a(susu)"));
+  for (guint i = 0; i < report->order->len; i++) {
+    ConsoleError *error = report->order->pdata[i];
+    g_variant_builder_add(&errors, "(susu)", error->source_id, error->line, error->message, error->count);
+  }
+  GVariant *params = g_variant_new("(a(susu)u)", &errors, report->dropped);
+  console_report_clear(report);
 
-  g_variant_get(reply_params, "(b)", &stop_prompts);
+  report->in_flight = true;
+  WebKitUserMessage *message = webkit_user_message_new("console", params);
+  webkit_web_page_send_message_to_view(report->page, message, NULL, console_report_reply_cb, NULL);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+console_report_schedule(ConsoleReport *report)
+{
+  if (report->source_id != 0 || report->in_flight || report->order->len == 0)
+    return;
+  report->source_id = g_timeout_add(CONSOLE_REPORT_INTERVAL, console_report_send_cb, report);
+}
+
+static void
+console_report_add(WebKitWebPage *web_page, const char *message, const char *source_id, guint line)
+{
+  ConsoleReport *report = g_object_get_data(G_OBJECT(web_page), "console-report");
+  if (report == NULL) {
+    report = console_report_new(web_page);
+    g_object_set_data_full(G_OBJECT(web_page), "console-report", report, console_report_free);
+  }
+
+  g_autofree gchar *key = g_strdup_printf("%s\n%u\n%s", source_id, line, message);
+  ConsoleError *error = g_hash_table_lookup(report->errors, key);
+  if (error != NULL) {
+    error->count++;
+  } else if (report->order->len >= CONSOLE_REPORT_MAX_ERRORS) {
+    report->dropped++;
+  } else {
+    error = g_new0(ConsoleError, 1);
+    error->source_id = g_strdup(source_id);
+    error->line = line;
+    error->message = g_strdup(message);
+    error->count = 1;
+    g_ptr_array_add(report->order, error);
+    g_hash_table_insert(report->errors, g_steal_pointer(&key), error);
+  }
+
+  console_report_schedule(report);
 }
 
 static void
 web_page_console_message_sent(WebKitWebPage *web_page, WebKitConsoleMessage *console_message, gpointer user_data)
 {
-  (void) web_page;
   (void) user_data;
-  GDateTime *now = g_date_time_new_now_local();
-  char *timestamp = g_date_time_format(now, "%Y-%m-%d %H:%M:%S");
-
   char *type = "";
   const gchar *message = webkit_console_message_get_text(console_message);
   const gchar *source_id = webkit_console_message_get_source_id(console_message);
@@ -84,15 +224,15 @@ web_page_console_message_sent(WebKitWebPage *web_page, WebKitConsoleMessage *con
   switch (webkit_console_message_get_level(console_message)) {
     case WEBKIT_CONSOLE_MESSAGE_LEVEL_ERROR:
       type = "ERROR";
-      WEB_PAGE_LOG();
-      if (g_strrstr(source_id, "file://") != NULL)
+      WEB_PAGE_LOG(LOGGER_LEVEL_ERROR);
+      if (g_strrstr(source_id, "file://") != NULL || g_strrstr(source_id, "web-greeter://") != NULL)
         break;
       if (!stop_prompts && detect_theme_errors)
-        web_page_send_console_message_to_view(web_page, type, message, source_id, line);
+        console_report_add(web_page, message, source_id, line);
       break;
     case WEBKIT_CONSOLE_MESSAGE_LEVEL_WARNING:
       type = "WARNING";
-      WEB_PAGE_LOG();
+      WEB_PAGE_LOG(LOGGER_LEVEL_WARN);
       break;
     default:
       return;
@@ -105,7 +245,8 @@ web_page_created_callback(WebKitWebProcessExtension *extension, WebKitWebPage *w
   (void) extension;
 
   gboolean secure_mode = false;
-  g_variant_get(user_data, "(bb)", &secure_mode, &detect_theme_errors);
+  g_strfreev(secure_mode_allowlist);
+  g_variant_get(user_data, "(bbb^as)", &secure_mode, &detect_theme_errors, NULL, &secure_mode_allowlist);
 
   page_id = webkit_web_page_get_id(web_page);
 
@@ -113,6 +254,7 @@ web_page_created_callback(WebKitWebProcessExtension *extension, WebKitWebPage *w
 
   g_signal_connect(web_page, "console-message-sent", G_CALLBACK(web_page_console_message_sent), NULL);
 
+  // Only set when the UI process could not compile its secure mode content filter
   if (secure_mode) {
     g_signal_connect(web_page, "send-request", G_CALLBACK(web_page_send_request_cb), NULL);
   }
@@ -123,6 +265,10 @@ web_page_created_callback(WebKitWebProcessExtension *extension, WebKitWebPage *w
 G_MODULE_EXPORT void
 webkit_web_process_extension_initialize_with_user_data(WebKitWebProcessExtension *extension, GVariant *user_data)
 {
+  logger_init();
+  gboolean debug_mode = false;
+  g_variant_get(user_data, "(bbb^as)", NULL, NULL, &debug_mode, NULL);
+  watchdog_start(debug_mode);
   g_variant_ref(user_data);
   g_signal_connect(extension, "page-created", G_CALLBACK(web_page_created_callback), user_data);
   web_page_initialize(extension);
@@ -0,0 +1,803 @@
+#include <errno.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gio/gio.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image-cache.h"
+#include "logger.h"
+
+/*
+ * Background derivatives, scaled down to a width and optionally blurred,
+ * avatar thumbnails and avatar atlases are rendered in worker threads and
+ * kept on disk under $XDG_CACHE_HOME/sea-greeter/backgrounds and
+ * $XDG_CACHE_HOME/sea-greeter/avatars.
+ * They are keyed by the source path, mtime and size, so a changed image
+ * gets new derivatives.
+ * Widths and blur radii are rounded up to steps, so a theme varying them
+ * does not get a file per value. Each directory is kept under
+ * IMAGE_CACHE_MAX_DISK_SIZE by removing the least recently used files, which
+ * also drops derivatives of images that changed since.
+ * The last background a theme requested is remembered in
+ * $XDG_CACHE_HOME/sea-greeter/backgrounds.last and prepared on the next start.
+ */
+#define IMAGE_CACHE_JPEG_QUALITY "90"
+#define IMAGE_CACHE_BLUR_PASSES 3
+#define IMAGE_CACHE_WIDTH_STEP 256
+#define IMAGE_CACHE_BLUR_STEP 4
+#define IMAGE_CACHE_MAX_DISK_SIZE (64 * 1024 * 1024)
+
+typedef enum {
+  IMAGE_CACHE_BACKGROUND,
+  IMAGE_CACHE_AVATAR,
+  IMAGE_CACHE_ATLAS,
+} ImageCacheKind;
+
+typedef struct {
+  ImageCacheKind kind;
+  gchar **paths;
+  gint width;
+  gint blur;
+} ImageCacheJob;
+
+typedef struct {
+  GBytes *bytes;
+  gchar *mime_type;
+} ImageCacheResult;
+
+static const struct {
+  const gchar *type;
+  const gchar *extension;
+  const gchar *mime_type;
+} image_cache_formats[] = {
+  { "jpeg", ".jpg", "image/jpeg" },
+  { "png", ".png", "image/png" },
+};
+
+static const gchar *image_cache_suffixes[] = { ".jpg", ".jpeg", ".png", ".gif", ".bmp", ".webp" };
+
+static GThreadPool *prewarm_pool = NULL;
+
+/* Atlases handed out by image_cache_atlas_new, by id */
+static GHashTable *atlases = NULL;
+
+static GMutex image_cache_trim_mutex;
+static GMutex last_background_mutex;
+static gchar *last_background = NULL;
+
+static gint
+image_cache_round_up(gint value, gint step, gint max)
+{
+  if (value <= 0)
+    return 0;
+  return MIN((value + step - 1) / step * step, max);
+}
+
+static ImageCacheJob *
+image_cache_job_new(ImageCacheKind kind, const gchar *const *paths, gint width, gint blur)
+{
+  ImageCacheJob *job = g_malloc(sizeof *job);
+  job->kind = kind;
+  job->paths = g_strdupv((gchar **) paths);
+  job->width = width;
+  job->blur = blur;
+  return job;
+}
+
+static void
+image_cache_job_free(gpointer data)
+{
+  ImageCacheJob *job = data;
+  g_strfreev(job->paths);
+  g_free(job);
+}
+
+static void
+image_cache_result_free(gpointer data)
+{
+  ImageCacheResult *result = data;
+  g_bytes_unref(result->bytes);
+  g_free(result->mime_type);
+  g_free(result);
+}
+
+/**
+ * Whether the path looks like an image the cache can render
+ */
+gboolean
+image_cache_is_image(const gchar *path)
+{
+  g_autofree gchar *lower = g_ascii_strdown(path, -1);
+  for (guint i = 0; i < G_N_ELEMENTS(image_cache_suffixes); i++) {
+    if (g_str_has_suffix(lower, image_cache_suffixes[i]))
+      return true;
+  }
+  return false;
+}
+
+static guint32
+image_cache_read_be(const guchar *data, guint bytes)
+{
+  guint32 value = 0;
+  for (guint i = 0; i < bytes; i++)
+    value = (value << 8) | data[i];
+  return value;
+}
+
+static guint32
+image_cache_read_le(const guchar *data, guint bytes)
+{
+  guint32 value = 0;
+  for (guint i = bytes; i > 0; i--)
+    value = (value << 8) | data[i - 1];
+  return value;
+}
+
+/**
+ * Walk the JPEG markers until a start of frame, skipping metadata segments
+ */
+static gboolean
+image_cache_read_jpeg_size(FILE *file, gint *width, gint *height)
+{
+  guchar segment[7];
+  if (fseek(file, 2, SEEK_SET) != 0)
+    return false;
+
+  for (guint i = 0; i < 256; i++) {
+    int byte = fgetc(file);
+    if (byte != 0xFF)
+      return false;
+    int marker;
+    do {
+      marker = fgetc(file);
+    } while (marker == 0xFF);
+    if (marker == EOF || marker == 0xD9 || marker == 0xDA)
+      return false;
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+      continue;
+
+    if (fread(segment, 1, 2, file) != 2)
+      return false;
+    guint32 length = image_cache_read_be(segment, 2);
+    if (length < 2)
+      return false;
+
+    gboolean is_frame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+    if (is_frame) {
+      if (fread(segment, 1, 5, file) != 5)
+        return false;
+      *height = image_cache_read_be(segment + 1, 2);
+      *width = image_cache_read_be(segment + 3, 2);
+      return true;
+    }
+    if (fseek(file, length - 2, SEEK_CUR) != 0)
+      return false;
+  }
+  return false;
+}
+
+/**
+ * Read the size of an image from its header, without decoding it
+ * PNG, JPEG, WebP, GIF and BMP files are supported
+ * @param path The image path
+ * @param width Return location for the width
+ * @param height Return location for the height
+ * @Returns Whether the size could be read
+ */
+gboolean
+image_cache_read_size(const gchar *path, gint *width, gint *height)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+
+  guchar header[30] = { 0 };
+  gsize length = fread(header, 1, sizeof header, file);
+  gboolean found = false;
+  *width = 0;
+  *height = 0;
+
+  if (length >= 24 && memcmp(header, "\x89PNG\r\n\x1a\n", 8) == 0 && memcmp(header + 12, "IHDR", 4) == 0) {
+    *width = image_cache_read_be(header + 16, 4);
+    *height = image_cache_read_be(header + 20, 4);
+    found = true;
+  } else if (length >= 4 && header[0] == 0xFF && header[1] == 0xD8) {
+    found = image_cache_read_jpeg_size(file, width, height);
+  } else if (length >= 30 && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WEBP", 4) == 0) {
+    if (memcmp(header + 12, "VP8 ", 4) == 0) {
+      *width = image_cache_read_le(header + 26, 2) & 0x3FFF;
+      *height = image_cache_read_le(header + 28, 2) & 0x3FFF;
+      found = true;
+    } else if (memcmp(header + 12, "VP8L", 4) == 0 && header[20] == 0x2F) {
+      guint32 bits = image_cache_read_le(header + 21, 4);
+      *width = (bits & 0x3FFF) + 1;
+      *height = ((bits >> 14) & 0x3FFF) + 1;
+      found = true;
+    } else if (memcmp(header + 12, "VP8X", 4) == 0) {
+      *width = image_cache_read_le(header + 24, 3) + 1;
+      *height = image_cache_read_le(header + 27, 3) + 1;
+      found = true;
+    }
+  } else if (length >= 10 && memcmp(header, "GIF8", 4) == 0) {
+    *width = image_cache_read_le(header + 6, 2);
+    *height = image_cache_read_le(header + 8, 2);
+    found = true;
+  } else if (length >= 26 && memcmp(header, "BM", 2) == 0) {
+    *width = ABS((gint32) image_cache_read_le(header + 18, 4));
+    *height = ABS((gint32) image_cache_read_le(header + 22, 4));
+    found = true;
+  }
+
+  fclose(file);
+  return found && *width > 0 && *height > 0;
+}
+
+static gchar *
+image_cache_get_dir(ImageCacheKind kind)
+{
+  const gchar *name = kind == IMAGE_CACHE_BACKGROUND ? "backgrounds" : "avatars";
+  return g_build_filename(g_get_user_cache_dir(), "sea-greeter", name, NULL);
+}
+
+/**
+ * Get the cache key of a job
+ * Missing sources are part of the key of an atlas, as they leave an empty cell,
+ * but make any other job fail
+ */
+static gchar *
+image_cache_get_key(ImageCacheJob *job, GError **error)
+{
+  g_autoptr(GString) key = g_string_new(NULL);
+  g_string_append_printf(key, "%d\n%d\n%d", job->kind, job->width, job->blur);
+
+  for (guint i = 0; job->paths[i] != NULL; i++) {
+    const gchar *path = job->paths[i];
+    struct stat path_stat;
+    if (stat(path, &path_stat) != 0 || !S_ISREG(path_stat.st_mode)) {
+      if (job->kind != IMAGE_CACHE_ATLAS) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "\"%s\" is not a file", path);
+        return NULL;
+      }
+      g_string_append_printf(key, "\n%s\n-", path);
+      continue;
+    }
+    g_string_append_printf(
+        key,
+        "\n%s\n%ld.%09ld\n%ld",
+        path,
+        (long) path_stat.st_mtim.tv_sec,
+        (long) path_stat.st_mtim.tv_nsec,
+        (long) path_stat.st_size);
+  }
+  return g_compute_checksum_for_string(G_CHECKSUM_SHA1, key->str, key->len);
+}
+
+/**
+ * Blur a single row or column with a running box sum
+ */
+static void
+image_cache_box_blur_line(guchar *data, gint length, gint stride, gint channels, gint radius, guchar *line)
+{
+  for (gint i = 0; i < length; i++) {
+    memcpy(line + i * channels, data + i * stride, channels);
+  }
+
+  gint window = 2 * radius + 1;
+  for (gint c = 0; c < channels; c++) {
+    gint sum = 0;
+    for (gint i = -radius; i <= radius; i++) {
+      sum += line[CLAMP(i, 0, length - 1) * channels + c];
+    }
+    for (gint i = 0; i < length; i++) {
+      data[i * stride + c] = sum / window;
+      gint next = MIN(i + radius + 1, length - 1);
+      gint previous = MAX(i - radius, 0);
+      sum += line[next * channels + c] - line[previous * channels + c];
+    }
+  }
+}
+
+/**
+ * Approximate a gaussian blur with a standard deviation of about radius,
+ * using three box blur passes in each direction
+ */
+static void
+image_cache_box_blur(GdkPixbuf *pixbuf, gint radius)
+{
+  gint width = gdk_pixbuf_get_width(pixbuf);
+  gint height = gdk_pixbuf_get_height(pixbuf);
+  gint channels = gdk_pixbuf_get_n_channels(pixbuf);
+  gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+
+  g_autofree guchar *line = g_malloc((gsize) MAX(width, height) * channels);
+
+  for (gint pass = 0; pass < IMAGE_CACHE_BLUR_PASSES; pass++) {
+    for (gint y = 0; y < height; y++) {
+      image_cache_box_blur_line(pixels + (gsize) y * rowstride, width, channels, channels, radius, line);
+    }
+    for (gint x = 0; x < width; x++) {
+      image_cache_box_blur_line(pixels + (gsize) x * channels, height, rowstride, channels, radius, line);
+    }
+  }
+}
+
+static GdkPixbuf *
+image_cache_load_background(const gchar *path, gint width, gint blur, GError **error)
+{
+  gint source_width = 0;
+  if (gdk_pixbuf_get_file_info(path, &source_width, NULL) == NULL) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "\"%s\" is not a supported image", path);
+    return NULL;
+  }
+
+  g_autoptr(GdkPixbuf) source = NULL;
+  if (width > 0 && width < source_width)
+    source = gdk_pixbuf_new_from_file_at_scale(path, width, -1, true, error);
+  else
+    source = gdk_pixbuf_new_from_file(path, error);
+  if (source == NULL)
+    return NULL;
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_apply_embedded_orientation(source);
+  if (blur > 0)
+    image_cache_box_blur(pixbuf, blur);
+  return pixbuf;
+}
+
+/**
+ * Load an image scaled to cover a size x size square, cropped to its center
+ */
+static GdkPixbuf *
+image_cache_load_avatar(const gchar *path, gint size, GError **error)
+{
+  gint source_width = 0;
+  gint source_height = 0;
+  if (gdk_pixbuf_get_file_info(path, &source_width, &source_height) == NULL || source_width <= 0
+      || source_height <= 0) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "\"%s\" is not a supported image", path);
+    return NULL;
+  }
+
+  gdouble scale = MAX((gdouble) size / source_width, (gdouble) size / source_height);
+  gint width = MAX((gint) (source_width * scale + 0.5), size);
+  gint height = MAX((gint) (source_height * scale + 0.5), size);
+
+  g_autoptr(GdkPixbuf) source = gdk_pixbuf_new_from_file_at_scale(path, width, height, false, error);
+  if (source == NULL)
+    return NULL;
+  g_autoptr(GdkPixbuf) oriented = gdk_pixbuf_apply_embedded_orientation(source);
+
+  width = gdk_pixbuf_get_width(oriented);
+  height = gdk_pixbuf_get_height(oriented);
+  gint crop = MIN(MIN(width, height), size);
+  g_autoptr(GdkPixbuf) cropped = gdk_pixbuf_new_subpixbuf(oriented, (width - crop) / 2, (height - crop) / 2, crop, crop);
+  if (crop == size)
+    return gdk_pixbuf_copy(cropped);
+  return gdk_pixbuf_scale_simple(cropped, size, size, GDK_INTERP_BILINEAR);
+}
+
+/**
+ * Compose the avatars of paths in a grid of size x size cells,
+ * laid out as described by image_cache_atlas_get_columns
+ * Images that can not be loaded leave their cell transparent
+ */
+static GdkPixbuf *
+image_cache_load_atlas(gchar **paths, gint size, GError **error)
+{
+  guint count = g_strv_length(paths);
+  guint columns = image_cache_atlas_get_columns(count);
+  guint rows = count == 0 ? 1 : (count + columns - 1) / columns;
+
+  GdkPixbuf *atlas = gdk_pixbuf_new(GDK_COLORSPACE_RGB, true, 8, (gint) columns * size, (gint) rows * size);
+  if (atlas == NULL) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE, "Could not allocate avatar atlas");
+    return NULL;
+  }
+  gdk_pixbuf_fill(atlas, 0x00000000);
+
+  for (guint i = 0; i < count; i++) {
+    g_autoptr(GError) avatar_error = NULL;
+    g_autoptr(GdkPixbuf) avatar = image_cache_load_avatar(paths[i], size, &avatar_error);
+    if (avatar == NULL) {
+      logger_warn("Could not add \"%s\" to the avatar atlas: %s", paths[i], avatar_error->message);
+      continue;
+    }
+    gdk_pixbuf_copy_area(avatar, 0, 0, size, size, atlas, (gint) (i % columns) * size, (gint) (i / columns) * size);
+  }
+  return atlas;
+}
+
+typedef struct {
+  gchar *path;
+  gint64 used;
+  goffset size;
+} ImageCacheFile;
+
+static gint
+image_cache_file_compare_used(gconstpointer a, gconstpointer b)
+{
+  const ImageCacheFile *file_a = a;
+  const ImageCacheFile *file_b = b;
+  return file_a->used < file_b->used ? -1 : file_a->used > file_b->used;
+}
+
+/**
+ * Remove the least recently used files of cache_dir until it fits IMAGE_CACHE_MAX_DISK_SIZE
+ * A file is used when it is written or read, which updates its mtime
+ */
+static void
+image_cache_trim(const gchar *cache_dir)
+{
+  g_mutex_lock(&image_cache_trim_mutex);
+  g_autoptr(GDir) dir = g_dir_open(cache_dir, 0, NULL);
+  g_autoptr(GArray) files = g_array_new(false, false, sizeof(ImageCacheFile));
+  goffset total = 0;
+  const gchar *name;
+  while (dir != NULL && (name = g_dir_read_name(dir)) != NULL) {
+    ImageCacheFile file = { g_build_filename(cache_dir, name, NULL), 0, 0 };
+    struct stat file_stat;
+    if (lstat(file.path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+      g_free(file.path);
+      continue;
+    }
+    file.used = (gint64) file_stat.st_mtim.tv_sec * G_USEC_PER_SEC + file_stat.st_mtim.tv_nsec / 1000;
+    file.size = file_stat.st_size;
+    total += file.size;
+    g_array_append_val(files, file);
+  }
+
+  g_array_sort(files, image_cache_file_compare_used);
+  for (guint i = 0; i < files->len; i++) {
+    ImageCacheFile *file = &g_array_index(files, ImageCacheFile, i);
+    if (total > IMAGE_CACHE_MAX_DISK_SIZE && unlink(file->path) == 0)
+      total -= file->size;
+    g_free(file->path);
+  }
+  g_mutex_unlock(&image_cache_trim_mutex);
+}
+
+/**
+ * Get a derivative from the disk cache, rendering it if needed
+ * This blocks, so it should only be called from a worker thread
+ * @param prepare_only Only render the derivative if it is not cached, returning NULL without error
+ */
+static ImageCacheResult *
+image_cache_render(ImageCacheJob *job, gboolean prepare_only, GError **error)
+{
+  g_autofree gchar *key = image_cache_get_key(job, error);
+  if (key == NULL)
+    return NULL;
+  g_autofree gchar *cache_dir = image_cache_get_dir(job->kind);
+
+  for (guint i = 0; i < G_N_ELEMENTS(image_cache_formats); i++) {
+    g_autofree gchar *name = g_strconcat(key, image_cache_formats[i].extension, NULL);
+    g_autofree gchar *cached_path = g_build_filename(cache_dir, name, NULL);
+    if (prepare_only && g_file_test(cached_path, G_FILE_TEST_IS_REGULAR))
+      return NULL;
+    gchar *contents = NULL;
+    gsize size = 0;
+    if (g_file_get_contents(cached_path, &contents, &size, NULL)) {
+      utimensat(AT_FDCWD, cached_path, NULL, 0);
+      ImageCacheResult *result = g_malloc(sizeof *result);
+      result->bytes = g_bytes_new_take(contents, size);
+      result->mime_type = g_strdup(image_cache_formats[i].mime_type);
+      return result;
+    }
+  }
+
+  g_autoptr(GdkPixbuf) pixbuf = NULL;
+  switch (job->kind) {
+    case IMAGE_CACHE_BACKGROUND:
+      pixbuf = image_cache_load_background(job->paths[0], job->width, job->blur, error);
+      break;
+    case IMAGE_CACHE_AVATAR:
+      pixbuf = image_cache_load_avatar(job->paths[0], job->width, error);
+      break;
+    case IMAGE_CACHE_ATLAS:
+      pixbuf = image_cache_load_atlas(job->paths, job->width, error);
+      break;
+  }
+  if (pixbuf == NULL)
+    return NULL;
+
+  guint format = gdk_pixbuf_get_has_alpha(pixbuf) ? 1 : 0;
+  gchar *buffer = NULL;
+  gsize size = 0;
+  gboolean saved = format == 0
+      ? gdk_pixbuf_save_to_buffer(
+            pixbuf,
+            &buffer,
+            &size,
+            image_cache_formats[format].type,
+            error,
+            "quality",
+            IMAGE_CACHE_JPEG_QUALITY,
+            NULL)
+      : gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &size, image_cache_formats[format].type, error, NULL);
+  if (!saved)
+    return NULL;
+
+  g_autofree gchar *name = g_strconcat(key, image_cache_formats[format].extension, NULL);
+  g_autofree gchar *cached_path = g_build_filename(cache_dir, name, NULL);
+  g_autoptr(GError) write_error = NULL;
+  if (g_mkdir_with_parents(cache_dir, 0700) != 0
+      || !g_file_set_contents_full(
+          cached_path,
+          buffer,
+          size,
+          G_FILE_SET_CONTENTS_CONSISTENT,
+          0600,
+          &write_error)) {
+    logger_warn(
+        "Could not cache \"%s\": %s",
+        cached_path,
+        write_error != NULL ? write_error->message : g_strerror(errno));
+  } else {
+    image_cache_trim(cache_dir);
+  }
+
+  ImageCacheResult *result = g_malloc(sizeof *result);
+  result->bytes = g_bytes_new_take(buffer, size);
+  result->mime_type = g_strdup(image_cache_formats[format].mime_type);
+  return result;
+}
+
+static gchar *
+image_cache_get_last_background_path(void)
+{
+  return g_build_filename(g_get_user_cache_dir(), "sea-greeter", "backgrounds.last", NULL);
+}
+
+/**
+ * Remember the background a theme requested, when it is not the one remembered already
+ */
+static void
+image_cache_remember_background(ImageCacheJob *job)
+{
+  g_autofree gchar *background = g_strdup_printf("%d\n%d\n%s", job->width, job->blur, job->paths[0]);
+
+  g_mutex_lock(&last_background_mutex);
+  if (g_strcmp0(last_background, background) != 0) {
+    g_free(last_background);
+    last_background = g_strdup(background);
+
+    g_autofree gchar *path = image_cache_get_last_background_path();
+    g_autofree gchar *dir = g_path_get_dirname(path);
+    if (g_mkdir_with_parents(dir, 0700) == 0)
+      g_file_set_contents_full(path, background, -1, G_FILE_SET_CONTENTS_CONSISTENT, 0600, NULL);
+  }
+  g_mutex_unlock(&last_background_mutex);
+}
+
+static void
+image_cache_task_cb(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+  (void) source_object;
+  (void) cancellable;
+  ImageCacheJob *job = task_data;
+
+  GError *error = NULL;
+  ImageCacheResult *result = image_cache_render(job, false, &error);
+  if (result == NULL) {
+    g_task_return_error(task, error);
+    return;
+  }
+  if (job->kind == IMAGE_CACHE_BACKGROUND)
+    image_cache_remember_background(job);
+  g_task_return_pointer(task, result, image_cache_result_free);
+}
+
+static void
+image_cache_run_job(ImageCacheJob *job, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+  g_autoptr(GTask) task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_task_data(task, job, image_cache_job_free);
+  g_task_run_in_thread(task, image_cache_task_cb);
+}
+
+/**
+ * Get an image scaled down to width and blurred by blur pixels
+ * @param width The target width, 0 to keep the source width
+ * @param blur The blur radius, 0 to skip blurring
+ */
+void
+image_cache_get_async(
+    const gchar *path,
+    gint width,
+    gint blur,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  const gchar *paths[] = { path, NULL };
+  ImageCacheJob *job = image_cache_job_new(
+      IMAGE_CACHE_BACKGROUND,
+      paths,
+      image_cache_round_up(width, IMAGE_CACHE_WIDTH_STEP, IMAGE_CACHE_MAX_WIDTH),
+      image_cache_round_up(blur, IMAGE_CACHE_BLUR_STEP, IMAGE_CACHE_MAX_BLUR));
+  image_cache_run_job(job, cancellable, callback, user_data);
+}
+
+/**
+ * Get a size x size thumbnail of an avatar
+ */
+void
+image_cache_get_avatar_async(
+    const gchar *path,
+    gint size,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  const gchar *paths[] = { path, NULL };
+  ImageCacheJob *job = image_cache_job_new(IMAGE_CACHE_AVATAR, paths, CLAMP(size, 1, IMAGE_CACHE_MAX_AVATAR_SIZE), 0);
+  image_cache_run_job(job, cancellable, callback, user_data);
+}
+
+/**
+ * Get an atlas created by image_cache_atlas_new
+ */
+void
+image_cache_get_atlas_async(
+    const gchar *id,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  ImageCacheJob *atlas = atlases != NULL ? g_hash_table_lookup(atlases, id) : NULL;
+  if (atlas == NULL) {
+    g_task_report_new_error(
+        NULL,
+        callback,
+        user_data,
+        image_cache_get_atlas_async,
+        G_IO_ERROR,
+        G_IO_ERROR_NOT_FOUND,
+        "Unknown avatar atlas \"%s\"",
+        id);
+    return;
+  }
+
+  ImageCacheJob *job = image_cache_job_new(atlas->kind, (const gchar *const *) atlas->paths, atlas->width, 0);
+  image_cache_run_job(job, cancellable, callback, user_data);
+}
+
+GBytes *
+image_cache_get_finish(GAsyncResult *result, gchar **mime_type, GError **error)
+{
+  ImageCacheResult *image = g_task_propagate_pointer(G_TASK(result), error);
+  if (image == NULL)
+    return NULL;
+
+  GBytes *bytes = g_bytes_ref(image->bytes);
+  if (mime_type != NULL)
+    *mime_type = g_strdup(image->mime_type);
+  image_cache_result_free(image);
+  return bytes;
+}
+
+/**
+ * Get the number of columns of an atlas of count avatars
+ * Avatar i is at column i % columns and row i / columns
+ */
+guint
+image_cache_atlas_get_columns(guint count)
+{
+  guint columns = 1;
+  while (columns * columns < count) {
+    columns++;
+  }
+  return columns;
+}
+
+/**
+ * Describe an atlas of the avatars of paths, each size x size pixels
+ * The atlas is rendered when it is first requested
+ * @return The atlas id, to be passed to image_cache_get_atlas_async
+ */
+gchar *
+image_cache_atlas_new(const gchar *const *paths, gint size)
+{
+  size = CLAMP(size, 1, IMAGE_CACHE_MAX_AVATAR_SIZE);
+
+  g_autoptr(GString) key = g_string_new(NULL);
+  g_string_append_printf(key, "%d", size);
+  for (guint i = 0; paths[i] != NULL; i++) {
+    g_string_append_printf(key, "\n%s", paths[i]);
+  }
+  gchar *id = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key->str, key->len);
+
+  if (atlases == NULL)
+    atlases = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, image_cache_job_free);
+  if (!g_hash_table_contains(atlases, id))
+    g_hash_table_insert(atlases, g_strdup(id), image_cache_job_new(IMAGE_CACHE_ATLAS, paths, size, 0));
+  return id;
+}
+
+static void
+image_cache_prewarm_cb(gpointer data, gpointer user_data)
+{
+  (void) user_data;
+  ImageCacheJob *job = data;
+
+  g_autoptr(GError) error = NULL;
+  ImageCacheResult *result = image_cache_render(job, true, &error);
+  if (error != NULL)
+    logger_warn("Could not prepare \"%s\": %s", job->paths[0], error->message);
+  if (result != NULL)
+    image_cache_result_free(result);
+
+  image_cache_job_free(job);
+}
+
+static void
+image_cache_prewarm_job(ImageCacheJob *job)
+{
+  if (prewarm_pool == NULL)
+    prewarm_pool = g_thread_pool_new(image_cache_prewarm_cb, NULL, 1, false, NULL);
+  g_thread_pool_push(prewarm_pool, job, NULL);
+}
+
+/**
+ * Render a derivative in the background, one image at a time,
+ * so it is ready when a theme requests it
+ */
+void
+image_cache_prewarm(const gchar *path, gint width, gint blur)
+{
+  const gchar *paths[] = { path, NULL };
+  image_cache_prewarm_job(image_cache_job_new(
+      IMAGE_CACHE_BACKGROUND,
+      paths,
+      image_cache_round_up(width, IMAGE_CACHE_WIDTH_STEP, IMAGE_CACHE_MAX_WIDTH),
+      image_cache_round_up(blur, IMAGE_CACHE_BLUR_STEP, IMAGE_CACHE_MAX_BLUR)));
+}
+
+/**
+ * Prepare the background the theme requested last time, at the same width and blur
+ */
+void
+image_cache_prewarm_last_background(void)
+{
+  g_autofree gchar *path = image_cache_get_last_background_path();
+  gchar *contents = NULL;
+  if (!g_file_get_contents(path, &contents, NULL, NULL))
+    return;
+
+  g_mutex_lock(&last_background_mutex);
+  g_free(last_background);
+  last_background = contents;
+  g_auto(GStrv) fields = g_strsplit(last_background, "\n", 3);
+  g_mutex_unlock(&last_background_mutex);
+
+  if (g_strv_length(fields) != 3 || !g_path_is_absolute(fields[2]))
+    return;
+  image_cache_prewarm(fields[2], g_ascii_strtoll(fields[0], NULL, 10), g_ascii_strtoll(fields[1], NULL, 10));
+}
+
+void
+image_cache_prewarm_avatar(const gchar *path, gint size)
+{
+  const gchar *paths[] = { path, NULL };
+  image_cache_prewarm_job(
+      image_cache_job_new(IMAGE_CACHE_AVATAR, paths, CLAMP(size, 1, IMAGE_CACHE_MAX_AVATAR_SIZE), 0));
+}
+
+void
+image_cache_destroy(void)
+{
+  if (atlases != NULL) {
+    g_hash_table_unref(atlases);
+    atlases = NULL;
+  }
+  if (prewarm_pool != NULL) {
+    g_thread_pool_free(prewarm_pool, true, true);
+    prewarm_pool = NULL;
+  }
+  g_clear_pointer(&last_background, g_free);
+}
@@ -0,0 +1,44 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H 1
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#define IMAGE_CACHE_MAX_WIDTH 16384
+#define IMAGE_CACHE_MAX_BLUR 100
+#define IMAGE_CACHE_AVATAR_SIZE 128
+#define IMAGE_CACHE_MAX_AVATAR_SIZE 512
+
+void image_cache_get_async(
+    const gchar *path,
+    gint width,
+    gint blur,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+void image_cache_get_avatar_async(
+    const gchar *path,
+    gint size,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+void image_cache_get_atlas_async(
+    const gchar *id,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+GBytes *image_cache_get_finish(GAsyncResult *result, gchar **mime_type, GError **error);
+
+void image_cache_prewarm(const gchar *path, gint width, gint blur);
+void image_cache_prewarm_avatar(const gchar *path, gint size);
+void image_cache_prewarm_last_background(void);
+
+gchar *image_cache_atlas_new(const gchar *const *paths, gint size);
+guint image_cache_atlas_get_columns(guint count);
+
+gboolean image_cache_is_image(const gchar *path);
+gboolean image_cache_read_size(const gchar *path, gint *width, gint *height);
+
+void image_cache_destroy(void);
+
+#endif
@@ -0,0 +1,299 @@
+#include <errno.h>
+#include <glib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+/*
+ * Every thread that logs owns a ring of formatted lines, filled only by
+ * that thread and emptied only by the writer thread, so logging takes no
+ * lock once the ring exists. Lines of one thread keep their order, lines
+ * of different threads are written out ring by ring.
+ */
+#define LOGGER_RING_SIZE 64
+#define LOGGER_LINE_MAX 1024
+#define LOGGER_TIMESTAMP_MAX 32
+
+typedef struct {
+  gsize length;
+  char text[LOGGER_LINE_MAX];
+} LoggerLine;
+
+typedef struct {
+  LoggerLine lines[LOGGER_RING_SIZE];
+  guint head;
+  guint tail;
+  gint closed;
+
+  time_t timestamp_second;
+  char timestamp[LOGGER_TIMESTAMP_MAX];
+} LoggerRing;
+
+LoggerLevel logger_level = LOGGER_LEVEL_DEBUG;
+
+static void logger_ring_close(gpointer data);
+
+static GPrivate logger_thread_ring = G_PRIVATE_INIT(logger_ring_close);
+static GPtrArray *logger_rings = NULL;
+static GMutex logger_rings_mutex;
+
+static GThread *logger_writer = NULL;
+static gint logger_running = false;
+static gint logger_writer_sleeping = false;
+static GMutex logger_wake_mutex;
+static GCond logger_wake_cond;
+
+static void
+logger_ring_close(gpointer data)
+{
+  LoggerRing *ring = data;
+  g_atomic_int_set(&ring->closed, true);
+}
+
+/**
+ * Format the time, at most once per second
+ */
+static void
+logger_update_timestamp(time_t *second, char *timestamp)
+{
+  time_t now = time(NULL);
+  if (now == *second)
+    return;
+
+  struct tm local;
+  localtime_r(&now, &local);
+  strftime(timestamp, LOGGER_TIMESTAMP_MAX, "%Y-%m-%d %H:%M:%S", &local);
+  *second = now;
+}
+
+static gsize
+logger_format(
+    char *text,
+    const char *timestamp,
+    const char *type,
+    const char *file,
+    int line,
+    const char *format,
+    va_list args)
+{
+  int prefix = snprintf(text, LOGGER_LINE_MAX, "%s [ %s ] %s %d: ", timestamp, type, file, line);
+  gsize length = MIN((gsize) MAX(prefix, 0), LOGGER_LINE_MAX - 2);
+
+  int message = vsnprintf(text + length, LOGGER_LINE_MAX - length, format, args);
+  length = MIN(length + (gsize) MAX(message, 0), LOGGER_LINE_MAX - 2);
+
+  text[length++] = '\n';
+  text[length] = '\0';
+  return length;
+}
+
+static void
+logger_write_all(const char *text, gsize length)
+{
+  while (length > 0) {
+    ssize_t written = write(STDERR_FILENO, text, length);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return;
+    text += written;
+    length -= written;
+  }
+}
+
+static LoggerRing *
+logger_get_ring(void)
+{
+  LoggerRing *ring = g_private_get(&logger_thread_ring);
+  if (ring != NULL)
+    return ring;
+
+  ring = g_new0(LoggerRing, 1);
+  ring->timestamp_second = -1;
+  g_private_set(&logger_thread_ring, ring);
+
+  g_mutex_lock(&logger_rings_mutex);
+  g_ptr_array_add(logger_rings, ring);
+  g_mutex_unlock(&logger_rings_mutex);
+  return ring;
+}
+
+static void
+logger_signal_writer(void)
+{
+  g_mutex_lock(&logger_wake_mutex);
+  g_cond_signal(&logger_wake_cond);
+  g_mutex_unlock(&logger_wake_mutex);
+}
+
+static void
+logger_wake_writer(void)
+{
+  if (g_atomic_int_get(&logger_writer_sleeping))
+    logger_signal_writer();
+}
+
+/**
+ * Move every pending line into buffer, and free the rings of finished threads
+ */
+static void
+logger_drain(GString *buffer)
+{
+  g_mutex_lock(&logger_rings_mutex);
+  for (guint i = logger_rings->len; i > 0; i--) {
+    LoggerRing *ring = logger_rings->pdata[i - 1];
+    gboolean closed = g_atomic_int_get(&ring->closed);
+    guint head = ring->head;
+    guint tail = g_atomic_int_get(&ring->tail);
+
+    for (; head != tail; head++) {
+      LoggerLine *line = &ring->lines[head % LOGGER_RING_SIZE];
+      g_string_append_len(buffer, line->text, line->length);
+    }
+    g_atomic_int_set(&ring->head, head);
+
+    if (closed) {
+      g_ptr_array_remove_index_fast(logger_rings, i - 1);
+      g_free(ring);
+    }
+  }
+  g_mutex_unlock(&logger_rings_mutex);
+}
+
+static gboolean
+logger_has_pending(void)
+{
+  gboolean pending = false;
+  g_mutex_lock(&logger_rings_mutex);
+  for (guint i = 0; i < logger_rings->len && !pending; i++) {
+    LoggerRing *ring = logger_rings->pdata[i];
+    pending = ring->head != (guint) g_atomic_int_get(&ring->tail) || g_atomic_int_get(&ring->closed);
+  }
+  g_mutex_unlock(&logger_rings_mutex);
+  return pending;
+}
+
+static gpointer
+logger_writer_thread(gpointer data)
+{
+  (void) data;
+  GString *buffer = g_string_sized_new(LOGGER_RING_SIZE * LOGGER_LINE_MAX);
+
+  while (true) {
+    gboolean stopping = !g_atomic_int_get(&logger_running);
+    logger_drain(buffer);
+    if (buffer->len > 0) {
+      logger_write_all(buffer->str, buffer->len);
+      g_string_truncate(buffer, 0);
+      continue;
+    }
+    if (stopping)
+      break;
+
+    // Producers only signal while this flag is set, so recheck after setting it
+    g_mutex_lock(&logger_wake_mutex);
+    g_atomic_int_set(&logger_writer_sleeping, true);
+    if (!logger_has_pending() && g_atomic_int_get(&logger_running))
+      g_cond_wait_until(&logger_wake_cond, &logger_wake_mutex, g_get_monotonic_time() + G_TIME_SPAN_SECOND);
+    g_atomic_int_set(&logger_writer_sleeping, false);
+    g_mutex_unlock(&logger_wake_mutex);
+  }
+
+  g_string_free(buffer, true);
+  return NULL;
+}
+
+/**
+ * Write a log line
+ * The line is written by the writer thread, or right away when it is not running
+ */
+void
+logger_log(const char *type, const char *file, int line, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+
+  if (!g_atomic_int_get(&logger_running)) {
+    time_t second = -1;
+    char timestamp[LOGGER_TIMESTAMP_MAX];
+    LoggerLine entry;
+    logger_update_timestamp(&second, timestamp);
+    entry.length = logger_format(entry.text, timestamp, type, file, line, format, args);
+    logger_write_all(entry.text, entry.length);
+    va_end(args);
+    return;
+  }
+
+  LoggerRing *ring = logger_get_ring();
+  // The ring is full, let the writer catch up
+  while (ring->tail - (guint) g_atomic_int_get(&ring->head) >= LOGGER_RING_SIZE) {
+    if (!g_atomic_int_get(&logger_running))
+      break;
+    logger_signal_writer();
+    g_thread_yield();
+  }
+
+  logger_update_timestamp(&ring->timestamp_second, ring->timestamp);
+  LoggerLine *entry = &ring->lines[ring->tail % LOGGER_RING_SIZE];
+  entry->length = logger_format(entry->text, ring->timestamp, type, file, line, format, args);
+  g_atomic_int_set(&ring->tail, ring->tail + 1);
+  va_end(args);
+
+  logger_wake_writer();
+}
+
+static LoggerLevel
+logger_parse_level(const char *level)
+{
+  if (g_ascii_strcasecmp(level, "error") == 0)
+    return LOGGER_LEVEL_ERROR;
+  if (g_ascii_strcasecmp(level, "warn") == 0 || g_ascii_strcasecmp(level, "warning") == 0)
+    return LOGGER_LEVEL_WARN;
+  return LOGGER_LEVEL_DEBUG;
+}
+
+/**
+ * Start the writer thread
+ * SEA_GREETER_LOG_LEVEL ("debug", "warn" or "error") sets the lowest level written
+ */
+void
+logger_init(void)
+{
+  if (logger_writer != NULL)
+    return;
+
+  const char *level = g_getenv("SEA_GREETER_LOG_LEVEL");
+  if (level != NULL)
+    logger_level = logger_parse_level(level);
+
+  logger_rings = g_ptr_array_new();
+  g_atomic_int_set(&logger_running, true);
+  logger_writer = g_thread_new("logger", logger_writer_thread, NULL);
+  atexit(logger_destroy);
+}
+
+/**
+ * Stop the writer thread, once every pending line is written
+ */
+void
+logger_destroy(void)
+{
+  if (logger_writer == NULL)
+    return;
+
+  g_atomic_int_set(&logger_running, false);
+  logger_signal_writer();
+
+  g_thread_join(logger_writer);
+  logger_writer = NULL;
+
+  // Lines pushed while the writer was stopping
+  GString *buffer = g_string_new(NULL);
+  logger_drain(buffer);
+  logger_write_all(buffer->str, buffer->len);
+  g_string_free(buffer, true);
+}
@@ -3,21 +3,33 @@
 #include <glib.h>
 #include <unistd.h>
 
-#define logger_raw(type, message, ...)                                                  \
-  {                                                                                     \
-    GDateTime *now = g_date_time_new_now_local();                                       \
-    char *timestamp = g_date_time_format(now, "%Y-%m-%d %H:%M:%S");                     \
-    char *str = g_strdup_printf(message, ##__VA_ARGS__);                                \
-    char *filename = g_path_get_basename(__FILE__);                                     \
-    fprintf(stderr, "%s [ %s ] %s %d: %s\n", timestamp, type, filename, __LINE__, str); \
-    g_date_time_unref(now);                                                             \
-    g_free(timestamp);                                                                  \
-    g_free(str);                                                                        \
-    g_free(filename);                                                                   \
+typedef enum {
+  LOGGER_LEVEL_DEBUG,
+  LOGGER_LEVEL_WARN,
+  LOGGER_LEVEL_ERROR,
+} LoggerLevel;
+
+/* Messages below this level are dropped before they are formatted */
+extern LoggerLevel logger_level;
+
+#ifdef __FILE_NAME__
+#define LOGGER_FILE_NAME __FILE_NAME__
+#else
+#define LOGGER_FILE_NAME (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+void logger_init(void);
+void logger_destroy(void);
+void logger_log(const char *type, const char *file, int line, const char *format, ...) G_GNUC_PRINTF(4, 5);
+
+#define logger_raw(level, type, message, ...)                                  \
+  {                                                                            \
+    if ((level) >= logger_level)                                               \
+      logger_log(type, LOGGER_FILE_NAME, __LINE__, message, ##__VA_ARGS__);    \
   }
 
-#define logger_debug(message, ...) { logger_raw("DEBUG", message, ##__VA_ARGS__) }
-#define logger_error(message, ...) { logger_raw("ERROR", message, ##__VA_ARGS__) }
-#define logger_warn(message, ...) { logger_raw("WARN", message, ##__VA_ARGS__) }
+#define logger_debug(message, ...) { logger_raw(LOGGER_LEVEL_DEBUG, "DEBUG", message, ##__VA_ARGS__) }
+#define logger_error(message, ...) { logger_raw(LOGGER_LEVEL_ERROR, "ERROR", message, ##__VA_ARGS__) }
+#define logger_warn(message, ...) { logger_raw(LOGGER_LEVEL_WARN, "WARN", message, ##__VA_ARGS__) }
 
 #endif
@@ -4,9 +4,15 @@
 #include <webkit/webkit.h>
 
 #include "config.h"
+#include "content-filter.h"
+#include "image-cache.h"
 #include "logger.h"
+#include "network-cache.h"
+#include "scheme.h"
 #include "settings.h"
+#include "storage-migration.h"
 #include "theme.h"
+#include "watchdog.h"
 
 #include "bridge/greeter_comm.h"
 #include "bridge/greeter_config.h"
@@ -48,10 +54,16 @@ initialize_web_process_extensions(WebKitWebContext *context, gpointer user_data)
 {
   (void) user_data;
 
-  gboolean secure_mode = greeter_config->greeter->secure_mode;
+  // The extension only filters requests itself when the content filter could not be compiled
+  gboolean secure_mode = greeter_config->greeter->secure_mode && content_filter_has_failed();
   gboolean detect_theme_errors = greeter_config->greeter->detect_theme_errors;
+  gboolean debug_mode = greeter_config->greeter->debug_mode;
+  const gchar *const no_allowlist[] = { NULL };
+  const gchar *const *allowlist = greeter_config->greeter->secure_mode_allowlist != NULL
+                                      ? (const gchar *const *) greeter_config->greeter->secure_mode_allowlist
+                                      : no_allowlist;
   g_autoptr(GVariant) data = NULL;
-  data = g_variant_new("(bb)", secure_mode, detect_theme_errors);
+  data = g_variant_new("(bbb^as)", secure_mode, detect_theme_errors, debug_mode, allowlist);
 
   logger_debug("Extension initialized");
 
@@ -146,11 +158,16 @@ app_activate_cb(GtkApplication *app, gpointer user_data)
 {
   (void) user_data;
 
+  watchdog_start(greeter_config->greeter->debug_mode);
+  WATCHDOG_SCOPE("activate");
+
   LightDM_initialize();
   GreeterConfig_initialize();
   ThemeUtils_initialize();
   GreeterComm_initialize();
 
+  scheme_register(webkit_web_context_get_default());
+
   g_signal_connect(
       webkit_web_context_get_default(),
       "initialize-web-process-extensions",
@@ -179,6 +196,8 @@ app_activate_cb(GtkApplication *app, gpointer user_data)
 
   gboolean debug_mode = greeter_config->greeter->debug_mode;
 
+  storage_migration_start();
+
   GListModel *monitors = gdk_display_get_monitors(display);
   guint n_monitors = g_list_model_get_n_items(monitors);
   for (guint i = 0; i < n_monitors; i++) {
@@ -225,6 +244,11 @@ g_application_parse_args(gint *argc, gchar ***argv)
   gchar *theme = NULL;
   gboolean list = false;
 
+  gchar *bundle_dir = NULL;
+  gboolean bundle_compress = false;
+
+  gboolean clear_cache = false;
+
   GOptionEntry entries[] = {
     { "version", 'v', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &version, "Version", NULL },
     { "api-version", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &api_version, "API version", NULL },
@@ -235,6 +259,16 @@ g_application_parse_args(gint *argc, gchar ***argv)
 
     { "theme", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &theme, "Theme", NULL },
     { "list", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &list, "List installed themes", NULL },
+
+    { "bundle-theme",
+      0,
+      G_OPTION_FLAG_NONE,
+      G_OPTION_ARG_FILENAME,
+      &bundle_dir,
+      "Pack a theme directory into <DIR>.bundle",
+      "DIR" },
+    { "bundle-compress", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &bundle_compress, "Compress the theme bundle", NULL },
+    { "clear-cache", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &clear_cache, "Clear the web cache on startup", NULL },
     { NULL, 0, 0, 0, NULL, NULL, NULL },
   };
 
@@ -259,12 +293,15 @@ g_application_parse_args(gint *argc, gchar ***argv)
     print_themes();
     exit(0);
   }
+  if (bundle_dir) {
+    exit(bundle_theme(bundle_dir, bundle_compress));
+  }
 
   load_configuration();
   /*print_greeter_config();*/
 
   if (theme) {
-    greeter_config->greeter->theme = g_strdup(theme);
+    override_configuration_theme(theme);
     g_free(theme);
   }
 
@@ -294,17 +331,27 @@ g_application_parse_args(gint *argc, gchar ***argv)
     g_free(mode_str);
 
   if (debug) {
-    greeter_config->greeter->debug_mode = true;
+    override_configuration_debug_mode(true);
   } else if (normal) {
-    greeter_config->greeter->debug_mode = false;
+    override_configuration_debug_mode(false);
   }
 
-  load_theme_config();
+  if (clear_cache)
+    network_cache_clear();
+  else
+    network_cache_enforce_limit();
+
+  resolve_theme();
+  preload_theme();
+  image_cache_prewarm_last_background();
+  content_filter_prepare();
 }
 
 int
 main(int argc, char **argv)
 {
+  logger_init();
+
   GtkApplication *app = gtk_application_new("com.github.jezerm.sea-greeter", G_APPLICATION_DEFAULT_FLAGS);
 
   setlocale(LC_ALL, "");
@@ -318,6 +365,7 @@ main(int argc, char **argv)
   g_application_parse_args(&argc, &argv);
 
   g_application_run(G_APPLICATION(app), argc, argv);
+  watchdog_stop();
 
   g_object_unref(app);
   webkit_application_info_unref(web_info);
@@ -326,6 +374,10 @@ main(int argc, char **argv)
   GreeterConfig_destroy();
   ThemeUtils_destroy();
   GreeterComm_destroy();
+  image_cache_destroy();
+  network_cache_destroy();
+  content_filter_destroy();
+  storage_migration_destroy();
 
   g_ptr_array_unref(greeter_browsers);
 
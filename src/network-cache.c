@@ -0,0 +1,292 @@
+#include <glib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <webkit/webkit.h>
+
+#include "logger.h"
+#include "network-cache.h"
+#include "settings.h"
+#include "theme.h"
+
+extern GreeterConfig *greeter_config;
+
+/*
+ * With "cache_dir" set, every web view shares a network session whose
+ * disk cache lives there, so theme resources survive across boots.
+ * WebKit sizes its disk cache by itself; "cache_size" is enforced at
+ * startup by removing the cached data of the biggest origins until the
+ * cache fits again.
+ * "cache_dir" is only used when it is a directory owned by the greeter user
+ * that nobody else can write, as it is created when missing.
+ */
+static WebKitNetworkSession *network_session = NULL;
+
+/**
+ * Get "cache_dir", or NULL when it is unset or not private to the greeter user
+ */
+static const char *
+network_cache_get_dir(void)
+{
+  static gboolean checked = false;
+  static gboolean usable = false;
+
+  const char *cache_dir = greeter_config->greeter->cache_dir;
+  if (cache_dir == NULL || cache_dir[0] == '\0')
+    return NULL;
+  if (checked)
+    return usable ? cache_dir : NULL;
+  checked = true;
+
+  g_mkdir_with_parents(cache_dir, 0700);
+  struct stat dir_stat;
+  if (lstat(cache_dir, &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode) || dir_stat.st_uid != geteuid()
+      || (dir_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    logger_warn("Not using cache_dir \"%s\", it is not private to the greeter user", cache_dir);
+    return NULL;
+  }
+  usable = true;
+  return cache_dir;
+}
+
+/**
+ * Get the network session shared by every web view
+ */
+WebKitNetworkSession *
+network_cache_get_session(void)
+{
+  if (network_session != NULL)
+    return network_session;
+
+  const char *cache_dir = network_cache_get_dir();
+  if (cache_dir == NULL) {
+    network_session = g_object_ref(webkit_network_session_get_default());
+    return network_session;
+  }
+
+  // Keep the default data directory, so themes keep their local storage
+  WebKitWebsiteDataManager *default_manager
+      = webkit_network_session_get_website_data_manager(webkit_network_session_get_default());
+  const char *data_dir = webkit_website_data_manager_get_base_data_directory(default_manager);
+
+  network_session = webkit_network_session_new(data_dir, cache_dir);
+  logger_debug("Using persistent cache at \"%s\"", cache_dir);
+  return network_session;
+}
+
+static guint64
+network_cache_dir_size(GFile *dir)
+{
+  g_autoptr(GFileEnumerator) enumerator = g_file_enumerate_children(
+      dir,
+      G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_STANDARD_SIZE,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+      NULL,
+      NULL);
+  if (enumerator == NULL)
+    return 0;
+
+  guint64 size = 0;
+  GFileInfo *info;
+  while ((info = g_file_enumerator_next_file(enumerator, NULL, NULL)) != NULL) {
+    if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
+      g_autoptr(GFile) child = g_file_enumerator_get_child(enumerator, info);
+      size += network_cache_dir_size(child);
+    } else {
+      size += g_file_info_get_size(info);
+    }
+    g_object_unref(info);
+  }
+  return size;
+}
+
+static void
+network_cache_size_cb(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+  (void) source_object;
+  (void) cancellable;
+  g_autoptr(GFile) dir = g_file_new_for_path(task_data);
+  g_task_return_int(task, (gssize) MIN(network_cache_dir_size(dir), G_MAXSSIZE));
+}
+
+static void
+network_cache_cleared_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) user_data;
+  g_autoptr(GError) error = NULL;
+  if (!webkit_website_data_manager_clear_finish(WEBKIT_WEBSITE_DATA_MANAGER(source_object), result, &error))
+    logger_warn("Could not clear the cache: %s", error->message);
+}
+
+static gint
+network_cache_compare_size(gconstpointer a, gconstpointer b)
+{
+  guint64 size_a = webkit_website_data_get_size(*(WebKitWebsiteData **) a, WEBKIT_WEBSITE_DATA_DISK_CACHE);
+  guint64 size_b = webkit_website_data_get_size(*(WebKitWebsiteData **) b, WEBKIT_WEBSITE_DATA_DISK_CACHE);
+  return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+}
+
+static void
+network_cache_removed_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) user_data;
+  g_autoptr(GError) error = NULL;
+  if (!webkit_website_data_manager_remove_finish(WEBKIT_WEBSITE_DATA_MANAGER(source_object), result, &error))
+    logger_warn("Could not trim the cache: %s", error->message);
+}
+
+/**
+ * Remove the cached data of the biggest origins, until excess bytes are gone
+ */
+static void
+network_cache_fetch_ready_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  WebKitWebsiteDataManager *manager = WEBKIT_WEBSITE_DATA_MANAGER(source_object);
+  guint64 excess = GPOINTER_TO_SIZE(user_data);
+  g_autoptr(GError) error = NULL;
+  GList *records = webkit_website_data_manager_fetch_finish(manager, result, &error);
+  if (error != NULL) {
+    logger_warn("Could not list the cache: %s", error->message);
+    return;
+  }
+
+  g_autoptr(GPtrArray) sorted = g_ptr_array_new();
+  for (GList *curr = records; curr != NULL; curr = curr->next) {
+    g_ptr_array_add(sorted, curr->data);
+  }
+  g_ptr_array_sort(sorted, network_cache_compare_size);
+
+  GList *removed = NULL;
+  guint64 freed = 0;
+  for (guint i = 0; i < sorted->len && freed < excess; i++) {
+    WebKitWebsiteData *record = sorted->pdata[i];
+    freed += webkit_website_data_get_size(record, WEBKIT_WEBSITE_DATA_DISK_CACHE);
+    removed = g_list_prepend(removed, record);
+  }
+  if (removed != NULL) {
+    logger_debug("Removing the cache of %u origins", g_list_length(removed));
+    webkit_website_data_manager_remove(
+        manager,
+        WEBKIT_WEBSITE_DATA_DISK_CACHE,
+        removed,
+        NULL,
+        network_cache_removed_cb,
+        NULL);
+  }
+  g_list_free(removed);
+  g_list_free_full(records, (GDestroyNotify) webkit_website_data_unref);
+}
+
+static void
+network_cache_size_ready_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) source_object;
+  (void) user_data;
+  gssize size = g_task_propagate_int(G_TASK(result), NULL);
+  gint64 limit = (gint64) greeter_config->greeter->cache_size * 1024 * 1024;
+  if (size < 0 || size <= limit)
+    return;
+
+  logger_debug("Cache is %" G_GSSIZE_FORMAT " bytes, over the limit. Trimming it", size);
+  WebKitWebsiteDataManager *manager = webkit_network_session_get_website_data_manager(network_cache_get_session());
+  webkit_website_data_manager_fetch(
+      manager,
+      WEBKIT_WEBSITE_DATA_DISK_CACHE,
+      NULL,
+      network_cache_fetch_ready_cb,
+      GSIZE_TO_POINTER((gsize) (size - limit)));
+}
+
+/**
+ * Trim the disk cache in the background if it is bigger than "cache_size"
+ */
+void
+network_cache_enforce_limit(void)
+{
+  const char *cache_dir = network_cache_get_dir();
+  if (cache_dir == NULL || greeter_config->greeter->cache_size <= 0)
+    return;
+
+  g_autoptr(GTask) task = g_task_new(NULL, NULL, network_cache_size_ready_cb, NULL);
+  g_task_set_task_data(task, g_strdup(cache_dir), g_free);
+  g_task_run_in_thread(task, network_cache_size_cb);
+}
+
+/* Entries of $XDG_CACHE_HOME/sea-greeter that the greeter itself writes */
+static const char *const greeter_cache_entries[] = {
+  "avatars",
+  "backgrounds",
+  "backgrounds.last",
+  "config.cache",
+  "content-filters",
+  "snapshots",
+  "themes.index",
+};
+
+static void
+network_cache_remove_entry(GFile *file)
+{
+  GFileType type = g_file_query_file_type(file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL);
+  if (type == G_FILE_TYPE_DIRECTORY) {
+    g_autoptr(GFileEnumerator) enumerator = g_file_enumerate_children(
+        file,
+        G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE,
+        G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+        NULL,
+        NULL);
+    GFileInfo *info;
+    while (enumerator != NULL && (info = g_file_enumerator_next_file(enumerator, NULL, NULL)) != NULL) {
+      g_autoptr(GFile) child = g_file_enumerator_get_child(enumerator, info);
+      if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY)
+        network_cache_remove_entry(child);
+      else
+        g_file_delete(child, NULL, NULL);
+      g_object_unref(info);
+    }
+  }
+  if (type != G_FILE_TYPE_UNKNOWN)
+    g_file_delete(file, NULL, NULL);
+}
+
+static void
+network_cache_clear_ready_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  network_cache_cleared_cb(source_object, result, user_data);
+  release_theme_loads();
+}
+
+/**
+ * Clear the web disk cache and the caches the greeter writes
+ * Themes are not loaded until WebKit is done clearing
+ */
+void
+network_cache_clear(void)
+{
+  const char *cache_dir = network_cache_get_dir();
+  if (cache_dir != NULL) {
+    // cache_dir may be shared with anything else, let WebKit remove only its own data
+    hold_theme_loads();
+    WebKitWebsiteDataManager *manager = webkit_network_session_get_website_data_manager(network_cache_get_session());
+    webkit_website_data_manager_clear(
+        manager,
+        WEBKIT_WEBSITE_DATA_DISK_CACHE,
+        0,
+        NULL,
+        network_cache_clear_ready_cb,
+        NULL);
+  }
+
+  g_autofree gchar *greeter_cache = g_build_filename(g_get_user_cache_dir(), "sea-greeter", NULL);
+  for (gsize i = 0; i < G_N_ELEMENTS(greeter_cache_entries); i++) {
+    g_autoptr(GFile) entry = g_file_new_build_filename(greeter_cache, greeter_cache_entries[i], NULL);
+    network_cache_remove_entry(entry);
+  }
+
+  logger_debug("Cache cleared");
+}
+
+void
+network_cache_destroy(void)
+{
+  g_clear_object(&network_session);
+}
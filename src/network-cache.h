@@ -0,0 +1,11 @@
+#ifndef NETWORK_CACHE_H
+#define NETWORK_CACHE_H 1
+
+#include <webkit/webkit.h>
+
+WebKitNetworkSession *network_cache_get_session(void);
+void network_cache_enforce_limit(void);
+void network_cache_clear(void);
+void network_cache_destroy(void);
+
+#endif
@@ -0,0 +1,483 @@
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <webkit/webkit.h>
+
+#include "image-cache.h"
+#include "logger.h"
+#include "scheme.h"
+#include "theme-bundle.h"
+
+/*
+ * Files served through "web-greeter://theme/<absolute path>" are read
+ * once and shared by every web view, until they are evicted by the LRU or
+ * change on disk. Only files too big for the cache are mapped, for the time
+ * of a single request.
+ * "web-greeter://background/<absolute path>?w=<width>&blur=<radius>"
+ * serves scaled and blurred derivatives from the image cache, and
+ * "web-greeter://avatar/<absolute path>?size=<size>" and
+ * "web-greeter://avatar-atlas/<id>" serve avatar thumbnails and atlases.
+ * "web-greeter://fallback/<path>" serves the fallback theme from the
+ * sea-greeter resources, without any disk access.
+ */
+#define SCHEME_CACHE_MAX_SIZE (64 * 1024 * 1024)
+#define SCHEME_CACHE_MAX_ENTRY_SIZE (8 * 1024 * 1024)
+
+typedef struct {
+  gchar *path;
+  GBytes *bytes;
+  GList *link;
+  dev_t dev;
+  ino_t ino;
+  gint64 mtime;
+  goffset size;
+} SchemeCacheEntry;
+
+static ThemeBundle *scheme_theme_bundle = NULL;
+
+static GHashTable *scheme_cache = NULL;
+static GQueue scheme_cache_lru = G_QUEUE_INIT;
+static gsize scheme_cache_size = 0;
+
+static const struct {
+  const gchar *suffix;
+  const gchar *mime_type;
+} scheme_mime_types[] = {
+  { ".html", "text/html" },
+  { ".htm", "text/html" },
+  { ".js", "text/javascript" },
+  { ".mjs", "text/javascript" },
+  { ".css", "text/css" },
+  { ".json", "application/json" },
+  { ".map", "application/json" },
+  { ".svg", "image/svg+xml" },
+  { ".png", "image/png" },
+  { ".jpg", "image/jpeg" },
+  { ".jpeg", "image/jpeg" },
+  { ".gif", "image/gif" },
+  { ".webp", "image/webp" },
+  { ".bmp", "image/bmp" },
+  { ".ico", "image/x-icon" },
+  { ".woff", "font/woff" },
+  { ".woff2", "font/woff2" },
+  { ".ttf", "font/ttf" },
+  { ".otf", "font/otf" },
+  { ".mp4", "video/mp4" },
+  { ".webm", "video/webm" },
+  { ".ogg", "audio/ogg" },
+  { ".mp3", "audio/mpeg" },
+  { ".wav", "audio/wav" },
+  { ".txt", "text/plain" },
+};
+
+/**
+ * Get the MIME type of a file, looking at its suffix first
+ * and guessing from its content otherwise
+ */
+gchar *
+scheme_get_mime_type(const gchar *path, GBytes *bytes)
+{
+  for (guint i = 0; i < G_N_ELEMENTS(scheme_mime_types); i++) {
+    if (g_str_has_suffix(path, scheme_mime_types[i].suffix))
+      return g_strdup(scheme_mime_types[i].mime_type);
+  }
+
+  gsize size = 0;
+  const guchar *data = bytes != NULL ? g_bytes_get_data(bytes, &size) : NULL;
+  g_autofree gchar *content_type = g_content_type_guess(path, data, size, NULL);
+  gchar *mime_type = g_content_type_get_mime_type(content_type);
+  return mime_type != NULL ? mime_type : g_strdup("application/octet-stream");
+}
+
+static void
+scheme_cache_entry_free(gpointer data)
+{
+  SchemeCacheEntry *entry = data;
+  g_free(entry->path);
+  g_bytes_unref(entry->bytes);
+  g_free(entry);
+}
+
+static void
+scheme_cache_evict(gsize needed)
+{
+  while (scheme_cache_size + needed > SCHEME_CACHE_MAX_SIZE && !g_queue_is_empty(&scheme_cache_lru)) {
+    SchemeCacheEntry *entry = g_queue_pop_tail(&scheme_cache_lru);
+    scheme_cache_size -= g_bytes_get_size(entry->bytes);
+    g_hash_table_remove(scheme_cache, entry->path);
+  }
+}
+
+static gint64
+scheme_cache_get_mtime(const struct stat *path_stat)
+{
+  return (gint64) path_stat->st_mtim.tv_sec * G_USEC_PER_SEC + path_stat->st_mtim.tv_nsec / 1000;
+}
+
+static void
+scheme_cache_remove(SchemeCacheEntry *entry)
+{
+  g_queue_delete_link(&scheme_cache_lru, entry->link);
+  scheme_cache_size -= g_bytes_get_size(entry->bytes);
+  g_hash_table_remove(scheme_cache, entry->path);
+}
+
+/**
+ * Get the contents of a file from the cache, reading it if needed
+ * An entry is only used while the inode, mtime and size of the file match path_stat
+ * @Returns A new GBytes reference, or NULL if the file could not be read
+ */
+static GBytes *
+scheme_cache_lookup(const gchar *path, const struct stat *path_stat, GError **error)
+{
+  if (scheme_cache == NULL)
+    scheme_cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, scheme_cache_entry_free);
+
+  gint64 mtime = scheme_cache_get_mtime(path_stat);
+  SchemeCacheEntry *entry = g_hash_table_lookup(scheme_cache, path);
+  if (entry != NULL
+      && (entry->dev != path_stat->st_dev || entry->ino != path_stat->st_ino || entry->mtime != mtime
+          || entry->size != path_stat->st_size)) {
+    scheme_cache_remove(entry);
+    entry = NULL;
+  }
+  if (entry != NULL) {
+    g_queue_unlink(&scheme_cache_lru, entry->link);
+    g_queue_push_head_link(&scheme_cache_lru, entry->link);
+    return g_bytes_ref(entry->bytes);
+  }
+
+  if (path_stat->st_size > SCHEME_CACHE_MAX_ENTRY_SIZE) {
+    GMappedFile *file = g_mapped_file_new(path, false, error);
+    if (file == NULL)
+      return NULL;
+    GBytes *bytes = g_mapped_file_get_bytes(file);
+    g_mapped_file_unref(file);
+    return bytes;
+  }
+
+  gchar *contents = NULL;
+  gsize size = 0;
+  if (!g_file_get_contents(path, &contents, &size, error))
+    return NULL;
+  GBytes *bytes = g_bytes_new_take(contents, size);
+
+  scheme_cache_evict(size);
+
+  entry = g_malloc(sizeof *entry);
+  entry->path = g_strdup(path);
+  entry->bytes = g_bytes_ref(bytes);
+  entry->dev = path_stat->st_dev;
+  entry->ino = path_stat->st_ino;
+  entry->mtime = mtime;
+  entry->size = path_stat->st_size;
+  g_queue_push_head(&scheme_cache_lru, entry);
+  entry->link = scheme_cache_lru.head;
+  g_hash_table_insert(scheme_cache, entry->path, entry);
+  scheme_cache_size += size;
+
+  return bytes;
+}
+
+/**
+ * Drop every cached file, so the next request reads them again
+ */
+void
+scheme_cache_clear(void)
+{
+  g_queue_clear(&scheme_cache_lru);
+  if (scheme_cache != NULL)
+    g_hash_table_remove_all(scheme_cache);
+  scheme_cache_size = 0;
+}
+
+void
+scheme_finish_with_bytes(WebKitURISchemeRequest *request, GBytes *bytes, const gchar *mime_type)
+{
+  g_autoptr(GInputStream) stream = g_memory_input_stream_new_from_bytes(bytes);
+  g_autoptr(WebKitURISchemeResponse) response
+      = webkit_uri_scheme_response_new(stream, (gint64) g_bytes_get_size(bytes));
+  webkit_uri_scheme_response_set_content_type(response, mime_type);
+  webkit_uri_scheme_request_finish_with_response(request, response);
+}
+
+static void
+scheme_finish_with_error(WebKitURISchemeRequest *request, GQuark domain, gint code, const gchar *message)
+{
+  g_autoptr(GError) error = g_error_new_literal(domain, code, message);
+  webkit_uri_scheme_request_finish_error(request, error);
+}
+
+static void
+scheme_handle_theme(WebKitURISchemeRequest *request, const gchar *path)
+{
+  struct stat path_stat;
+  if (path == NULL || !g_path_is_absolute(path) || stat(path, &path_stat) != 0 || !S_ISREG(path_stat.st_mode)) {
+    scheme_finish_with_error(request, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "File not found");
+    return;
+  }
+
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GBytes) bytes = scheme_cache_lookup(path, &path_stat, &error);
+  if (bytes == NULL) {
+    logger_error("Could not read \"%s\": %s", path, error->message);
+    webkit_uri_scheme_request_finish_error(request, error);
+    return;
+  }
+
+  g_autofree gchar *mime_type = scheme_get_mime_type(path, bytes);
+  scheme_finish_with_bytes(request, bytes, mime_type);
+}
+
+static void
+scheme_handle_bundle(WebKitURISchemeRequest *request, const gchar *path)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  if (scheme_theme_bundle != NULL && path != NULL)
+    bytes = theme_bundle_lookup(scheme_theme_bundle, path);
+  if (bytes == NULL && path != NULL && g_path_is_absolute(path)) {
+    // Absolute paths outside the bundle, like file:// URLs did, read the file system
+    scheme_handle_theme(request, path);
+    return;
+  }
+  if (bytes == NULL) {
+    scheme_finish_with_error(request, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "File not found in theme bundle");
+    return;
+  }
+
+  g_autofree gchar *mime_type = scheme_get_mime_type(path, bytes);
+  scheme_finish_with_bytes(request, bytes, mime_type);
+}
+
+static void
+scheme_handle_fallback(WebKitURISchemeRequest *request, const gchar *path)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  if (path != NULL && strstr(path, "..") == NULL) {
+    g_autofree gchar *resource = g_strconcat(SCHEME_FALLBACK_RESOURCE, path, NULL);
+    bytes = g_resources_lookup_data(resource, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  }
+  if (bytes == NULL) {
+    scheme_finish_with_error(request, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "File not found in fallback theme");
+    return;
+  }
+
+  g_autofree gchar *mime_type = scheme_get_mime_type(path, bytes);
+  scheme_finish_with_bytes(request, bytes, mime_type);
+}
+
+static void
+scheme_image_ready_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) source_object;
+  WebKitURISchemeRequest *request = user_data;
+
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *mime_type = NULL;
+  g_autoptr(GBytes) bytes = image_cache_get_finish(result, &mime_type, &error);
+  if (bytes == NULL) {
+    logger_error("Could not prepare image: %s", error->message);
+    webkit_uri_scheme_request_finish_error(request, error);
+  } else {
+    scheme_finish_with_bytes(request, bytes, mime_type);
+  }
+  g_object_unref(request);
+}
+
+/**
+ * Serve a background image scaled to "w" pixels wide and blurred by "blur" pixels
+ */
+static void
+scheme_handle_background(WebKitURISchemeRequest *request, const gchar *path, const gchar *query)
+{
+  if (path == NULL || !g_path_is_absolute(path) || !image_cache_is_image(path)) {
+    scheme_finish_with_error(request, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Not an image");
+    return;
+  }
+
+  gint width = 0;
+  gint blur = 0;
+  if (query != NULL) {
+    g_autoptr(GHashTable) params = g_uri_parse_params(query, -1, "&", G_URI_PARAMS_NONE, NULL);
+    const gchar *width_param = params != NULL ? g_hash_table_lookup(params, "w") : NULL;
+    const gchar *blur_param = params != NULL ? g_hash_table_lookup(params, "blur") : NULL;
+    if (width_param != NULL)
+      width = CLAMP(g_ascii_strtoll(width_param, NULL, 10), 0, IMAGE_CACHE_MAX_WIDTH);
+    if (blur_param != NULL)
+      blur = CLAMP(g_ascii_strtoll(blur_param, NULL, 10), 0, IMAGE_CACHE_MAX_BLUR);
+  }
+
+  if (width == 0 && blur == 0) {
+    scheme_handle_theme(request, path);
+    return;
+  }
+
+  image_cache_get_async(path, width, blur, NULL, scheme_image_ready_cb, g_object_ref(request));
+}
+
+/**
+ * Serve a "size" pixels square thumbnail of an avatar
+ */
+static void
+scheme_handle_avatar(WebKitURISchemeRequest *request, const gchar *path, const gchar *query)
+{
+  if (path == NULL || !g_path_is_absolute(path)) {
+    scheme_finish_with_error(request, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Not an image");
+    return;
+  }
+
+  gint size = IMAGE_CACHE_AVATAR_SIZE;
+  if (query != NULL) {
+    g_autoptr(GHashTable) params = g_uri_parse_params(query, -1, "&", G_URI_PARAMS_NONE, NULL);
+    const gchar *size_param = params != NULL ? g_hash_table_lookup(params, "size") : NULL;
+    if (size_param != NULL)
+      size = CLAMP(g_ascii_strtoll(size_param, NULL, 10), 1, IMAGE_CACHE_MAX_AVATAR_SIZE);
+  }
+
+  image_cache_get_avatar_async(path, size, NULL, scheme_image_ready_cb, g_object_ref(request));
+}
+
+static void
+scheme_handle_avatar_atlas(WebKitURISchemeRequest *request, const gchar *path)
+{
+  if (path == NULL || path[0] != '/') {
+    scheme_finish_with_error(request, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Unknown avatar atlas");
+    return;
+  }
+  image_cache_get_atlas_async(path + 1, NULL, scheme_image_ready_cb, g_object_ref(request));
+}
+
+static void
+scheme_request_cb(WebKitURISchemeRequest *request, gpointer user_data)
+{
+  (void) user_data;
+  const gchar *uri = webkit_uri_scheme_request_get_uri(request);
+
+  g_autoptr(GUri) guri = g_uri_parse(uri, G_URI_FLAGS_NONE, NULL);
+  if (guri == NULL) {
+    scheme_finish_with_error(request, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Invalid URI");
+    return;
+  }
+
+  const gchar *host = g_uri_get_host(guri);
+  const gchar *path = g_uri_get_path(guri);
+
+  if (g_strcmp0(host, SCHEME_HOST_THEME) == 0) {
+    scheme_handle_theme(request, path);
+    return;
+  }
+  if (g_strcmp0(host, SCHEME_HOST_BUNDLE) == 0) {
+    scheme_handle_bundle(request, path);
+    return;
+  }
+  if (g_strcmp0(host, SCHEME_HOST_FALLBACK) == 0) {
+    scheme_handle_fallback(request, path);
+    return;
+  }
+  if (g_strcmp0(host, SCHEME_HOST_BACKGROUND) == 0) {
+    scheme_handle_background(request, path, g_uri_get_query(guri));
+    return;
+  }
+  if (g_strcmp0(host, SCHEME_HOST_AVATAR) == 0) {
+    scheme_handle_avatar(request, path, g_uri_get_query(guri));
+    return;
+  }
+  if (g_strcmp0(host, SCHEME_HOST_AVATAR_ATLAS) == 0) {
+    scheme_handle_avatar_atlas(request, path);
+    return;
+  }
+
+  scheme_finish_with_error(request, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Unknown web-greeter resource");
+}
+
+/**
+ * Build a "web-greeter://theme" URI for an absolute file path
+ */
+gchar *
+scheme_theme_uri_new(const gchar *path)
+{
+  g_autofree gchar *escaped = g_uri_escape_string(path, "/", true);
+  return g_strconcat(SCHEME_NAME "://" SCHEME_HOST_THEME, escaped, NULL);
+}
+
+/**
+ * Build a "web-greeter://bundle" URI for a path inside the theme bundle
+ */
+gchar *
+scheme_bundle_uri_new(const gchar *path)
+{
+  while (path[0] == '/')
+    path++;
+  g_autofree gchar *escaped = g_uri_escape_string(path, "/", true);
+  return g_strconcat(SCHEME_NAME "://" SCHEME_HOST_BUNDLE "/", escaped, NULL);
+}
+
+/**
+ * Build a "web-greeter://fallback" URI for a path inside the fallback theme
+ */
+gchar *
+scheme_fallback_uri_new(const gchar *path)
+{
+  while (path[0] == '/')
+    path++;
+  g_autofree gchar *escaped = g_uri_escape_string(path, "/", true);
+  return g_strconcat(SCHEME_NAME "://" SCHEME_HOST_FALLBACK "/", escaped, NULL);
+}
+
+/**
+ * Build a "web-greeter://avatar" URI for a thumbnail of an avatar
+ */
+gchar *
+scheme_avatar_uri_new(const gchar *path, gint size)
+{
+  g_autofree gchar *escaped = g_uri_escape_string(path, "/", true);
+  return g_strdup_printf(SCHEME_NAME "://" SCHEME_HOST_AVATAR "%s?size=%d", escaped, size);
+}
+
+/**
+ * Build a "web-greeter://avatar-atlas" URI for an atlas created by image_cache_atlas_new
+ */
+gchar *
+scheme_avatar_atlas_uri_new(const gchar *id)
+{
+  return g_strconcat(SCHEME_NAME "://" SCHEME_HOST_AVATAR_ATLAS "/", id, NULL);
+}
+
+/**
+ * Set the theme bundle served through "web-greeter://bundle"
+ * The scheme takes ownership of the bundle
+ */
+void
+scheme_set_theme_bundle(ThemeBundle *bundle)
+{
+  if (scheme_theme_bundle == bundle)
+    return;
+  theme_bundle_free(scheme_theme_bundle);
+  scheme_theme_bundle = bundle;
+}
+
+ThemeBundle *
+scheme_get_theme_bundle(void)
+{
+  return scheme_theme_bundle;
+}
+
+/**
+ * Register the web-greeter URI scheme in the web context
+ */
+void
+scheme_register(WebKitWebContext *context)
+{
+  webkit_web_context_register_uri_scheme(context, SCHEME_NAME, scheme_request_cb, NULL, NULL);
+
+  // Themes are no longer a file:// origin, so their localStorage is copied
+  // over by storage-migration.c. Registering the scheme as local keeps the
+  // allow-*-access-from-file-urls settings applying to theme pages, so
+  // XHR/fetch of file:// URLs from a theme still works.
+  WebKitSecurityManager *security_manager = webkit_web_context_get_security_manager(context);
+  webkit_security_manager_register_uri_scheme_as_local(security_manager, SCHEME_NAME);
+  webkit_security_manager_register_uri_scheme_as_secure(security_manager, SCHEME_NAME);
+  webkit_security_manager_register_uri_scheme_as_cors_enabled(security_manager, SCHEME_NAME);
+}
@@ -0,0 +1,34 @@
+#ifndef SCHEME_H
+#define SCHEME_H 1
+
+#include <webkit/webkit.h>
+
+#include "theme-bundle.h"
+
+#define SCHEME_NAME "web-greeter"
+#define SCHEME_HOST_THEME "theme"
+#define SCHEME_HOST_BUNDLE "bundle"
+#define SCHEME_HOST_BACKGROUND "background"
+#define SCHEME_HOST_AVATAR "avatar"
+#define SCHEME_HOST_AVATAR_ATLAS "avatar-atlas"
+#define SCHEME_HOST_FALLBACK "fallback"
+
+/* Resource directory of the fallback theme, compiled into sea-greeter */
+#define SCHEME_FALLBACK_RESOURCE "/com/github/jezerm/sea_greeter/resources/fallback"
+
+void scheme_register(WebKitWebContext *context);
+void scheme_cache_clear(void);
+
+gchar *scheme_theme_uri_new(const gchar *path);
+gchar *scheme_bundle_uri_new(const gchar *path);
+gchar *scheme_avatar_uri_new(const gchar *path, gint size);
+gchar *scheme_avatar_atlas_uri_new(const gchar *id);
+gchar *scheme_fallback_uri_new(const gchar *path);
+
+void scheme_set_theme_bundle(ThemeBundle *bundle);
+ThemeBundle *scheme_get_theme_bundle(void);
+
+gchar *scheme_get_mime_type(const gchar *path, GBytes *bytes);
+void scheme_finish_with_bytes(WebKitURISchemeRequest *request, GBytes *bytes, const gchar *mime_type);
+
+#endif
@@ -0,0 +1,268 @@
+#include <glib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <yaml.h>
+
+#include "logger.h"
+#include "settings-loader.h"
+
+/*
+ * Single pass YAML loader. Parser events are matched against a table of key
+ * paths as they come, and scalars are written straight into their fields;
+ * keys missing from the table are skipped along with their values.
+ */
+#define SETTINGS_LOADER_MAX_DEPTH 32
+
+typedef struct {
+  yaml_parser_t parser;
+  const SettingsField *fields;
+  guint n_fields;
+  GString *path;
+} SettingsLoader;
+
+static const SettingsField *
+settings_loader_lookup(SettingsLoader *loader)
+{
+  for (guint i = 0; i < loader->n_fields; i++) {
+    if (strcmp(loader->fields[i].path, loader->path->str) == 0)
+      return &loader->fields[i];
+  }
+  return NULL;
+}
+
+static void
+settings_loader_set_scalar(const SettingsField *field, const char *value)
+{
+  switch (field->type) {
+    case SETTINGS_FIELD_STRING: {
+      char **string = field->field;
+      g_free(*string);
+      *string = g_strdup(value);
+      break;
+    }
+    case SETTINGS_FIELD_BOOL:
+      *(bool *) field->field = strcmp(value, "True") == 0;
+      break;
+    case SETTINGS_FIELD_INT:
+      *(int *) field->field = strtol(value, NULL, 10);
+      break;
+    default:
+      break;
+  }
+}
+
+static gboolean settings_loader_parse_value(SettingsLoader *loader, yaml_event_t *event, guint depth);
+
+/**
+ * Skip events up to the end of the mapping or sequence that was just started
+ */
+static gboolean
+settings_loader_skip(SettingsLoader *loader)
+{
+  guint level = 1;
+  while (level > 0) {
+    yaml_event_t event;
+    if (!yaml_parser_parse(&loader->parser, &event))
+      return false;
+    if (event.type == YAML_MAPPING_START_EVENT || event.type == YAML_SEQUENCE_START_EVENT)
+      level++;
+    else if (event.type == YAML_MAPPING_END_EVENT || event.type == YAML_SEQUENCE_END_EVENT)
+      level--;
+    else if (event.type == YAML_STREAM_END_EVENT)
+      level = 0;
+    yaml_event_delete(&event);
+  }
+  return true;
+}
+
+/**
+ * Collect the scalars of a sequence into field, if it takes a list
+ */
+static gboolean
+settings_loader_parse_sequence(SettingsLoader *loader, const SettingsField *field)
+{
+  GPtrArray *items = NULL;
+  if (field != NULL && field->type == SETTINGS_FIELD_PTR_ARRAY)
+    items = *(GPtrArray **) field->field;
+  else if (field != NULL && field->type == SETTINGS_FIELD_STRV)
+    items = g_ptr_array_new_with_free_func(g_free);
+
+  while (true) {
+    yaml_event_t event;
+    if (!yaml_parser_parse(&loader->parser, &event)) {
+      if (field != NULL && field->type == SETTINGS_FIELD_STRV)
+        g_ptr_array_free(items, true);
+      return false;
+    }
+
+    gboolean ok = true;
+    yaml_event_type_t type = event.type;
+    if (type == YAML_SCALAR_EVENT && items != NULL)
+      g_ptr_array_add(items, g_strdup((const char *) event.data.scalar.value));
+    else if (type == YAML_MAPPING_START_EVENT || type == YAML_SEQUENCE_START_EVENT)
+      ok = settings_loader_skip(loader);
+    yaml_event_delete(&event);
+
+    if (!ok || type == YAML_SEQUENCE_END_EVENT || type == YAML_STREAM_END_EVENT) {
+      if (field != NULL && field->type == SETTINGS_FIELD_STRV) {
+        g_ptr_array_add(items, NULL);
+        char ***strv = field->field;
+        g_strfreev(*strv);
+        *strv = (char **) g_ptr_array_free(items, false);
+      }
+      return ok;
+    }
+  }
+}
+
+/**
+ * Parse the keys of a mapping, whose path prefix is loader->path
+ */
+static gboolean
+settings_loader_parse_mapping(SettingsLoader *loader, guint depth)
+{
+  gsize prefix_length = loader->path->len;
+
+  while (true) {
+    yaml_event_t event;
+    if (!yaml_parser_parse(&loader->parser, &event))
+      return false;
+
+    if (event.type != YAML_SCALAR_EVENT) {
+      // Non scalar keys are not supported
+      gboolean done = event.type == YAML_MAPPING_END_EVENT || event.type == YAML_STREAM_END_EVENT;
+      gboolean ok = true;
+      if (event.type == YAML_MAPPING_START_EVENT || event.type == YAML_SEQUENCE_START_EVENT)
+        ok = settings_loader_skip(loader);
+      yaml_event_delete(&event);
+      if (done || !ok)
+        return ok;
+      continue;
+    }
+
+    if (prefix_length > 0)
+      g_string_append_c(loader->path, '.');
+    g_string_append(loader->path, (const char *) event.data.scalar.value);
+    yaml_event_delete(&event);
+
+    if (!yaml_parser_parse(&loader->parser, &event))
+      return false;
+    gboolean ok = settings_loader_parse_value(loader, &event, depth);
+    yaml_event_delete(&event);
+    g_string_truncate(loader->path, prefix_length);
+    if (!ok)
+      return false;
+  }
+}
+
+/**
+ * Handle the value of the key at loader->path, event being its first event
+ */
+static gboolean
+settings_loader_parse_value(SettingsLoader *loader, yaml_event_t *event, guint depth)
+{
+  switch (event->type) {
+    case YAML_SCALAR_EVENT: {
+      const SettingsField *field = settings_loader_lookup(loader);
+      if (field != NULL)
+        settings_loader_set_scalar(field, (const char *) event->data.scalar.value);
+      return true;
+    }
+    case YAML_SEQUENCE_START_EVENT:
+      return settings_loader_parse_sequence(loader, settings_loader_lookup(loader));
+    case YAML_MAPPING_START_EVENT:
+      if (depth >= SETTINGS_LOADER_MAX_DEPTH)
+        return settings_loader_skip(loader);
+      return settings_loader_parse_mapping(loader, depth + 1);
+    default:
+      return true;
+  }
+}
+
+static gboolean
+settings_loader_run(SettingsLoader *loader, const char *name)
+{
+  gint64 start = g_get_monotonic_time();
+  loader->path = g_string_new(NULL);
+
+  gboolean ok = true;
+  gboolean done = false;
+  while (ok && !done) {
+    yaml_event_t event;
+    if (!yaml_parser_parse(&loader->parser, &event)) {
+      ok = false;
+      break;
+    }
+    if (event.type == YAML_MAPPING_START_EVENT)
+      ok = settings_loader_parse_mapping(loader, 1);
+    else if (event.type == YAML_STREAM_END_EVENT)
+      done = true;
+    yaml_event_delete(&event);
+  }
+
+  if (!ok) {
+    logger_warn(
+        "Could not parse %s: %s at line %zu",
+        name,
+        loader->parser.problem != NULL ? loader->parser.problem : "unknown error",
+        loader->parser.problem_mark.line + 1);
+  }
+  logger_debug("Parsed %s in %" G_GINT64_FORMAT " us", name, g_get_monotonic_time() - start);
+
+  g_string_free(loader->path, true);
+  yaml_parser_delete(&loader->parser);
+  return ok;
+}
+
+/**
+ * Load a YAML file into the fields of a key path table
+ * @param path The file to load
+ * @param fields The key path table
+ * @param n_fields The length of fields
+ * @Returns Whether the file could be read and parsed
+ */
+gboolean
+settings_loader_load_file(const char *path, const SettingsField *fields, guint n_fields)
+{
+  FILE *fh = fopen(path, "rb");
+  if (fh == NULL)
+    return false;
+
+  SettingsLoader loader = { .fields = fields, .n_fields = n_fields };
+  if (!yaml_parser_initialize(&loader.parser)) {
+    fclose(fh);
+    return false;
+  }
+  yaml_parser_set_input_file(&loader.parser, fh);
+
+  gboolean ok = settings_loader_run(&loader, path);
+  fclose(fh);
+  return ok;
+}
+
+/**
+ * Load a YAML document into the fields of a key path table
+ * @param name The document name, for messages
+ * @param data The document
+ * @param size The length of data
+ * @param fields The key path table
+ * @param n_fields The length of fields
+ * @Returns Whether the document could be parsed
+ */
+gboolean
+settings_loader_load_data(
+    const char *name,
+    const char *data,
+    size_t size,
+    const SettingsField *fields,
+    guint n_fields)
+{
+  SettingsLoader loader = { .fields = fields, .n_fields = n_fields };
+  if (!yaml_parser_initialize(&loader.parser))
+    return false;
+  yaml_parser_set_input_string(&loader.parser, (const unsigned char *) data, size);
+
+  return settings_loader_run(&loader, name);
+}
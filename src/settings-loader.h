@@ -0,0 +1,36 @@
+#ifndef SETTINGS_LOADER_H
+#define SETTINGS_LOADER_H 1
+
+#include <glib.h>
+
+typedef enum {
+  /* char *, replaced by the scalar */
+  SETTINGS_FIELD_STRING,
+  /* bool, true for "True" */
+  SETTINGS_FIELD_BOOL,
+  /* int */
+  SETTINGS_FIELD_INT,
+  /* char **, replaced by the scalars of a sequence */
+  SETTINGS_FIELD_STRV,
+  /* GPtrArray *, the scalars of a sequence are appended */
+  SETTINGS_FIELD_PTR_ARRAY,
+} SettingsFieldType;
+
+/**
+ * A YAML key path, like "greeter.theme", and the field it is written to
+ */
+typedef struct {
+  const char *path;
+  SettingsFieldType type;
+  gpointer field;
+} SettingsField;
+
+gboolean settings_loader_load_file(const char *path, const SettingsField *fields, guint n_fields);
+gboolean settings_loader_load_data(
+    const char *name,
+    const char *data,
+    size_t size,
+    const SettingsField *fields,
+    guint n_fields);
+
+#endif
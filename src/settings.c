@@ -1,25 +1,26 @@
 #include "settings.h"
+#include "config-cache.h"
 #include "logger.h"
+#include "settings-loader.h"
 #include <glib.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <yaml.h>
 
 GreeterConfig *greeter_config;
 
 static void
-init_greeter_config_branding(void)
+init_greeter_config_branding(GreeterConfig *config)
 {
   GreeterConfigBranding *branding = NULL;
   branding = malloc(sizeof *branding);
   branding->background_images_dir = NULL;
   branding->logo_image = NULL;
   branding->user_image = NULL;
-  greeter_config->branding = branding;
+  config->branding = branding;
 }
 static void
-init_greeter_config_greeter(void)
+init_greeter_config_greeter(GreeterConfig *config)
 {
   GreeterConfigGreeter *greeter = NULL;
   greeter = malloc(sizeof *greeter);
@@ -27,13 +28,16 @@ init_greeter_config_greeter(void)
   greeter->detect_theme_errors = true;
   greeter->screensaver_timeout = 300;
   greeter->secure_mode = true;
+  greeter->secure_mode_allowlist = NULL;
   greeter->theme = g_strdup("gruvbox");
   greeter->icon_theme = NULL;
   greeter->time_language = NULL;
-  greeter_config->greeter = greeter;
+  greeter->cache_dir = g_strdup("/var/cache/lightdm/sea-greeter");
+  greeter->cache_size = 64;
+  config->greeter = greeter;
 }
 static void
-init_greeter_config_features(void)
+init_greeter_config_features(GreeterConfig *config)
 {
   GreeterConfigFeatures *features = NULL;
   features = malloc(sizeof *features);
@@ -42,26 +46,27 @@ init_greeter_config_features(void)
   features->backlight->enabled = false;
   features->backlight->steps = 0;
   features->backlight->value = 10;
-  greeter_config->features = features;
+  config->features = features;
 }
 static void
-init_greeter_config_app(void)
+init_greeter_config_app(GreeterConfig *config)
 {
   GreeterConfigApp *app = NULL;
   app = malloc(sizeof *app);
   app->debug_mode = false;
   app->fullscreen = true;
   app->theme_dir = g_strdup("/usr/share/web-greeter/themes/");
-  greeter_config->app = app;
+  config->app = app;
 }
 static void
-init_greeter_config_theme(void)
+init_greeter_config_theme(GreeterConfig *config)
 {
   GreeterConfigTheme *theme = NULL;
   theme = malloc(sizeof *theme);
   theme->primary_html = g_strdup("index.html");
   theme->secondary_html = NULL;
-  greeter_config->theme = theme;
+  theme->preload = NULL;
+  config->theme = theme;
 }
 
 void
@@ -89,6 +94,8 @@ print_greeter_config(void)
       "  theme: \"%s\"\n"
       "  icon_theme: \"%s\"\n"
       "  time_language: \"%s\"\n"
+      "  cache_dir: \"%s\"\n"
+      "  cache_size: %d\n"
       "layouts:\n"
       "%s"
       "features:\n"
@@ -106,6 +113,8 @@ print_greeter_config(void)
       greeter_config->greeter->theme,
       greeter_config->greeter->icon_theme,
       greeter_config->greeter->time_language,
+      greeter_config->greeter->cache_dir,
+      greeter_config->greeter->cache_size,
       layouts->str,
       greeter_config->features->battery,
       greeter_config->features->backlight->enabled,
@@ -114,286 +123,207 @@ print_greeter_config(void)
   g_string_free(layouts, true);
 }
 
-static void
-init_greeter_config(void)
+static GreeterConfig *
+greeter_config_new(void)
 {
-  greeter_config = g_malloc(sizeof *greeter_config);
-  init_greeter_config_branding();
-  init_greeter_config_greeter();
-  init_greeter_config_features();
-  init_greeter_config_app();
-  init_greeter_config_theme();
-  greeter_config->layouts = g_ptr_array_new();
+  GreeterConfig *config = g_malloc(sizeof *config);
+  init_greeter_config_branding(config);
+  init_greeter_config_greeter(config);
+  init_greeter_config_features(config);
+  init_greeter_config_app(config);
+  init_greeter_config_theme(config);
+  config->layouts = g_ptr_array_new_with_free_func(g_free);
+  return config;
 }
 
-void
-free_greeter_config_branding(void)
+static void
+free_greeter_config_branding(GreeterConfigBranding *branding)
 {
-  if (greeter_config == NULL)
-    return;
-  else if (greeter_config->branding == NULL)
+  if (branding == NULL)
     return;
 
-  GreeterConfigBranding *branding = greeter_config->branding;
   g_free(branding->background_images_dir);
   g_free(branding->logo_image);
   g_free(branding->user_image);
   g_free(branding);
 }
-void
-free_greeter_config_greeter(void)
+static void
+free_greeter_config_greeter(GreeterConfigGreeter *greeter)
 {
-  if (greeter_config == NULL)
-    return;
-  else if (greeter_config->greeter == NULL)
+  if (greeter == NULL)
     return;
 
-  GreeterConfigGreeter *greeter = greeter_config->greeter;
+  g_strfreev(greeter->secure_mode_allowlist);
   g_free(greeter->theme);
   g_free(greeter->icon_theme);
   g_free(greeter->time_language);
+  g_free(greeter->cache_dir);
   g_free(greeter);
 }
-void
-free_greeter_config_features(void)
+static void
+free_greeter_config_features(GreeterConfigFeatures *features)
 {
-  if (greeter_config == NULL)
-    return;
-  else if (greeter_config->features == NULL)
+  if (features == NULL)
     return;
 
-  GreeterConfigFeatures *features = greeter_config->features;
   g_free(features->backlight);
   g_free(features);
 }
-void
-free_greeter_config_app(void)
+static void
+free_greeter_config_app(GreeterConfigApp *app)
 {
-  if (greeter_config == NULL)
-    return;
-  else if (greeter_config->app == NULL)
+  if (app == NULL)
     return;
 
-  GreeterConfigApp *app = greeter_config->app;
   g_free(app->theme_dir);
   g_free(app);
 }
-void
-free_greeter_config_theme(void)
+static void
+free_greeter_config_theme(GreeterConfigTheme *theme)
 {
-  if (greeter_config == NULL)
-    return;
-  else if (greeter_config->theme == NULL)
+  if (theme == NULL)
     return;
 
-  GreeterConfigTheme *theme = greeter_config->theme;
   g_free(theme->primary_html);
   g_free(theme->secondary_html);
+  g_strfreev(theme->preload);
   g_free(theme);
 }
 
+/**
+ * Free a GreeterConfig, like one returned by read_configuration()
+ */
+void
+greeter_config_free(GreeterConfig *config)
+{
+  if (config == NULL)
+    return;
+
+  free_greeter_config_branding(config->branding);
+  free_greeter_config_greeter(config->greeter);
+  free_greeter_config_features(config->features);
+  free_greeter_config_app(config->app);
+  free_greeter_config_theme(config->theme);
+  if (config->layouts != NULL)
+    g_ptr_array_free(config->layouts, true);
+  g_free(config);
+}
+
 void
 free_greeter_config(void)
 {
-  free_greeter_config_branding();
-  free_greeter_config_greeter();
-  free_greeter_config_features();
-  free_greeter_config_app();
-  free_greeter_config_theme();
-  g_ptr_array_free(greeter_config->layouts, true);
-  g_free(greeter_config);
+  greeter_config_free(greeter_config);
   greeter_config = NULL;
 }
 
-static bool
-yaml_get_bool(char *str)
+/**
+ * Parse the configuration file into config
+ */
+static gboolean
+parse_configuration(GreeterConfig *config, const char *path)
 {
-  if (strcmp(str, "True") == 0)
-    return true;
-  else
+  GreeterConfigBranding *branding = config->branding;
+  GreeterConfigGreeter *greeter = config->greeter;
+  GreeterConfigFeatures *features = config->features;
+  const SettingsField fields[] = {
+    { "branding.background_images_dir", SETTINGS_FIELD_STRING, &branding->background_images_dir },
+    { "branding.logo_image", SETTINGS_FIELD_STRING, &branding->logo_image },
+    { "branding.user_image", SETTINGS_FIELD_STRING, &branding->user_image },
+    { "greeter.debug_mode", SETTINGS_FIELD_BOOL, &greeter->debug_mode },
+    { "greeter.detect_theme_errors", SETTINGS_FIELD_BOOL, &greeter->detect_theme_errors },
+    { "greeter.screensaver_timeout", SETTINGS_FIELD_INT, &greeter->screensaver_timeout },
+    { "greeter.secure_mode", SETTINGS_FIELD_BOOL, &greeter->secure_mode },
+    { "greeter.secure_mode_allowlist", SETTINGS_FIELD_STRV, &greeter->secure_mode_allowlist },
+    { "greeter.theme", SETTINGS_FIELD_STRING, &greeter->theme },
+    { "greeter.icon_theme", SETTINGS_FIELD_STRING, &greeter->icon_theme },
+    { "greeter.time_language", SETTINGS_FIELD_STRING, &greeter->time_language },
+    { "greeter.cache_dir", SETTINGS_FIELD_STRING, &greeter->cache_dir },
+    { "greeter.cache_size", SETTINGS_FIELD_INT, &greeter->cache_size },
+    { "layouts", SETTINGS_FIELD_PTR_ARRAY, &config->layouts },
+    { "features.battery", SETTINGS_FIELD_BOOL, &features->battery },
+    { "features.backlight.enabled", SETTINGS_FIELD_BOOL, &features->backlight->enabled },
+    { "features.backlight.value", SETTINGS_FIELD_INT, &features->backlight->value },
+    { "features.backlight.steps", SETTINGS_FIELD_INT, &features->backlight->steps },
+  };
+
+  if (!settings_loader_load_file(path, fields, G_N_ELEMENTS(fields)))
     return false;
-}
-static int
-yaml_get_int(char *str)
-{
-  return strtol(str, NULL, 10);
-}
 
-static void
-load_branding(GNode *node)
-{
-  if (node == NULL)
-    return;
-  char *key = node->data;
-  char *value = node->children->data;
-  if (strcmp(key, "background_images_dir") == 0) {
-    g_free(greeter_config->branding->background_images_dir);
-    greeter_config->branding->background_images_dir = g_strdup(value);
-  } else if (strcmp(key, "logo_image") == 0) {
-    g_free(greeter_config->branding->logo_image);
-    greeter_config->branding->logo_image = g_strdup(value);
-  } else if (strcmp(key, "user_image") == 0) {
-    g_free(greeter_config->branding->user_image);
-    greeter_config->branding->user_image = g_strdup(value);
-  }
-  /*printf("  %s: %s\n", key, (char*) value);*/
-  load_branding(node->next);
-}
-static void
-load_greeter(GNode *node)
-{
-  if (node == NULL)
-    return;
-  char *key = node->data;
-  char *value = node->children->data;
-  if (strcmp(key, "debug_mode") == 0) {
-    greeter_config->greeter->debug_mode = yaml_get_bool(value);
-  } else if (strcmp(key, "detect_theme_errors") == 0) {
-    greeter_config->greeter->detect_theme_errors = yaml_get_bool(value);
-  } else if (strcmp(key, "screensaver_timeout") == 0) {
-    greeter_config->greeter->screensaver_timeout = yaml_get_int(value);
-  } else if (strcmp(key, "secure_mode") == 0) {
-    greeter_config->greeter->secure_mode = yaml_get_bool(value);
-  } else if (strcmp(key, "theme") == 0) {
-    g_free(greeter_config->greeter->theme);
-    greeter_config->greeter->theme = g_strdup(value);
-  } else if (strcmp(key, "icon_theme") == 0) {
-    g_free(greeter_config->greeter->icon_theme);
-    greeter_config->greeter->icon_theme = g_strdup(value);
-  } else if (strcmp(key, "time_language") == 0) {
-    g_free(greeter_config->greeter->time_language);
-    greeter_config->greeter->time_language = g_strdup(value);
-  }
-  /*printf("  %s: %s\n", key, (char*) value);*/
-  load_greeter(node->next);
-}
-static void
-load_layouts(GNode *node)
-{
-  if (node == NULL)
-    return;
-  char *value = node->data;
-  g_ptr_array_add(greeter_config->layouts, g_strdup(value));
-  /*printf("  %s\n", (char *) value);*/
-  load_layouts(node->next);
+  config_cache_save(path, config);
+  return true;
 }
+
+/* Values given on the command line, kept over the configuration file */
+static char *override_theme = NULL;
+static gboolean override_debug = false;
+static gboolean override_debug_mode = false;
+
 static void
-load_backlight(GNode *node)
+apply_overrides(GreeterConfig *config)
 {
-  if (node == NULL)
-    return;
-  char *key = node->data;
-  char *value = node->children->data;
-  if (strcmp(key, "enabled") == 0) {
-    greeter_config->features->backlight->enabled = yaml_get_bool(value);
-  } else if (strcmp(key, "value") == 0) {
-    greeter_config->features->backlight->value = yaml_get_int(value);
-  } else if (strcmp(key, "steps") == 0) {
-    greeter_config->features->backlight->steps = yaml_get_int(value);
+  if (override_theme != NULL) {
+    g_free(config->greeter->theme);
+    config->greeter->theme = g_strdup(override_theme);
   }
-  /*printf("    %s: %s\n", key, (char*) value);*/
-  load_backlight(node->next);
+  if (override_debug)
+    config->greeter->debug_mode = override_debug_mode;
 }
-static void
-load_features(GNode *node)
+
+/**
+ * Use theme instead of "greeter.theme", now and after every reload
+ */
+void
+override_configuration_theme(const char *theme)
 {
-  if (node == NULL)
-    return;
-  char *key = node->data;
-  char *value = node->children->data;
-  if (strcmp(key, "battery") == 0) {
-    greeter_config->features->battery = yaml_get_bool(value);
-  } else if (strcmp(key, "backlight") == 0) {
-    load_backlight(node->children);
-  }
-  /*printf("  %s: %s\n", key, (char*) value);*/
-  load_features(node->next);
+  g_free(override_theme);
+  override_theme = g_strdup(theme);
+  if (greeter_config != NULL)
+    apply_overrides(greeter_config);
 }
 
-enum storage_flags { VAR, VAL, SEQ };
-
-static void
-process_layer(yaml_parser_t *parser, GNode *data)
+/**
+ * Use debug_mode instead of "greeter.debug_mode", now and after every reload
+ */
+void
+override_configuration_debug_mode(gboolean debug_mode)
 {
-  GNode *last_leaf = data;
-  yaml_event_t event;
-  int storage = VAR;
-
-  while (1) {
-    yaml_parser_parse(parser, &event);
-
-    if (event.type == YAML_SCALAR_EVENT) {
-      if (storage)
-        g_node_append_data(last_leaf, g_strdup((gchar *) event.data.scalar.value));
-      else
-        last_leaf = g_node_append(data, g_node_new(g_strdup((gchar *) event.data.scalar.value)));
-      storage ^= VAL;
-    } else if (event.type == YAML_SEQUENCE_START_EVENT)
-      storage = SEQ;
-    else if (event.type == YAML_SEQUENCE_END_EVENT)
-      storage = VAR;
-    else if (event.type == YAML_MAPPING_START_EVENT) {
-      process_layer(parser, last_leaf);
-      storage ^= VAL;
-    } else if (event.type == YAML_MAPPING_END_EVENT || event.type == YAML_STREAM_END_EVENT)
-      break;
-
-    yaml_event_delete(&event);
-  }
+  override_debug = true;
+  override_debug_mode = debug_mode;
+  if (greeter_config != NULL)
+    apply_overrides(greeter_config);
 }
 
-static gboolean
-node_free(GNode *node, gpointer data)
+/**
+ * Read the configuration file again into a new GreeterConfig
+ * Safe to call from any thread, as the current configuration is not used
+ * @Returns The new configuration, or NULL if it could not be parsed
+ */
+GreeterConfig *
+read_configuration(void)
 {
-  (void) data;
-  char *str = node->data;
-  if (str != NULL) {
-    g_free(str);
-    node->data = NULL;
+  GreeterConfig *config = greeter_config_new();
+  if (!parse_configuration(config, GREETER_CONFIG_PATH)) {
+    greeter_config_free(config);
+    return NULL;
   }
-  return false;
+  apply_overrides(config);
+  return config;
 }
 
 void
 load_configuration(void)
 {
-  init_greeter_config();
+  greeter_config = greeter_config_new();
 
-  const char *path_to_config = "/etc/lightdm/web-greeter.yml";
-  FILE *fh = fopen(path_to_config, "rb");
-  yaml_parser_t parser;
+  if (config_cache_load(GREETER_CONFIG_PATH, greeter_config)) {
+    logger_debug("Configuration loaded from cache");
+    return;
+  }
 
-  if (!yaml_parser_initialize(&parser) || fh == NULL) {
+  if (!parse_configuration(greeter_config, GREETER_CONFIG_PATH)) {
     logger_error("Config was not loaded");
     return;
   }
 
-  yaml_parser_set_input_file(&parser, fh);
-
-  GNode *cfg = g_node_new(g_strdup(path_to_config));
-  process_layer(&parser, cfg);
-
-  yaml_parser_delete(&parser);
-  fclose(fh);
-
-  GNode *node = cfg->children;
-  do {
-    /*printf("'%s'\n", (char*) node->data);*/
-    if (strcmp(node->data, "branding") == 0) {
-      load_branding(node->children);
-    } else if (strcmp(node->data, "greeter") == 0) {
-      load_greeter(node->children);
-    } else if (strcmp(node->data, "layouts") == 0) {
-      load_layouts(node->children);
-    } else if (strcmp(node->data, "features") == 0) {
-      load_features(node->children);
-    } else
-      break;
-    node = node->next;
-  } while (node != NULL);
-
-  g_node_traverse(cfg, G_PRE_ORDER, G_TRAVERSE_ALL, -1, node_free, NULL);
-  g_node_destroy(cfg);
-
   logger_debug("Configuration loaded");
 }
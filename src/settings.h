@@ -36,6 +36,10 @@ typedef struct greeter_config_greeter_st {
    * Don't allow themes to make remote http requests
    */
   bool secure_mode;
+  /**
+   * URL prefixes themes may still request in secure mode
+   */
+  char **secure_mode_allowlist;
   /**
    * Greeter theme to use
    */
@@ -48,6 +52,14 @@ typedef struct greeter_config_greeter_st {
    * Language to use when displaying the date or time
    */
   char *time_language;
+  /**
+   * Directory for the persistent web cache, empty to disable it
+   */
+  char *cache_dir;
+  /**
+   * Size limit of the web cache, in MiB
+   */
+  int cache_size;
 } GreeterConfigGreeter;
 
 typedef struct greeter_config_features_backlight_st {
@@ -86,6 +98,7 @@ typedef struct greeter_config_app_st {
 typedef struct greeter_config_theme_st {
   char *primary_html;
   char *secondary_html;
+  char **preload;
 } GreeterConfigTheme;
 
 /**
@@ -100,9 +113,16 @@ typedef struct greeter_config_st {
   GreeterConfigTheme *theme;
 } GreeterConfig;
 
+#define GREETER_CONFIG_PATH "/etc/lightdm/web-greeter.yml"
+
 extern GreeterConfig *greeter_config;
 
 void print_greeter_config(void);
 void free_greeter_config(void);
 void load_configuration(void);
+
+GreeterConfig *read_configuration(void);
+void override_configuration_theme(const char *theme);
+void override_configuration_debug_mode(gboolean debug_mode);
+void greeter_config_free(GreeterConfig *config);
 #endif
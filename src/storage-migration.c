@@ -0,0 +1,205 @@
+#include <glib.h>
+#include <webkit/webkit.h>
+
+#include "logger.h"
+#include "network-cache.h"
+#include "scheme.h"
+#include "storage-migration.h"
+#include "theme.h"
+
+/*
+ * Themes used to be loaded from file://, and are now served from
+ * web-greeter://, which is another origin with its own localStorage.
+ * On the first start, the localStorage of the file:// origin is read from a
+ * blank file:/// page, and a user script copies the keys the theme does not
+ * have yet into the new origin, before the theme scripts run.
+ * $XDG_CACHE_HOME/sea-greeter/storage-migrated marks the migration as done,
+ * once the script reported that it copied the keys. It is also written when
+ * the old data could not be read, so a failed migration is not tried again.
+ */
+#define STORAGE_MIGRATION_TIMEOUT 3
+
+static const char *const storage_read_script
+    = "(() => {"
+      "  const entries = [];"
+      "  for (let i = 0; i < localStorage.length; i++) {"
+      "    const key = localStorage.key(i);"
+      "    entries.push([key, localStorage.getItem(key)]);"
+      "  }"
+      "  return JSON.stringify(entries);"
+      "})()";
+
+static const char *const storage_write_script
+    = "((entries) => {"
+      "  if (window.location.protocol !== '" SCHEME_NAME ":')"
+      "    return;"
+      "  if (window.location.host === '" SCHEME_HOST_FALLBACK "')"
+      "    return;"
+      "  for (const [key, value] of entries) {"
+      "    if (localStorage.getItem(key) === null) localStorage.setItem(key, value);"
+      "  }"
+      "  window.webkit.messageHandlers.storageMigrated.postMessage(true);"
+      "})(%s);";
+
+static WebKitWebView *migration_view = NULL;
+static WebKitUserScript *migration_script = NULL;
+static GPtrArray *migration_managers = NULL;
+static guint migration_timeout_id = 0;
+static gboolean migrating = false;
+
+static gchar *
+storage_migration_get_marker_path(void)
+{
+  return g_build_filename(g_get_user_cache_dir(), "sea-greeter", "storage-migrated", NULL);
+}
+
+static void
+storage_migration_write_marker(const char *state)
+{
+  g_autofree gchar *marker_path = storage_migration_get_marker_path();
+  g_autofree gchar *marker_dir = g_path_get_dirname(marker_path);
+  g_mkdir_with_parents(marker_dir, 0700);
+  g_file_set_contents(marker_path, state, -1, NULL);
+}
+
+static void
+storage_migration_done_cb(WebKitUserContentManager *manager, JSCValue *value, gpointer user_data)
+{
+  (void) manager;
+  (void) value;
+  (void) user_data;
+  if (migration_script == NULL)
+    return;
+
+  // Later loads must not bring back keys the theme removed since
+  for (guint i = 0; i < migration_managers->len; i++) {
+    WebKitUserContentManager *migrated = migration_managers->pdata[i];
+    webkit_user_content_manager_remove_script(migrated, migration_script);
+    g_signal_handlers_disconnect_by_func(migrated, storage_migration_done_cb, NULL);
+  }
+  g_clear_pointer(&migration_script, webkit_user_script_unref);
+  storage_migration_write_marker("done");
+  logger_debug("Theme localStorage is migrated from file://");
+}
+
+static void
+storage_migration_finish(const char *entries)
+{
+  if (!migrating)
+    return;
+  migrating = false;
+  g_clear_handle_id(&migration_timeout_id, g_source_remove);
+
+  if (entries == NULL) {
+    storage_migration_write_marker("failed");
+  } else if (g_strcmp0(entries, "[]") == 0) {
+    storage_migration_write_marker("done");
+  } else {
+    g_autofree gchar *source = g_strdup_printf(storage_write_script, entries);
+    migration_script = webkit_user_script_new(
+        source,
+        WEBKIT_USER_CONTENT_INJECT_TOP_FRAME,
+        WEBKIT_USER_SCRIPT_INJECT_AT_DOCUMENT_START,
+        NULL,
+        NULL);
+  }
+
+  release_theme_loads();
+}
+
+static void
+storage_migration_read_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  (void) user_data;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(JSCValue) value = webkit_web_view_evaluate_javascript_finish(WEBKIT_WEB_VIEW(source_object), result, &error);
+  if (value == NULL || !jsc_value_is_string(value)) {
+    logger_warn("Theme localStorage was not migrated: %s", error != NULL ? error->message : "no data");
+    storage_migration_finish(NULL);
+    return;
+  }
+
+  g_autofree gchar *entries = jsc_value_to_string(value);
+  storage_migration_finish(entries);
+}
+
+static void
+storage_migration_load_changed_cb(WebKitWebView *web_view, WebKitLoadEvent load_event, gpointer user_data)
+{
+  (void) user_data;
+  if (load_event != WEBKIT_LOAD_FINISHED)
+    return;
+  webkit_web_view_evaluate_javascript(
+      web_view,
+      storage_read_script,
+      -1,
+      NULL,
+      NULL,
+      NULL,
+      storage_migration_read_cb,
+      NULL);
+}
+
+static gboolean
+storage_migration_timeout_cb(gpointer user_data)
+{
+  (void) user_data;
+  migration_timeout_id = 0;
+  logger_warn("Theme localStorage was not migrated: timed out");
+  storage_migration_finish(NULL);
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * Read the localStorage of the file:// origin once, holding theme loads meanwhile
+ */
+void
+storage_migration_start(void)
+{
+  g_autofree gchar *marker_path = storage_migration_get_marker_path();
+  if (migration_view != NULL || g_file_test(marker_path, G_FILE_TEST_EXISTS))
+    return;
+
+  migration_view
+      = g_object_ref_sink(g_object_new(WEBKIT_TYPE_WEB_VIEW, "network-session", network_cache_get_session(), NULL));
+  WebKitSettings *settings = webkit_web_view_get_settings(migration_view);
+  g_object_set(G_OBJECT(settings), "allow-file-access-from-file-urls", true, NULL);
+  g_object_set(G_OBJECT(settings), "enable-html5-local-storage", true, NULL);
+  g_signal_connect(migration_view, "load-changed", G_CALLBACK(storage_migration_load_changed_cb), NULL);
+
+  migrating = true;
+  hold_theme_loads();
+  migration_timeout_id = g_timeout_add_seconds(STORAGE_MIGRATION_TIMEOUT, storage_migration_timeout_cb, NULL);
+  webkit_web_view_load_html(migration_view, "<!DOCTYPE html>", "file:///");
+}
+
+/**
+ * Add the migration script to manager, once, when there is something to migrate
+ */
+void
+storage_migration_attach(WebKitUserContentManager *manager)
+{
+  if (migration_script == NULL || g_object_get_data(G_OBJECT(manager), "storage-migration") != NULL)
+    return;
+  webkit_user_content_manager_add_script(manager, migration_script);
+  webkit_user_content_manager_register_script_message_handler(manager, "storageMigrated", NULL);
+  g_signal_connect(
+      manager,
+      "script-message-received::storageMigrated",
+      G_CALLBACK(storage_migration_done_cb),
+      NULL);
+  g_object_set_data(G_OBJECT(manager), "storage-migration", GINT_TO_POINTER(true));
+
+  if (migration_managers == NULL)
+    migration_managers = g_ptr_array_new_with_free_func(g_object_unref);
+  g_ptr_array_add(migration_managers, g_object_ref(manager));
+}
+
+void
+storage_migration_destroy(void)
+{
+  g_clear_handle_id(&migration_timeout_id, g_source_remove);
+  g_clear_pointer(&migration_script, webkit_user_script_unref);
+  g_clear_pointer(&migration_managers, g_ptr_array_unref);
+  g_clear_object(&migration_view);
+}
@@ -0,0 +1,10 @@
+#ifndef STORAGE_MIGRATION_H
+#define STORAGE_MIGRATION_H 1
+
+#include <webkit/webkit.h>
+
+void storage_migration_start(void);
+void storage_migration_attach(WebKitUserContentManager *manager);
+void storage_migration_destroy(void);
+
+#endif
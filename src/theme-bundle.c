@@ -0,0 +1,335 @@
+#include <gio/gio.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logger.h"
+#include "theme-bundle.h"
+
+/*
+ * A theme bundle is a single file with every file of a theme directory:
+ *
+ *   magic     8 bytes, "SEATHEME"
+ *   version   guint32, little endian
+ *   reserved  guint32
+ *   toc_size  guint64, little endian
+ *   toc       "a{s(ttt)}" little endian GVariant,
+ *             relative path -> (offset, stored size, original size)
+ *   blob      file contents, offsets are relative to its start
+ *
+ * Entries whose stored size differs from their original size are
+ * zlib compressed.
+ */
+#define THEME_BUNDLE_MAGIC "SEATHEME"
+#define THEME_BUNDLE_MAGIC_SIZE 8
+#define THEME_BUNDLE_VERSION 1
+#define THEME_BUNDLE_HEADER_SIZE (THEME_BUNDLE_MAGIC_SIZE + 4 + 4 + 8)
+#define THEME_BUNDLE_TOC_TYPE "a{s(ttt)}"
+
+typedef struct {
+  guint64 offset;
+  guint64 size;
+  guint64 original_size;
+  GBytes *uncompressed;
+} ThemeBundleEntry;
+
+struct _ThemeBundle {
+  gchar *path;
+  GBytes *data;
+  gsize blob_offset;
+  GHashTable *entries;
+};
+
+static GBytes *
+theme_bundle_convert(GConverter *converter, const guint8 *data, gsize size, GError **error)
+{
+  GByteArray *output = g_byte_array_sized_new(size);
+  guint8 buffer[16384];
+  gsize total_read = 0;
+  GConverterResult result;
+
+  do {
+    gsize bytes_read = 0;
+    gsize bytes_written = 0;
+    result = g_converter_convert(
+        converter,
+        data + total_read,
+        size - total_read,
+        buffer,
+        sizeof buffer,
+        G_CONVERTER_INPUT_AT_END,
+        &bytes_read,
+        &bytes_written,
+        error);
+    if (result == G_CONVERTER_ERROR) {
+      g_byte_array_unref(output);
+      return NULL;
+    }
+    total_read += bytes_read;
+    g_byte_array_append(output, buffer, bytes_written);
+  } while (result != G_CONVERTER_FINISHED);
+
+  return g_byte_array_free_to_bytes(output);
+}
+
+static void
+theme_bundle_collect(const gchar *root, const gchar *relative, GPtrArray *paths)
+{
+  g_autofree gchar *dir_path = relative != NULL ? g_build_filename(root, relative, NULL) : g_strdup(root);
+  g_autoptr(GDir) dir = g_dir_open(dir_path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  const gchar *name;
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    gchar *child = relative != NULL ? g_build_filename(relative, name, NULL) : g_strdup(name);
+    g_autofree gchar *child_path = g_build_filename(root, child, NULL);
+
+    if (g_file_test(child_path, G_FILE_TEST_IS_DIR) && !g_file_test(child_path, G_FILE_TEST_IS_SYMLINK)) {
+      theme_bundle_collect(root, child, paths);
+      g_free(child);
+    } else if (g_file_test(child_path, G_FILE_TEST_IS_REGULAR)) {
+      g_ptr_array_add(paths, child);
+    } else {
+      g_free(child);
+    }
+  }
+}
+
+static gint
+theme_bundle_compare_paths(gconstpointer a, gconstpointer b)
+{
+  return g_strcmp0(*((const gchar **) a), *((const gchar **) b));
+}
+
+/**
+ * Pack a theme directory into a single bundle file
+ * @param theme_dir The theme directory, which must contain an index.yml
+ * @param output The bundle file to write
+ * @param compress Whether to zlib compress the entries that get smaller
+ */
+gboolean
+theme_bundle_write(const gchar *theme_dir, const gchar *output, gboolean compress, GError **error)
+{
+  g_autofree gchar *index_path = g_build_filename(theme_dir, "index.yml", NULL);
+  if (!g_file_test(index_path, G_FILE_TEST_IS_REGULAR)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "\"%s\" has no index.yml", theme_dir);
+    return false;
+  }
+
+  g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+  theme_bundle_collect(theme_dir, NULL, paths);
+  g_ptr_array_sort(paths, theme_bundle_compare_paths);
+
+  g_autoptr(GByteArray) blob = g_byte_array_new();
+  GVariantBuilder toc_builder;
+  g_variant_builder_init(&toc_builder, G_VARIANT_TYPE(THEME_BUNDLE_TOC_TYPE));
+
+  for (guint i = 0; i < paths->len; i++) {
+    const gchar *path = paths->pdata[i];
+    g_autofree gchar *file_path = g_build_filename(theme_dir, path, NULL);
+    g_autofree gchar *contents = NULL;
+    gsize size = 0;
+    if (!g_file_get_contents(file_path, &contents, &size, error)) {
+      g_variant_builder_clear(&toc_builder);
+      return false;
+    }
+
+    const guint8 *stored = (const guint8 *) contents;
+    gsize stored_size = size;
+    g_autoptr(GBytes) compressed = NULL;
+
+    if (compress && size > 0) {
+      g_autoptr(GZlibCompressor) compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB, 9);
+      compressed = theme_bundle_convert(G_CONVERTER(compressor), stored, size, NULL);
+      if (compressed != NULL && g_bytes_get_size(compressed) < size) {
+        stored = g_bytes_get_data(compressed, &stored_size);
+      }
+    }
+
+    g_variant_builder_add(
+        &toc_builder,
+        "{s(ttt)}",
+        path,
+        (guint64) blob->len,
+        (guint64) stored_size,
+        (guint64) size);
+    g_byte_array_append(blob, stored, stored_size);
+  }
+
+  g_autoptr(GVariant) toc = g_variant_ref_sink(g_variant_builder_end(&toc_builder));
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant *swapped = g_variant_byteswap(toc);
+    g_variant_unref(toc);
+    toc = swapped;
+  }
+
+  guint32 version = GUINT32_TO_LE(THEME_BUNDLE_VERSION);
+  guint32 reserved = 0;
+  guint64 toc_size = GUINT64_TO_LE(g_variant_get_size(toc));
+
+  g_autoptr(GByteArray) bundle = g_byte_array_sized_new(THEME_BUNDLE_HEADER_SIZE + g_variant_get_size(toc) + blob->len);
+  g_byte_array_append(bundle, (const guint8 *) THEME_BUNDLE_MAGIC, THEME_BUNDLE_MAGIC_SIZE);
+  g_byte_array_append(bundle, (const guint8 *) &version, sizeof version);
+  g_byte_array_append(bundle, (const guint8 *) &reserved, sizeof reserved);
+  g_byte_array_append(bundle, (const guint8 *) &toc_size, sizeof toc_size);
+  g_byte_array_append(bundle, g_variant_get_data(toc), g_variant_get_size(toc));
+  g_byte_array_append(bundle, blob->data, blob->len);
+
+  return g_file_set_contents(output, (const gchar *) bundle->data, bundle->len, error);
+}
+
+/**
+ * Whether the file at path is a theme bundle
+ */
+gboolean
+theme_bundle_is_bundle(const gchar *path)
+{
+  if (!g_file_test(path, G_FILE_TEST_IS_REGULAR))
+    return false;
+
+  g_autoptr(GFile) file = g_file_new_for_path(path);
+  g_autoptr(GFileInputStream) stream = g_file_read(file, NULL, NULL);
+  if (stream == NULL)
+    return false;
+
+  gchar magic[THEME_BUNDLE_MAGIC_SIZE];
+  gsize bytes_read = 0;
+  if (!g_input_stream_read_all(G_INPUT_STREAM(stream), magic, sizeof magic, &bytes_read, NULL, NULL))
+    return false;
+
+  return bytes_read == THEME_BUNDLE_MAGIC_SIZE && memcmp(magic, THEME_BUNDLE_MAGIC, THEME_BUNDLE_MAGIC_SIZE) == 0;
+}
+
+static void
+theme_bundle_entry_free(gpointer data)
+{
+  ThemeBundleEntry *entry = data;
+  if (entry->uncompressed != NULL)
+    g_bytes_unref(entry->uncompressed);
+  g_free(entry);
+}
+
+/**
+ * Open a theme bundle
+ * The whole file is read at once, so loading a theme is a single sequential read
+ */
+ThemeBundle *
+theme_bundle_open(const gchar *path, GError **error)
+{
+  gchar *contents = NULL;
+  gsize size = 0;
+  if (!g_file_get_contents(path, &contents, &size, error))
+    return NULL;
+  g_autoptr(GBytes) data = g_bytes_new_take(contents, size);
+
+  if (size < THEME_BUNDLE_HEADER_SIZE || memcmp(contents, THEME_BUNDLE_MAGIC, THEME_BUNDLE_MAGIC_SIZE) != 0) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "\"%s\" is not a theme bundle", path);
+    return NULL;
+  }
+
+  guint32 version;
+  guint64 toc_size;
+  memcpy(&version, contents + THEME_BUNDLE_MAGIC_SIZE, sizeof version);
+  memcpy(&toc_size, contents + THEME_BUNDLE_MAGIC_SIZE + 8, sizeof toc_size);
+  version = GUINT32_FROM_LE(version);
+  toc_size = GUINT64_FROM_LE(toc_size);
+
+  if (version != THEME_BUNDLE_VERSION || toc_size > size - THEME_BUNDLE_HEADER_SIZE) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "\"%s\" is not a supported theme bundle", path);
+    return NULL;
+  }
+
+  g_autoptr(GBytes) toc_data = g_bytes_new_from_bytes(data, THEME_BUNDLE_HEADER_SIZE, toc_size);
+  g_autoptr(GVariant) toc
+      = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(THEME_BUNDLE_TOC_TYPE), toc_data, false));
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant *swapped = g_variant_byteswap(toc);
+    g_variant_unref(toc);
+    toc = swapped;
+  }
+
+  ThemeBundle *bundle = g_malloc(sizeof *bundle);
+  bundle->path = g_strdup(path);
+  bundle->data = g_bytes_ref(data);
+  bundle->blob_offset = THEME_BUNDLE_HEADER_SIZE + toc_size;
+  bundle->entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, theme_bundle_entry_free);
+
+  gsize blob_size = size - bundle->blob_offset;
+  GVariantIter iter;
+  const gchar *entry_path;
+  guint64 offset, stored_size, original_size;
+  g_variant_iter_init(&iter, toc);
+  while (g_variant_iter_next(&iter, "{&s(ttt)}", &entry_path, &offset, &stored_size, &original_size)) {
+    if (offset > blob_size || stored_size > blob_size - offset) {
+      logger_warn("Theme bundle entry \"%s\" is out of bounds", entry_path);
+      continue;
+    }
+    ThemeBundleEntry *entry = g_malloc(sizeof *entry);
+    entry->offset = offset;
+    entry->size = stored_size;
+    entry->original_size = original_size;
+    entry->uncompressed = NULL;
+    g_hash_table_insert(bundle->entries, g_strdup(entry_path), entry);
+  }
+
+  return bundle;
+}
+
+void
+theme_bundle_free(ThemeBundle *bundle)
+{
+  if (bundle == NULL)
+    return;
+  g_free(bundle->path);
+  g_bytes_unref(bundle->data);
+  g_hash_table_unref(bundle->entries);
+  g_free(bundle);
+}
+
+const gchar *
+theme_bundle_get_path(ThemeBundle *bundle)
+{
+  return bundle->path;
+}
+
+gboolean
+theme_bundle_contains(ThemeBundle *bundle, const gchar *path)
+{
+  while (path != NULL && path[0] == '/')
+    path++;
+  return g_hash_table_contains(bundle->entries, path);
+}
+
+/**
+ * Get the contents of a file inside the bundle
+ * @param path The path relative to the theme directory
+ * @Returns A new GBytes reference, or NULL if the file is not in the bundle
+ */
+GBytes *
+theme_bundle_lookup(ThemeBundle *bundle, const gchar *path)
+{
+  while (path != NULL && path[0] == '/')
+    path++;
+
+  ThemeBundleEntry *entry = g_hash_table_lookup(bundle->entries, path);
+  if (entry == NULL)
+    return NULL;
+
+  GBytes *stored = g_bytes_new_from_bytes(bundle->data, bundle->blob_offset + entry->offset, entry->size);
+  if (entry->size == entry->original_size)
+    return stored;
+
+  if (entry->uncompressed == NULL) {
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GZlibDecompressor) decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB);
+    gsize size = 0;
+    const guint8 *data = g_bytes_get_data(stored, &size);
+    entry->uncompressed = theme_bundle_convert(G_CONVERTER(decompressor), data, size, &error);
+    if (entry->uncompressed == NULL)
+      logger_error("Could not decompress \"%s\": %s", path, error->message);
+  }
+  g_bytes_unref(stored);
+
+  return entry->uncompressed != NULL ? g_bytes_ref(entry->uncompressed) : NULL;
+}
@@ -0,0 +1,21 @@
+#ifndef THEME_BUNDLE_H
+#define THEME_BUNDLE_H 1
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#define THEME_BUNDLE_SUFFIX ".bundle"
+
+typedef struct _ThemeBundle ThemeBundle;
+
+gboolean theme_bundle_write(const gchar *theme_dir, const gchar *output, gboolean compress, GError **error);
+
+gboolean theme_bundle_is_bundle(const gchar *path);
+ThemeBundle *theme_bundle_open(const gchar *path, GError **error);
+void theme_bundle_free(ThemeBundle *bundle);
+
+const gchar *theme_bundle_get_path(ThemeBundle *bundle);
+gboolean theme_bundle_contains(ThemeBundle *bundle, const gchar *path);
+GBytes *theme_bundle_lookup(ThemeBundle *bundle, const gchar *path);
+
+#endif
@@ -0,0 +1,388 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "settings.h"
+#include "theme-bundle.h"
+#include "theme-index.h"
+#include "theme.h"
+
+/*
+ * The theme index keeps the entry points of every installed theme in
+ * $XDG_CACHE_HOME/sea-greeter/themes.index, as a serialized GVariant that
+ * is mapped instead of read.
+ * A theme is parsed again only when its directory, its index.yml or its
+ * bundle changed; when the themes directory itself did not change, it is
+ * not even read.
+ * Theme sizes are refreshed along with the theme, so changes deep inside
+ * a theme directory may not be reflected until its top level changes.
+ */
+#define THEME_INDEX_VERSION 1
+#define THEME_INDEX_ENTRY_TYPE "(ssssasbtxx)"
+#define THEME_INDEX_ENTRY_FORMAT "(ssss^asbtxx)"
+#define THEME_INDEX_TYPE "(usxa" THEME_INDEX_ENTRY_TYPE ")"
+#define THEME_INDEX_MAX_DEPTH 16
+
+static void
+theme_index_entry_free(gpointer data)
+{
+  ThemeIndexEntry *entry = data;
+  g_free(entry->name);
+  g_free(entry->path);
+  g_free(entry->primary_html);
+  g_free(entry->secondary_html);
+  g_strfreev(entry->preload);
+  g_free(entry);
+}
+
+static gint64
+theme_index_stat_mtime(struct stat *file_stat)
+{
+  return (gint64) file_stat->st_mtim.tv_sec * G_USEC_PER_SEC + file_stat->st_mtim.tv_nsec / 1000;
+}
+
+static gchar *
+theme_index_get_cache_path(void)
+{
+  return g_build_filename(g_get_user_cache_dir(), "sea-greeter", "themes.index", NULL);
+}
+
+/**
+ * Sum the size of the regular files in a directory tree
+ * dir_fd is consumed
+ */
+static guint64
+theme_index_dir_size(int dir_fd, guint depth)
+{
+  DIR *dir = fdopendir(dir_fd);
+  if (dir == NULL) {
+    close(dir_fd);
+    return 0;
+  }
+
+  guint64 size = 0;
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (g_strcmp0(ent->d_name, ".") == 0 || g_strcmp0(ent->d_name, "..") == 0)
+      continue;
+
+    if (ent->d_type == DT_DIR && depth < THEME_INDEX_MAX_DEPTH) {
+      int child_fd = openat(dirfd(dir), ent->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+      if (child_fd >= 0)
+        size += theme_index_dir_size(child_fd, depth + 1);
+      continue;
+    }
+    if (ent->d_type != DT_REG && ent->d_type != DT_UNKNOWN)
+      continue;
+
+    struct stat file_stat;
+    if (fstatat(dirfd(dir), ent->d_name, &file_stat, AT_SYMLINK_NOFOLLOW) != 0)
+      continue;
+    if (S_ISREG(file_stat.st_mode)) {
+      size += file_stat.st_size;
+    } else if (S_ISDIR(file_stat.st_mode) && depth < THEME_INDEX_MAX_DEPTH) {
+      int child_fd = openat(dirfd(dir), ent->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+      if (child_fd >= 0)
+        size += theme_index_dir_size(child_fd, depth + 1);
+    }
+  }
+  closedir(dir);
+  return size;
+}
+
+static gint64
+theme_index_config_mtime(int themes_fd, const gchar *file_name)
+{
+  g_autofree gchar *config = g_build_filename(file_name, "index.yml", NULL);
+  struct stat config_stat;
+  if (fstatat(themes_fd, config, &config_stat, 0) != 0)
+    return 0;
+  return theme_index_stat_mtime(&config_stat);
+}
+
+/**
+ * Index a theme directory or bundle
+ * @return The entry, or NULL if file_name is neither
+ */
+static ThemeIndexEntry *
+theme_index_entry_new(int themes_fd, const gchar *themes_dir, const gchar *file_name, struct stat *file_stat)
+{
+  g_autofree gchar *path = g_build_path("/", themes_dir, file_name, NULL);
+  g_autoptr(GBytes) config = NULL;
+  gboolean is_bundle = false;
+  guint64 size = 0;
+
+  if (S_ISDIR(file_stat->st_mode)) {
+    g_autofree gchar *config_path = g_build_filename(path, "index.yml", NULL);
+    gchar *contents = NULL;
+    gsize length = 0;
+    if (g_file_get_contents(config_path, &contents, &length, NULL))
+      config = g_bytes_new_take(contents, length);
+
+    int dir_fd = openat(themes_fd, file_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0)
+      size = theme_index_dir_size(dir_fd, 0);
+  } else if (S_ISREG(file_stat->st_mode) && g_str_has_suffix(file_name, THEME_BUNDLE_SUFFIX)) {
+    g_autoptr(GError) error = NULL;
+    ThemeBundle *bundle = theme_bundle_open(path, &error);
+    if (bundle == NULL) {
+      logger_debug("\"%s\" was not indexed: %s", path, error->message);
+      return NULL;
+    }
+    config = theme_bundle_lookup(bundle, "index.yml");
+    theme_bundle_free(bundle);
+    is_bundle = true;
+    size = file_stat->st_size;
+  } else {
+    return NULL;
+  }
+
+  GreeterConfigTheme theme = { .primary_html = g_strdup("index.html"), .secondary_html = NULL, .preload = NULL };
+  if (config != NULL) {
+    gsize length = 0;
+    const char *data = g_bytes_get_data(config, &length);
+    read_theme_config(data, length, &theme);
+  }
+
+  ThemeIndexEntry *entry = g_malloc(sizeof *entry);
+  entry->name = is_bundle ? g_strndup(file_name, strlen(file_name) - strlen(THEME_BUNDLE_SUFFIX)) : g_strdup(file_name);
+  entry->path = g_steal_pointer(&path);
+  entry->primary_html = theme.primary_html;
+  entry->secondary_html = theme.secondary_html;
+  entry->preload = theme.preload;
+  entry->is_bundle = is_bundle;
+  entry->size = size;
+  entry->mtime = theme_index_stat_mtime(file_stat);
+  entry->config_mtime = is_bundle ? 0 : theme_index_config_mtime(themes_fd, file_name);
+  return entry;
+}
+
+static gboolean
+theme_index_entry_is_current(ThemeIndexEntry *entry, int themes_fd, const gchar *file_name, struct stat *file_stat)
+{
+  if (entry->mtime != theme_index_stat_mtime(file_stat))
+    return false;
+  if (entry->is_bundle)
+    return entry->size == (guint64) file_stat->st_size;
+  return entry->config_mtime == theme_index_config_mtime(themes_fd, file_name);
+}
+
+/**
+ * Read the persisted index of themes_dir
+ * @return A table of entries by file name, or NULL if there is no usable index
+ */
+static GHashTable *
+theme_index_read(const gchar *themes_dir, gint64 *dir_mtime)
+{
+  g_autofree gchar *cache_path = theme_index_get_cache_path();
+  GMappedFile *mapped = g_mapped_file_new(cache_path, false, NULL);
+  if (mapped == NULL)
+    return NULL;
+  g_autoptr(GBytes) bytes = g_mapped_file_get_bytes(mapped);
+  g_mapped_file_unref(mapped);
+  g_autoptr(GVariant) index
+      = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(THEME_INDEX_TYPE), bytes, false));
+
+  guint32 version = 0;
+  const gchar *indexed_dir = NULL;
+  g_autoptr(GVariantIter) iter = NULL;
+  g_variant_get(index, "(u&sxa" THEME_INDEX_ENTRY_TYPE ")", &version, &indexed_dir, dir_mtime, &iter);
+  if (version != THEME_INDEX_VERSION || g_strcmp0(indexed_dir, themes_dir) != 0)
+    return NULL;
+
+  GHashTable *entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, theme_index_entry_free);
+  ThemeIndexEntry entry;
+  while (g_variant_iter_next(
+      iter,
+      THEME_INDEX_ENTRY_FORMAT,
+      &entry.name,
+      &entry.path,
+      &entry.primary_html,
+      &entry.secondary_html,
+      &entry.preload,
+      &entry.is_bundle,
+      &entry.size,
+      &entry.mtime,
+      &entry.config_mtime)) {
+    if (g_strcmp0(entry.secondary_html, "") == 0)
+      g_clear_pointer(&entry.secondary_html, g_free);
+    if (entry.preload != NULL && entry.preload[0] == NULL)
+      g_clear_pointer(&entry.preload, g_strfreev);
+
+    ThemeIndexEntry *copy = g_memdup2(&entry, sizeof entry);
+    g_hash_table_insert(entries, g_path_get_basename(copy->path), copy);
+  }
+  return entries;
+}
+
+static void
+theme_index_write(const gchar *themes_dir, gint64 dir_mtime, GPtrArray *index)
+{
+  const gchar *const no_preload[] = { NULL };
+
+  GVariantBuilder entries;
+  g_variant_builder_init(&entries, G_VARIANT_TYPE("a" THEME_INDEX_ENTRY_TYPE));
+  for (guint i = 0; i < index->len; i++) {
+    ThemeIndexEntry *entry = index->pdata[i];
+    g_variant_builder_add(
+        &entries,
+        THEME_INDEX_ENTRY_FORMAT,
+        entry->name,
+        entry->path,
+        entry->primary_html,
+        entry->secondary_html != NULL ? entry->secondary_html : "",
+        entry->preload != NULL ? (const gchar *const *) entry->preload : no_preload,
+        entry->is_bundle,
+        entry->size,
+        entry->mtime,
+        entry->config_mtime);
+  }
+
+  g_autoptr(GVariant) value = g_variant_ref_sink(g_variant_new(
+      "(usx@a" THEME_INDEX_ENTRY_TYPE ")",
+      THEME_INDEX_VERSION,
+      themes_dir,
+      dir_mtime,
+      g_variant_builder_end(&entries)));
+
+  g_autofree gchar *cache_path = theme_index_get_cache_path();
+  g_autofree gchar *cache_dir = g_path_get_dirname(cache_path);
+  g_autoptr(GError) error = NULL;
+  if (g_mkdir_with_parents(cache_dir, 0700) != 0
+      || !g_file_set_contents(cache_path, g_variant_get_data(value), g_variant_get_size(value), &error)) {
+    logger_debug("Theme index was not saved: %s", error != NULL ? error->message : g_strerror(errno));
+  }
+}
+
+static gint
+theme_index_compare(gconstpointer a, gconstpointer b)
+{
+  const ThemeIndexEntry *entry1 = *((ThemeIndexEntry **) a);
+  const ThemeIndexEntry *entry2 = *((ThemeIndexEntry **) b);
+
+  g_autofree char *name1 = g_utf8_casefold(entry1->name, -1);
+  g_autofree char *name2 = g_utf8_casefold(entry2->name, -1);
+  gint value = strcmp(name1, name2);
+  if (value == 0)
+    value = entry1->is_bundle - entry2->is_bundle;
+  return value;
+}
+
+/**
+ * Get the themes installed in themes_dir, sorted by name
+ * The persisted index is updated for the themes that changed
+ * @return An array of ThemeIndexEntry, or NULL if themes_dir can not be read
+ */
+GPtrArray *
+theme_index_load(const gchar *themes_dir)
+{
+  int themes_fd = open(themes_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (themes_fd < 0)
+    return NULL;
+
+  struct stat dir_stat;
+  if (fstat(themes_fd, &dir_stat) != 0) {
+    close(themes_fd);
+    return NULL;
+  }
+  gint64 dir_mtime = theme_index_stat_mtime(&dir_stat);
+
+  gint64 indexed_mtime = 0;
+  g_autoptr(GHashTable) cached = theme_index_read(themes_dir, &indexed_mtime);
+  gboolean changed = cached == NULL || indexed_mtime != dir_mtime;
+
+  // Entries only come and go when the themes directory mtime changes
+  g_autoptr(GPtrArray) file_names = g_ptr_array_new_with_free_func(g_free);
+  if (!changed) {
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, cached);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+      g_ptr_array_add(file_names, g_strdup(key));
+    }
+  } else {
+    DIR *dir = fdopendir(dup(themes_fd));
+    struct dirent *ent;
+    while (dir != NULL && (ent = readdir(dir)) != NULL) {
+      if (ent->d_name[0] == '.')
+        continue;
+      if (ent->d_type != DT_DIR && ent->d_type != DT_REG && ent->d_type != DT_LNK && ent->d_type != DT_UNKNOWN)
+        continue;
+      if (ent->d_type == DT_REG && !g_str_has_suffix(ent->d_name, THEME_BUNDLE_SUFFIX))
+        continue;
+      g_ptr_array_add(file_names, g_strdup(ent->d_name));
+    }
+    if (dir != NULL)
+      closedir(dir);
+  }
+
+  GPtrArray *index = g_ptr_array_new_with_free_func(theme_index_entry_free);
+  for (guint i = 0; i < file_names->len; i++) {
+    const gchar *file_name = file_names->pdata[i];
+    struct stat file_stat;
+    if (fstatat(themes_fd, file_name, &file_stat, 0) != 0) {
+      changed = true;
+      continue;
+    }
+
+    gpointer stolen_key = NULL;
+    gpointer stolen_entry = NULL;
+    if (cached != NULL && g_hash_table_steal_extended(cached, file_name, &stolen_key, &stolen_entry)) {
+      g_free(stolen_key);
+      if (theme_index_entry_is_current(stolen_entry, themes_fd, file_name, &file_stat)) {
+        g_ptr_array_add(index, stolen_entry);
+        continue;
+      }
+      theme_index_entry_free(stolen_entry);
+    }
+
+    changed = true;
+    ThemeIndexEntry *entry = theme_index_entry_new(themes_fd, themes_dir, file_name, &file_stat);
+    if (entry != NULL)
+      g_ptr_array_add(index, entry);
+  }
+  close(themes_fd);
+
+  g_ptr_array_sort(index, theme_index_compare);
+  if (changed)
+    theme_index_write(themes_dir, dir_mtime, index);
+  return index;
+}
+
+/**
+ * Find a theme by name, preferring its bundle over its directory
+ */
+ThemeIndexEntry *
+theme_index_lookup(GPtrArray *index, const gchar *name)
+{
+  if (index == NULL || name == NULL)
+    return NULL;
+
+  ThemeIndexEntry *found = NULL;
+  for (guint i = 0; i < index->len; i++) {
+    ThemeIndexEntry *entry = index->pdata[i];
+    if (g_strcmp0(entry->name, name) == 0 && (found == NULL || entry->is_bundle))
+      found = entry;
+  }
+  return found;
+}
+
+ThemeIndexEntry *
+theme_index_lookup_path(GPtrArray *index, const gchar *path)
+{
+  if (index == NULL || path == NULL)
+    return NULL;
+
+  for (guint i = 0; i < index->len; i++) {
+    ThemeIndexEntry *entry = index->pdata[i];
+    if (g_strcmp0(entry->path, path) == 0)
+      return entry;
+  }
+  return NULL;
+}
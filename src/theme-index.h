@@ -0,0 +1,22 @@
+#ifndef THEME_INDEX_H
+#define THEME_INDEX_H 1
+
+#include <glib.h>
+
+typedef struct {
+  gchar *name;
+  gchar *path;
+  gchar *primary_html;
+  gchar *secondary_html;
+  gchar **preload;
+  gboolean is_bundle;
+  guint64 size;
+  gint64 mtime;
+  gint64 config_mtime;
+} ThemeIndexEntry;
+
+GPtrArray *theme_index_load(const gchar *themes_dir);
+ThemeIndexEntry *theme_index_lookup(GPtrArray *index, const gchar *name);
+ThemeIndexEntry *theme_index_lookup_path(GPtrArray *index, const gchar *path);
+
+#endif
@@ -0,0 +1,138 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "theme-preload.h"
+
+/*
+ * Theme assets are read through the page cache while the web process spawns.
+ * posix_fadvise(WILLNEED) starts asynchronous readahead without copying
+ * anything, so the walk itself is cheap; it is bounded anyway so a huge
+ * background directory does not evict everything else.
+ */
+#define THEME_PRELOAD_MAX_BYTES (128 * 1024 * 1024)
+#define THEME_PRELOAD_MAX_FILES 4096
+#define THEME_PRELOAD_MAX_DEPTH 8
+
+typedef struct {
+  GPtrArray *paths;
+  goffset bytes;
+  guint files;
+} ThemePreload;
+
+static gboolean
+theme_preload_exhausted(ThemePreload *preload)
+{
+  return preload->bytes >= THEME_PRELOAD_MAX_BYTES || preload->files >= THEME_PRELOAD_MAX_FILES;
+}
+
+static void
+theme_preload_file(ThemePreload *preload, int dir_fd, const char *name)
+{
+  int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+    goffset length = MIN((goffset) file_stat.st_size, THEME_PRELOAD_MAX_BYTES - preload->bytes);
+    posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED);
+    preload->bytes += length;
+    preload->files++;
+  }
+  close(fd);
+}
+
+static void
+theme_preload_dir(ThemePreload *preload, int dir_fd, guint depth)
+{
+  DIR *dir = fdopendir(dir_fd);
+  if (dir == NULL) {
+    close(dir_fd);
+    return;
+  }
+
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL && !theme_preload_exhausted(preload)) {
+    // Hidden entries are usually VCS data, which themes never load
+    if (ent->d_name[0] == '.')
+      continue;
+
+    unsigned char type = ent->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat entry_stat;
+      if (fstatat(dirfd(dir), ent->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) != 0)
+        continue;
+      type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : S_ISREG(entry_stat.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+
+    if (type == DT_REG) {
+      theme_preload_file(preload, dirfd(dir), ent->d_name);
+    } else if (type == DT_DIR && depth < THEME_PRELOAD_MAX_DEPTH) {
+      int child_fd = openat(dirfd(dir), ent->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+      if (child_fd >= 0)
+        theme_preload_dir(preload, child_fd, depth + 1);
+    }
+  }
+  closedir(dir);
+}
+
+static gpointer
+theme_preload_thread(gpointer data)
+{
+  ThemePreload *preload = data;
+  gint64 start = g_get_monotonic_time();
+
+  for (guint i = 0; i < preload->paths->len && !theme_preload_exhausted(preload); i++) {
+    const char *path = preload->paths->pdata[i];
+    struct stat path_stat;
+    if (stat(path, &path_stat) != 0)
+      continue;
+
+    if (S_ISDIR(path_stat.st_mode)) {
+      int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (dir_fd >= 0)
+        theme_preload_dir(preload, dir_fd, 0);
+    } else {
+      theme_preload_file(preload, AT_FDCWD, path);
+    }
+  }
+
+  logger_debug(
+      "Preloaded %u theme files (%" G_GOFFSET_FORMAT " bytes) in %" G_GINT64_FORMAT " ms",
+      preload->files,
+      preload->bytes,
+      (g_get_monotonic_time() - start) / 1000);
+
+  g_ptr_array_unref(preload->paths);
+  g_free(preload);
+  return NULL;
+}
+
+/**
+ * Start reading ahead files and directories in a background thread
+ * Paths are preloaded in order, until the budget is exhausted
+ * @param paths Absolute paths, the array is consumed
+ */
+void
+theme_preload_start(GPtrArray *paths)
+{
+  ThemePreload *preload = g_malloc0(sizeof *preload);
+  preload->paths = paths;
+
+  GError *error = NULL;
+  GThread *thread = g_thread_try_new("theme-preload", theme_preload_thread, preload, &error);
+  if (thread == NULL) {
+    logger_warn("Could not preload theme: %s", error->message);
+    g_error_free(error);
+    g_ptr_array_unref(preload->paths);
+    g_free(preload);
+    return;
+  }
+  g_thread_unref(thread);
+}
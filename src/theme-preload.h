@@ -0,0 +1,8 @@
+#ifndef THEME_PRELOAD_H
+#define THEME_PRELOAD_H 1
+
+#include <glib.h>
+
+void theme_preload_start(GPtrArray *paths);
+
+#endif
@@ -4,64 +4,58 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <webkit/webkit.h>
-#include <yaml.h>
 
+#include "content-filter.h"
 #include "logger.h"
+#include "scheme.h"
+#include "settings-loader.h"
+#include "storage-migration.h"
+#include "theme-bundle.h"
+#include "theme-index.h"
+#include "theme-preload.h"
+#include "theme.h"
+#include "watchdog.h"
 #include "settings.h"
 
 #include "browser.h"
 
 extern GreeterConfig *greeter_config;
 
-char *theme_dir = NULL;
-
 #define WEB_GREETER_THEMES_PATH "/usr/share/web-greeter/themes/"
 
-static gint
-sort_ptr_array(gconstpointer a, gconstpointer b)
-{
-  const char *entry1 = *((char **) a);
-  const char *entry2 = *((char **) b);
-
-  char *entry1_f = g_utf8_casefold(entry1, strlen(entry1));
-  char *entry2_f = g_utf8_casefold(entry2, strlen(entry2));
+static GPtrArray *theme_index = NULL;
+static char *theme_index_dir = NULL;
 
-  const gboolean value = strcmp(entry1_f, entry2_f) > 0;
-
-  g_free(entry1_f);
-  g_free(entry2_f);
-
-  return value;
+/**
+ * Gets the index of the themes installed in themes_dir
+ * It is loaded once, and kept while the same directory is requested
+ */
+static GPtrArray *
+get_theme_index(const char *themes_dir)
+{
+  if (theme_index != NULL && g_strcmp0(theme_index_dir, themes_dir) == 0)
+    return theme_index;
+
+  if (theme_index != NULL)
+    g_ptr_array_unref(theme_index);
+  g_free(theme_index_dir);
+  theme_index = theme_index_load(themes_dir);
+  theme_index_dir = g_strdup(themes_dir);
+  return theme_index;
 }
 
+/**
+ * Lists the installed themes
+ * @Returns An array of ThemeIndexEntry owned by the theme index, or NULL
+ */
 GPtrArray *
 list_themes(void)
 {
-  DIR *dir;
-  struct dirent *ent;
-  dir = opendir(WEB_GREETER_THEMES_PATH);
-  if (dir == NULL) {
+  GPtrArray *themes = get_theme_index(WEB_GREETER_THEMES_PATH);
+  if (themes == NULL) {
     printf("There are no themes located at %s\n", WEB_GREETER_THEMES_PATH);
     return NULL;
   }
-
-  GPtrArray *themes = g_ptr_array_new();
-
-  while ((ent = readdir(dir)) != NULL) {
-    char *file_name = ent->d_name;
-    if (g_strcmp0(file_name, ".") == 0 || g_strcmp0(file_name, "..") == 0) {
-      continue;
-    }
-    char *file_path = g_build_path("/", WEB_GREETER_THEMES_PATH, file_name, NULL);
-    struct stat file_stat;
-    stat(file_path, &file_stat);
-    if (S_ISDIR(file_stat.st_mode)) {
-      g_ptr_array_add(themes, file_name);
-    }
-  }
-
-  g_ptr_array_sort(themes, sort_ptr_array);
-
   return themes;
 }
 
@@ -75,239 +69,449 @@ print_themes(void)
   printf("Themes are located in %s\n\n", WEB_GREETER_THEMES_PATH);
 
   for (uint i = 0; i < themes->len; i++) {
-    char *theme = themes->pdata[i];
-    printf("- %s\n", theme);
+    ThemeIndexEntry *theme = themes->pdata[i];
+    printf("- %s%s\n", theme->name, theme->is_bundle ? " (bundle)" : "");
   }
-
-  g_ptr_array_free(themes, true);
 }
 
 /**
- * Loads the theme directory
+ * Packs a theme directory into "<dir>.bundle"
+ * @Returns The exit status
  */
-char *
-load_theme_dir(void)
+int
+bundle_theme(const char *dir, gboolean compress)
 {
-  const char *theme = greeter_config->greeter->theme;
-  const char *dir = greeter_config->app->theme_dir;
-  const char *def_theme = "gruvbox";
+  char *theme_path = g_strdup(dir);
+  while (strlen(theme_path) > 1 && g_str_has_suffix(theme_path, "/"))
+    theme_path[strlen(theme_path) - 1] = '\0';
 
-  char *final_dir = NULL;
+  char *output = g_strconcat(theme_path, THEME_BUNDLE_SUFFIX, NULL);
+  GError *error = NULL;
+  int status = 0;
 
-  if (g_str_has_prefix(theme, "/")) {
-    g_free(final_dir);
-    final_dir = g_strdup(theme);
-  } else if (strstr(theme, ".") || strstr(theme, "/")) {
-    g_free(final_dir);
-    final_dir = g_build_path("/", getcwd(NULL, 0), theme, NULL);
+  if (theme_bundle_write(theme_path, output, compress, &error)) {
+    printf("Theme bundle written to %s\n", output);
   } else {
-    final_dir = g_build_path("/", dir, theme, NULL);
+    fprintf(stderr, "Could not bundle \"%s\": %s\n", theme_path, error->message);
+    g_error_free(error);
+    status = 1;
   }
 
-  if (g_str_has_suffix(final_dir, ".html")) {
-    char *dirname = g_path_get_dirname(final_dir);
-    g_free(final_dir);
-    final_dir = dirname;
-  }
+  g_free(theme_path);
+  g_free(output);
+  return status;
+}
 
-  if (access(final_dir, F_OK) != 0) {
-    logger_warn("\"%s\" theme does not exists. Using \"%s\" theme", theme, def_theme);
-    g_free(final_dir);
-    final_dir = g_build_path("/", dir, def_theme, NULL);
-  }
+/**
+ * Reads the entry points and the preload list of an index.yml document into theme
+ * Keys missing from the document are left untouched
+ */
+gboolean
+read_theme_config(const char *data, size_t size, GreeterConfigTheme *theme)
+{
+  const SettingsField fields[] = {
+    { "primary_html", SETTINGS_FIELD_STRING, &theme->primary_html },
+    { "secondary_html", SETTINGS_FIELD_STRING, &theme->secondary_html },
+    { "preload", SETTINGS_FIELD_STRV, &theme->preload },
+  };
+  return settings_loader_load_data("index.yml", data, size, fields, G_N_ELEMENTS(fields));
+}
+
+/**
+ * Opens the theme bundle at path, reusing the one served by the scheme
+ * @Returns The bundle, or NULL if path is not a theme bundle
+ */
+static ThemeBundle *
+open_theme_bundle(const char *path)
+{
+  ThemeBundle *current = scheme_get_theme_bundle();
+  if (current != NULL && g_strcmp0(theme_bundle_get_path(current), path) == 0)
+    return current;
+
+  if (!theme_bundle_is_bundle(path))
+    return NULL;
 
-  g_free(theme_dir);
-  theme_dir = final_dir;
-  return theme_dir;
+  g_autoptr(GError) error = NULL;
+  ThemeBundle *bundle = theme_bundle_open(path, &error);
+  if (bundle == NULL)
+    logger_warn("Theme bundle was not loaded:\n\t%s", error->message);
+  return bundle;
 }
 
 /**
- * Loads the primary theme path
- * The provided theme with `--theme` flag is preferred over index.yml
+ * Get the path of a file relative to dir, or NULL if it is not inside dir
  */
-char *
-load_primary_theme_path(void)
+static const char *
+theme_relative_path(const char *dir, const char *path)
 {
-  if (!theme_dir)
-    load_theme_dir();
+  size_t length = strlen(dir);
+  if (strncmp(path, dir, length) != 0 || path[length] != '/')
+    return NULL;
+  return path + length + 1;
+}
 
-  const char *theme = greeter_config->greeter->theme;
-  char *theme_name = g_path_get_basename(theme);
-  const char *dir = greeter_config->app->theme_dir;
+/**
+ * Whether a file of the theme exists, either in its bundle, in the fallback theme or in the filesystem
+ */
+static gboolean
+theme_path_exists(const ThemeDescriptor *descriptor, const char *path)
+{
+  const char *relative = theme_relative_path(descriptor->dir, path);
+  if (descriptor->bundle != NULL)
+    return relative != NULL && theme_bundle_contains(descriptor->bundle, relative);
+  if (descriptor->is_fallback)
+    return g_resources_get_info(path, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL, NULL, NULL);
+  return access(path, F_OK) == 0;
+}
 
-  const char *def_theme = "gruvbox";
+/**
+ * Build the URI a web view loads a file of the theme from
+ */
+static char *
+theme_uri_new(const ThemeDescriptor *descriptor, const char *path)
+{
+  const char *relative = theme_relative_path(descriptor->dir, path);
+  if (descriptor->bundle != NULL && relative != NULL)
+    return scheme_bundle_uri_new(relative);
+  if (descriptor->is_fallback && relative != NULL)
+    return scheme_fallback_uri_new(relative);
+  return scheme_theme_uri_new(path);
+}
+
+static void
+theme_descriptor_free(ThemeDescriptor *descriptor)
+{
+  if (descriptor == NULL)
+    return;
+  // The bundle served by the scheme is released when it is replaced
+  if (descriptor->bundle != NULL && descriptor->bundle != scheme_get_theme_bundle())
+    theme_bundle_free(descriptor->bundle);
+  g_free(descriptor->dir);
+  g_free(descriptor->primary_path);
+  g_free(descriptor->secondary_path);
+  g_free(descriptor->primary_uri);
+  g_free(descriptor->secondary_uri);
+  g_strfreev(descriptor->preload);
+  g_free(descriptor);
+}
+
+/**
+ * Reads the index.yml of a theme into config
+ * Indexed themes are not parsed again
+ */
+static void
+load_theme_config(const ThemeDescriptor *descriptor, GreeterConfigTheme *config)
+{
+  ThemeIndexEntry *entry = theme_index_lookup_path(get_theme_index(greeter_config->app->theme_dir), descriptor->dir);
+  if (entry != NULL) {
+    g_free(config->primary_html);
+    config->primary_html = g_strdup(entry->primary_html);
+    config->secondary_html = g_strdup(entry->secondary_html);
+    config->preload = g_strdupv(entry->preload);
+    return;
+  }
 
-  if (g_str_has_suffix(theme_name, ".html")) {
-    g_free(greeter_config->theme->primary_html);
-    greeter_config->theme->primary_html = g_strdup(theme_name);
+  g_autoptr(GBytes) config_bytes = NULL;
+  if (descriptor->bundle != NULL) {
+    config_bytes = theme_bundle_lookup(descriptor->bundle, "index.yml");
+  } else {
+    char *path_to_theme_config = g_build_path("/", descriptor->dir, "index.yml", NULL);
+    char *contents = NULL;
+    gsize length = 0;
+    if (g_file_get_contents(path_to_theme_config, &contents, &length, NULL))
+      config_bytes = g_bytes_new_take(contents, length);
+    g_free(path_to_theme_config);
   }
-  g_free(theme_name);
 
-  const char *primary = greeter_config->theme->primary_html;
-  char *path_to_theme = g_build_path("/", theme_dir, primary, NULL);
+  if (config_bytes == NULL) {
+    logger_warn("Theme config was not loaded:\n\t%s", "index.yml not found");
+  } else {
+    gsize size = 0;
+    const char *data = g_bytes_get_data(config_bytes, &size);
+    if (!read_theme_config(data, size, config))
+      logger_warn("Theme config was not loaded:\n\t%s", "could not initialize the YAML parser");
+  }
+}
 
+/**
+ * Builds the full path of an entry point of the theme
+ */
+static char *
+theme_entry_point_new(const char *dir, const char *html)
+{
+  char *path_to_theme = g_build_path("/", dir, html, NULL);
   if (!g_str_has_suffix(path_to_theme, ".html")) {
     char *to_index = g_build_path("/", path_to_theme, "index.html", NULL);
     g_free(path_to_theme);
     path_to_theme = to_index;
   }
-
-  if (access(path_to_theme, F_OK) != 0) {
-    logger_warn("\"%s\" theme does not exists. Using \"%s\" theme", path_to_theme, def_theme);
-    g_free(path_to_theme);
-    path_to_theme = g_build_path("/", dir, def_theme, "index.html", NULL);
-  }
-
-  g_free(greeter_config->greeter->theme);
-  greeter_config->greeter->theme = g_strdup(path_to_theme);
   return path_to_theme;
 }
 
 /**
- * Loads the secondary theme path
- * This can only be set with index.yml, either it defaults to primary html
+ * Builds the descriptor of the embedded fallback theme
+ * It is served from the sea-greeter resources, so it is always available
  */
-char *
-load_secondary_theme_path(void)
+static ThemeDescriptor *
+theme_descriptor_new_fallback(void)
 {
-  if (!theme_dir)
-    load_theme_dir();
+  ThemeDescriptor *descriptor = g_malloc0(sizeof *descriptor);
+  descriptor->dir = g_strdup(SCHEME_FALLBACK_RESOURCE);
+  descriptor->is_fallback = true;
+  descriptor->primary_path = theme_entry_point_new(descriptor->dir, "index.html");
+  descriptor->secondary_path = g_strdup(descriptor->primary_path);
+  descriptor->primary_uri = theme_uri_new(descriptor, descriptor->primary_path);
+  descriptor->secondary_uri = g_strdup(descriptor->primary_uri);
+  return descriptor;
+}
 
-  const char *primary = greeter_config->theme->primary_html;
-  const char *secondary = greeter_config->theme->secondary_html;
-  char *path_to_theme = g_build_path("/", theme_dir, secondary != NULL ? secondary : primary, NULL);
+/**
+ * Resolves a theme, given as a name, a directory, a bundle or an html file
+ * @Returns The descriptor, or NULL if the theme or its primary html do not exist
+ */
+static ThemeDescriptor *
+theme_descriptor_new(const char *theme)
+{
+  const char *themes_dir = greeter_config->app->theme_dir;
 
-  if (!g_str_has_suffix(path_to_theme, ".html")) {
-    char *to_index = g_build_path("/", path_to_theme, "index.html", NULL);
-    g_free(path_to_theme);
-    path_to_theme = to_index;
+  if (g_str_has_prefix(theme, SCHEME_FALLBACK_RESOURCE))
+    return theme_descriptor_new_fallback();
+
+  char *final_dir = NULL;
+  if (g_str_has_prefix(theme, "/")) {
+    final_dir = g_strdup(theme);
+  } else if (strstr(theme, ".") || strstr(theme, "/")) {
+    char *cwd = g_get_current_dir();
+    final_dir = g_build_path("/", cwd, theme, NULL);
+    g_free(cwd);
+  } else {
+    ThemeIndexEntry *entry = theme_index_lookup(get_theme_index(themes_dir), theme);
+    if (entry != NULL)
+      final_dir = g_strdup(entry->path);
+    else
+      final_dir = g_build_path("/", themes_dir, theme, NULL);
   }
 
-  if (access(path_to_theme, F_OK) != 0) {
-    logger_warn("\"%s\" does not exists. Using \"%s\" for secondary monitors", path_to_theme, primary);
-    g_free(path_to_theme);
-    path_to_theme = load_primary_theme_path();
+  ThemeDescriptor *descriptor = g_malloc0(sizeof *descriptor);
+  descriptor->bundle = open_theme_bundle(final_dir);
+
+  // The provided theme with `--theme` flag is preferred over index.yml
+  char *primary_override = NULL;
+  if (descriptor->bundle == NULL && g_str_has_suffix(final_dir, ".html")) {
+    primary_override = g_path_get_basename(final_dir);
+    char *dirname = g_path_get_dirname(final_dir);
+    g_free(final_dir);
+    final_dir = dirname;
   }
+  descriptor->dir = final_dir;
 
-  return path_to_theme;
+  if (descriptor->bundle == NULL && access(descriptor->dir, F_OK) != 0) {
+    logger_warn("\"%s\" theme does not exists", theme);
+    g_free(primary_override);
+    theme_descriptor_free(descriptor);
+    return NULL;
+  }
+
+  GreeterConfigTheme config = { .primary_html = g_strdup("index.html"), .secondary_html = NULL, .preload = NULL };
+  load_theme_config(descriptor, &config);
+  if (primary_override != NULL) {
+    g_free(config.primary_html);
+    config.primary_html = primary_override;
+  }
+  descriptor->preload = config.preload;
+
+  descriptor->primary_path = theme_entry_point_new(descriptor->dir, config.primary_html);
+  if (!theme_path_exists(descriptor, descriptor->primary_path)) {
+    logger_warn("\"%s\" theme does not exists", descriptor->primary_path);
+    g_free(config.primary_html);
+    g_free(config.secondary_html);
+    theme_descriptor_free(descriptor);
+    return NULL;
+  }
+
+  // The secondary html can only be set with index.yml, either it defaults to primary html
+  if (config.secondary_html != NULL) {
+    descriptor->secondary_path = theme_entry_point_new(descriptor->dir, config.secondary_html);
+    if (!theme_path_exists(descriptor, descriptor->secondary_path)) {
+      logger_warn(
+          "\"%s\" does not exists. Using \"%s\" for secondary monitors",
+          descriptor->secondary_path,
+          config.primary_html);
+      g_clear_pointer(&descriptor->secondary_path, g_free);
+    }
+  }
+  if (descriptor->secondary_path == NULL)
+    descriptor->secondary_path = g_strdup(descriptor->primary_path);
+
+  descriptor->primary_uri = theme_uri_new(descriptor, descriptor->primary_path);
+  descriptor->secondary_uri = theme_uri_new(descriptor, descriptor->secondary_path);
+
+  g_free(config.primary_html);
+  g_free(config.secondary_html);
+  return descriptor;
 }
 
-enum storage_flags { VAR, VAL, SEQ };
+static ThemeDescriptor *theme_descriptor = NULL;
 
+/**
+ * Makes descriptor the current theme and serves its bundle, if any
+ */
 static void
-process_layer(yaml_parser_t *parser, GNode *data)
+set_theme_descriptor(ThemeDescriptor *descriptor)
 {
-  GNode *last_leaf = data;
-  yaml_event_t event;
-  int storage = VAR;
-
-  while (1) {
-    yaml_parser_parse(parser, &event);
-
-    if (event.type == YAML_SCALAR_EVENT) {
-      if (storage)
-        g_node_append_data(last_leaf, g_strdup((gchar *) event.data.scalar.value));
-      else
-        last_leaf = g_node_append(data, g_node_new(g_strdup((gchar *) event.data.scalar.value)));
-      storage ^= VAL;
-    } else if (event.type == YAML_SEQUENCE_START_EVENT)
-      storage = SEQ;
-    else if (event.type == YAML_SEQUENCE_END_EVENT)
-      storage = VAR;
-    else if (event.type == YAML_MAPPING_START_EVENT) {
-      process_layer(parser, last_leaf);
-      storage ^= VAL;
-    } else if (event.type == YAML_MAPPING_END_EVENT || event.type == YAML_STREAM_END_EVENT)
-      break;
-
-    yaml_event_delete(&event);
-  }
+  ThemeDescriptor *previous = theme_descriptor;
+  theme_descriptor = descriptor;
+  // The scheme owns the served bundle, and frees the previous one when it is replaced
+  scheme_set_theme_bundle(descriptor->bundle);
+  if (previous != NULL)
+    previous->bundle = NULL;
+  theme_descriptor_free(previous);
 }
 
-static gboolean
-node_free(GNode *node, gpointer data)
+/**
+ * Resolves the configured theme once, falling back to "gruvbox" and then to the embedded fallback theme
+ * Browsers load and reload the resolved theme, so filesystem probing is not repeated per monitor
+ */
+const ThemeDescriptor *
+resolve_theme(void)
 {
-  (void) data;
-  char *str = node->data;
-  if (str != NULL) {
-    g_free(str);
-    node->data = NULL;
+  WATCHDOG_SCOPE("resolve_theme");
+  const char *theme = greeter_config->greeter->theme;
+  const char *def_theme = "gruvbox";
+
+  ThemeDescriptor *descriptor = theme_descriptor_new(theme);
+  if (descriptor == NULL && g_strcmp0(theme, def_theme) != 0) {
+    logger_warn("Using \"%s\" theme", def_theme);
+    descriptor = theme_descriptor_new(def_theme);
   }
-  return false;
+  if (descriptor == NULL) {
+    logger_warn("Using the fallback theme");
+    descriptor = theme_descriptor_new_fallback();
+  }
+
+  set_theme_descriptor(descriptor);
+  return theme_descriptor;
+}
+
+/**
+ * Gets the resolved theme, resolving it if needed
+ */
+const ThemeDescriptor *
+get_theme_descriptor(void)
+{
+  if (theme_descriptor == NULL)
+    return resolve_theme();
+  return theme_descriptor;
 }
 
+/**
+ * Makes the embedded fallback theme the current theme
+ */
 void
-load_theme_config(void)
+use_fallback_theme(void)
 {
-  if (!theme_dir)
-    theme_dir = load_theme_dir();
+  set_theme_descriptor(theme_descriptor_new_fallback());
+}
 
-  char *path_to_theme_config = g_build_path("/", theme_dir, "index.yml", NULL);
-  FILE *file = fopen(path_to_theme_config, "rb");
-  yaml_parser_t parser;
+/**
+ * Reads ahead the theme files and the branding images in the background,
+ * while the web process starts
+ * Only the files listed in the "preload" key of index.yml are read when it is set
+ */
+void
+preload_theme(void)
+{
+  WATCHDOG_SCOPE("preload_theme");
+  const ThemeDescriptor *descriptor = get_theme_descriptor();
+  if (descriptor->is_fallback)
+    return;
 
-  if (!yaml_parser_initialize(&parser) || file == NULL) {
-    logger_warn("Theme config was not loaded:\n\t%s", strerror(errno));
-  }
+  GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+  char **preload = descriptor->preload;
 
-  yaml_parser_set_input_file(&parser, file);
-
-  GNode *cfg = g_node_new(g_strdup(path_to_theme_config));
-  process_layer(&parser, cfg);
-
-  yaml_parser_delete(&parser);
-  fclose(file);
-
-  GNode *node = cfg->children;
-
-  do {
-    /*printf("'%s'\n", (char *) node->data);*/
-    if (g_strcmp0(node->data, "primary_html") == 0) {
-      GNode *children = node->children;
-      if (children != NULL) {
-        char *value = children->data;
-        greeter_config->theme->primary_html = g_strdup(value);
-      }
-    } else if (g_strcmp0(node->data, "secondary_html") == 0) {
-      GNode *children = node->children;
-      if (children != NULL) {
-        char *value = children->data;
-        greeter_config->theme->secondary_html = g_strdup(value);
-      }
+  if (preload != NULL && descriptor->bundle == NULL) {
+    for (guint i = 0; preload[i] != NULL; i++) {
+      g_ptr_array_add(paths, g_build_path("/", descriptor->dir, preload[i], NULL));
     }
-    node = node->next;
-  } while (node != NULL);
+  } else {
+    g_ptr_array_add(paths, g_strdup(descriptor->dir));
+  }
 
-  g_node_traverse(cfg, G_PRE_ORDER, G_TRAVERSE_ALL, -1, node_free, NULL);
-  g_node_destroy(cfg);
+  GreeterConfigBranding *branding = greeter_config->branding;
+  if (branding->logo_image != NULL)
+    g_ptr_array_add(paths, g_strdup(branding->logo_image));
+  if (branding->user_image != NULL)
+    g_ptr_array_add(paths, g_strdup(branding->user_image));
+  if (branding->background_images_dir != NULL)
+    g_ptr_array_add(paths, g_strdup(branding->background_images_dir));
 
-  g_free(path_to_theme_config);
+  theme_preload_start(paths);
 }
 
-void
-load_theme(Browser *browser)
+/*
+ * Loads wait while something the pages depend on is being prepared, like
+ * the secure mode content filter. The snapshot is shown meanwhile.
+ */
+static guint theme_load_holds = 0;
+static GPtrArray *pending_theme_loads = NULL;
+
+static void
+load_theme_uri(Browser *browser)
 {
   WebKitWebView *web_view = WEBKIT_WEB_VIEW(browser->web_view);
+  const ThemeDescriptor *descriptor = get_theme_descriptor();
 
-  load_theme_dir();
-  char *primary_html = load_primary_theme_path();
-  char *secondary_html = load_secondary_theme_path();
+  WebKitUserContentManager *manager = webkit_web_view_get_user_content_manager(web_view);
+  content_filter_attach(manager);
+  storage_migration_attach(manager);
 
-  char *theme = NULL;
+  const char *uri = browser->is_primary ? descriptor->primary_uri : descriptor->secondary_uri;
+  webkit_web_view_load_uri(web_view, uri);
 
-  if (browser->is_primary) {
-    theme = g_strdup(primary_html);
-  } else {
-    theme = g_strdup(secondary_html);
+  logger_debug("Theme loaded");
+}
+
+/**
+ * Keep load_theme from loading pages until release_theme_loads()
+ */
+void
+hold_theme_loads(void)
+{
+  theme_load_holds++;
+}
+
+/**
+ * Load the pages held back, once nothing holds them anymore
+ */
+void
+release_theme_loads(void)
+{
+  if (theme_load_holds == 0 || --theme_load_holds > 0 || pending_theme_loads == NULL)
+    return;
+
+  g_autoptr(GPtrArray) browsers = g_steal_pointer(&pending_theme_loads);
+  for (guint i = 0; i < browsers->len; i++) {
+    load_theme_uri(browsers->pdata[i]);
   }
+}
+
+void
+load_theme(Browser *browser)
+{
+  WATCHDOG_SCOPE("load_theme");
+  const ThemeDescriptor *descriptor = get_theme_descriptor();
 
-  g_free(primary_html);
-  g_free(secondary_html);
+  const char *uri = browser->is_primary ? descriptor->primary_uri : descriptor->secondary_uri;
+  const char *path = browser->is_primary ? descriptor->primary_path : descriptor->secondary_path;
+  browser_show_snapshot(browser, uri, path);
 
-  char *uri = g_strconcat("file://", theme, NULL);
-  webkit_web_view_load_uri(web_view, uri);
-  g_free(uri);
-  g_free(theme);
+  if (theme_load_holds == 0) {
+    load_theme_uri(browser);
+    return;
+  }
 
-  logger_debug("Theme loaded");
+  if (pending_theme_loads == NULL)
+    pending_theme_loads = g_ptr_array_new_with_free_func(g_object_unref);
+  if (!g_ptr_array_find(pending_theme_loads, browser, NULL))
+    g_ptr_array_add(pending_theme_loads, g_object_ref(browser));
 }
@@ -2,10 +2,34 @@
 #define THEME_H 1
 
 #include "browser.h"
+#include "settings.h"
+#include "theme-bundle.h"
+
+/**
+ * A theme resolved once, shared by every browser
+ */
+typedef struct {
+  char *dir;
+  char *primary_path;
+  char *secondary_path;
+  char *primary_uri;
+  char *secondary_uri;
+  char **preload;
+  ThemeBundle *bundle;
+  gboolean is_fallback;
+} ThemeDescriptor;
 
 GPtrArray *list_themes(void);
 void print_themes(void);
-void load_theme_config(void);
+int bundle_theme(const char *dir, gboolean compress);
+gboolean read_theme_config(const char *data, size_t size, GreeterConfigTheme *theme);
+
+const ThemeDescriptor *resolve_theme(void);
+const ThemeDescriptor *get_theme_descriptor(void);
+void use_fallback_theme(void);
+void preload_theme(void);
 void load_theme(Browser *browser);
+void hold_theme_loads(void);
+void release_theme_loads(void);
 
 #endif
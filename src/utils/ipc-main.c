@@ -3,11 +3,8 @@
 #include <glib.h>
 #include <unistd.h>
 
-#include <jsc/jsc.h>
 #include <webkit/webkit.h>
 
-#include "utils/utils.h"
-
 typedef struct {
   gboolean received;
   WebKitUserMessage *message;
@@ -58,20 +55,30 @@ ipc_main_send_message_sync(WebKitWebView *web_view, WebKitUserMessage *message)
  * @param callback A callback
  */
 void
-ipc_renderer_send_message(WebKitWebView *web_view, WebKitUserMessage *message, GAsyncReadyCallback callback)
+ipc_main_send_message(WebKitWebView *web_view, WebKitUserMessage *message, GAsyncReadyCallback callback)
 {
   webkit_web_view_send_message_to_page(web_view, message, NULL, callback, NULL);
 }
 
+/**
+ * Sends a message to web_page synchronously with arguments
+ *
+ * @param web_view A WebKitWebView
+ * @param object The object to access
+ * @param target The target property/method to call
+ * @param arguments An "av" GVariant with the parameters, or NULL
+ * @Returns The received response from web_page
+ */
 WebKitUserMessage *
 ipc_main_send_message_sync_with_arguments(
     WebKitWebView *web_view,
-    JSCContext *jsc_context,
     const char *object,
     const char *target,
-    GPtrArray *arguments)
+    GVariant *arguments)
 {
-  GVariant *parameters = jsc_parameters_to_g_variant_array(jsc_context, target, arguments);
+  if (arguments == NULL)
+    arguments = g_variant_new_array(G_VARIANT_TYPE_VARIANT, NULL, 0);
+  GVariant *parameters = g_variant_new("(s@av)", target, arguments);
   WebKitUserMessage *message = webkit_user_message_new(object, parameters);
   WebKitUserMessage *reply = ipc_main_send_message_sync(web_view, message);
   return reply;
@@ -3,13 +3,12 @@
 
 #include <webkit/webkit.h>
 
-WebKitUserMessage *ipc_renderer_send_message_sync(WebKitWebView *web_view, WebKitUserMessage *message);
-void ipc_renderer_send_message(WebKitWebView *web_view, WebKitUserMessage *message, GAsyncReadyCallback callback);
-WebKitUserMessage *ipc_renderer_send_message_sync_with_arguments(
+WebKitUserMessage *ipc_main_send_message_sync(WebKitWebView *web_view, WebKitUserMessage *message);
+void ipc_main_send_message(WebKitWebView *web_view, WebKitUserMessage *message, GAsyncReadyCallback callback);
+WebKitUserMessage *ipc_main_send_message_sync_with_arguments(
     WebKitWebView *web_view,
-    JSCContext *jsc_context,
     const char *object,
     const char *target,
-    GPtrArray *arguments);
+    GVariant *arguments);
 
 #endif
@@ -37,8 +37,145 @@ jsc_array_to_g_ptr_array(JSCValue *jsc_array)
   return array;
 }
 
+#define JSC_VALUE_MAX_DEPTH 32
+
+static GVariant *
+jsc_value_to_g_variant_at_depth(JSCValue *value, guint depth)
+{
+  if (value == NULL || jsc_value_is_undefined(value) || jsc_value_is_null(value) || jsc_value_is_function(value)
+      || depth > JSC_VALUE_MAX_DEPTH)
+    return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+
+  if (jsc_value_is_boolean(value))
+    return g_variant_new_boolean(jsc_value_to_boolean(value));
+
+  if (jsc_value_is_number(value))
+    return g_variant_new_double(jsc_value_to_double(value));
+
+  if (jsc_value_is_string(value)) {
+    g_autofree gchar *str = jsc_value_to_string(value);
+    return g_variant_new_string(str);
+  }
+
+  if (jsc_value_is_array(value)) {
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("av"));
+
+    g_autoptr(JSCValue) jsc_length = jsc_value_object_get_property(value, "length");
+    int length = jsc_value_to_int32(jsc_length);
+    for (int i = 0; i < length; i++) {
+      g_autoptr(JSCValue) item = jsc_value_object_get_property_at_index(value, i);
+      g_variant_builder_add(&builder, "v", jsc_value_to_g_variant_at_depth(item, depth + 1));
+    }
+    return g_variant_builder_end(&builder);
+  }
+
+  if (jsc_value_is_object(value)) {
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+    g_auto(GStrv) properties = jsc_value_object_enumerate_properties(value);
+    for (guint i = 0; properties != NULL && properties[i] != NULL; i++) {
+      g_autoptr(JSCValue) item = jsc_value_object_get_property(value, properties[i]);
+      g_variant_builder_add(&builder, "{sv}", properties[i], jsc_value_to_g_variant_at_depth(item, depth + 1));
+    }
+    return g_variant_builder_end(&builder);
+  }
+
+  return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+}
+
 /**
- * Convert JSCValue parameters to GVariant
+ * Convert a JSCValue to a GVariant
+ * Objects become "a{sv}", arrays "av", numbers "d", and null or undefined
+ * values an empty "mv"
+ * @param value The JSCValue to convert
+ * @Returns A floating GVariant reference
+ */
+GVariant *
+jsc_value_to_g_variant(JSCValue *value)
+{
+  return jsc_value_to_g_variant_at_depth(value, 0);
+}
+
+/**
+ * Convert a GVariant to a JSCValue
+ * Dictionaries become objects, other arrays and tuples become arrays,
+ * and NULL or empty maybe values become null
+ * @param context The JSCContext
+ * @param variant The GVariant to convert
+ */
+JSCValue *
+g_variant_to_jsc_value(JSCContext *context, GVariant *variant)
+{
+  if (variant == NULL)
+    return jsc_value_new_null(context);
+
+  switch (g_variant_classify(variant)) {
+    case G_VARIANT_CLASS_VARIANT: {
+      g_autoptr(GVariant) inner = g_variant_get_variant(variant);
+      return g_variant_to_jsc_value(context, inner);
+    }
+    case G_VARIANT_CLASS_MAYBE: {
+      g_autoptr(GVariant) inner = g_variant_get_maybe(variant);
+      return g_variant_to_jsc_value(context, inner);
+    }
+    case G_VARIANT_CLASS_BOOLEAN:
+      return jsc_value_new_boolean(context, g_variant_get_boolean(variant));
+    case G_VARIANT_CLASS_BYTE:
+      return jsc_value_new_number(context, g_variant_get_byte(variant));
+    case G_VARIANT_CLASS_INT16:
+      return jsc_value_new_number(context, g_variant_get_int16(variant));
+    case G_VARIANT_CLASS_UINT16:
+      return jsc_value_new_number(context, g_variant_get_uint16(variant));
+    case G_VARIANT_CLASS_INT32:
+      return jsc_value_new_number(context, g_variant_get_int32(variant));
+    case G_VARIANT_CLASS_UINT32:
+      return jsc_value_new_number(context, g_variant_get_uint32(variant));
+    case G_VARIANT_CLASS_INT64:
+      return jsc_value_new_number(context, g_variant_get_int64(variant));
+    case G_VARIANT_CLASS_UINT64:
+      return jsc_value_new_number(context, g_variant_get_uint64(variant));
+    case G_VARIANT_CLASS_HANDLE:
+      return jsc_value_new_number(context, g_variant_get_handle(variant));
+    case G_VARIANT_CLASS_DOUBLE:
+      return jsc_value_new_number(context, g_variant_get_double(variant));
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE:
+      return jsc_value_new_string(context, g_variant_get_string(variant, NULL));
+    case G_VARIANT_CLASS_ARRAY:
+      if (g_variant_type_is_dict_entry(g_variant_type_element(g_variant_get_type(variant)))) {
+        JSCValue *object = jsc_value_new_object(context, NULL, NULL);
+        gsize n_children = g_variant_n_children(variant);
+        for (gsize i = 0; i < n_children; i++) {
+          g_autoptr(GVariant) entry = g_variant_get_child_value(variant, i);
+          g_autoptr(GVariant) key = g_variant_get_child_value(entry, 0);
+          g_autoptr(GVariant) item = g_variant_get_child_value(entry, 1);
+          if (!g_variant_is_of_type(key, G_VARIANT_TYPE_STRING))
+            continue;
+          g_autoptr(JSCValue) jsc_item = g_variant_to_jsc_value(context, item);
+          jsc_value_object_set_property(object, g_variant_get_string(key, NULL), jsc_item);
+        }
+        return object;
+      }
+      /* fall through */
+    case G_VARIANT_CLASS_TUPLE: {
+      gsize n_children = g_variant_n_children(variant);
+      g_autoptr(GPtrArray) items = g_ptr_array_new_full(n_children, jsc_g_ptr_array_free);
+      for (gsize i = 0; i < n_children; i++) {
+        g_autoptr(GVariant) item = g_variant_get_child_value(variant, i);
+        g_ptr_array_add(items, g_variant_to_jsc_value(context, item));
+      }
+      return jsc_value_new_array_from_garray(context, items);
+    }
+    default:
+      return jsc_value_new_null(context);
+  }
+}
+
+/**
+ * Convert JSCValue parameters to a "(sav)" GVariant
  * @param context The JSCContext
  * @param name Custom string to send, useful to execute a "name" method with given parameters
  * @param parameters A GPtrArray of JSCValue parameters
@@ -46,23 +183,15 @@ jsc_array_to_g_ptr_array(JSCValue *jsc_array)
 GVariant *
 jsc_parameters_to_g_variant_array(JSCContext *context, const gchar *name, GPtrArray *parameters)
 {
-  JSCValue *jsc_params;
-  if (parameters == NULL) {
-    jsc_params = jsc_value_new_array(context, G_TYPE_NONE);
-  } else {
-    jsc_params = jsc_value_new_array_from_garray(context, parameters);
-  }
-  char *json_params = jsc_value_to_json(jsc_params, 0);
-  GVariant *name_p = g_variant_new_string(name);
-  GVariant *params = g_variant_new_string(json_params);
+  (void) context;
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("av"));
 
-  GVariant *param_arr[] = { name_p, params };
-
-  GVariant *result = g_variant_new_array(G_VARIANT_TYPE_STRING, param_arr, G_N_ELEMENTS(param_arr));
+  for (guint i = 0; parameters != NULL && i < parameters->len; i++) {
+    g_variant_builder_add(&builder, "v", jsc_value_to_g_variant(parameters->pdata[i]));
+  }
 
-  g_free(json_params);
-  g_object_unref(jsc_params);
-  return result;
+  return g_variant_new("(s@av)", name, g_variant_builder_end(&builder));
 }
 
 JSCValue *
@@ -71,9 +200,9 @@ g_variant_reply_to_jsc_value(JSCContext *context, GVariant *reply)
   if (reply == NULL) {
     return NULL;
   }
-  const gchar *json_value = g_variant_get_string(reply, NULL);
-  JSCValue *value = jsc_value_new_from_json(context, json_value);
+  JSCValue *value = g_variant_to_jsc_value(context, reply);
   if (jsc_value_is_null(value)) {
+    g_object_unref(value);
     return NULL;
   }
   return value;
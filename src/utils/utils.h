@@ -8,6 +8,9 @@ const char *g_variant_to_string(GVariant *variant);
 
 GPtrArray *jsc_array_to_g_ptr_array(JSCValue *jsc_array);
 
+GVariant *jsc_value_to_g_variant(JSCValue *value);
+JSCValue *g_variant_to_jsc_value(JSCContext *context, GVariant *variant);
+
 GVariant *jsc_parameters_to_g_variant_array(JSCContext *context, const gchar *name, GPtrArray *parameters);
 JSCValue *g_variant_reply_to_jsc_value(JSCContext *context, GVariant *reply);
 
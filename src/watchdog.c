@@ -0,0 +1,187 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "logger.h"
+#include "watchdog.h"
+
+/*
+ * A high priority heartbeat runs on the main context, and measures how late
+ * it is dispatched. Handlers mark what they run with WATCHDOG_SCOPE, so a
+ * stall is logged with the scope that took too long, or with the scope seen
+ * running by the watcher thread. The watcher also logs a main loop that
+ * stays blocked, before it ever returns.
+ * The watchdog only runs in debug mode, or when
+ * SEA_GREETER_WATCHDOG_THRESHOLD sets the stall threshold in ms, 0 disabling
+ * it even in debug mode.
+ */
+#define WATCHDOG_INTERVAL 100
+#define WATCHDOG_DEFAULT_THRESHOLD 250
+#define WATCHDOG_BLOCKED_FACTOR 8
+#define WATCHDOG_MAX_DEPTH 8
+#define WATCHDOG_NAME_MAX 128
+
+struct _WatchdogScope {
+  char name[WATCHDOG_NAME_MAX];
+  gint64 start;
+};
+
+static gint64 watchdog_threshold = 0;
+static GThread *main_thread = NULL;
+static GThread *watcher = NULL;
+static guint heartbeat_id = 0;
+
+static GMutex watchdog_mutex;
+static GCond watchdog_cond;
+static gboolean watchdog_running = false;
+static WatchdogScope scopes[WATCHDOG_MAX_DEPTH];
+static guint depth = 0;
+static gint64 last_beat = 0;
+static char stall_culprit[WATCHDOG_NAME_MAX];
+static gboolean stall_reported = false;
+
+static gboolean
+watchdog_heartbeat_cb(gpointer user_data)
+{
+  (void) user_data;
+  gint64 now = g_get_monotonic_time();
+  char culprit[WATCHDOG_NAME_MAX];
+
+  g_mutex_lock(&watchdog_mutex);
+  gint64 late = now - last_beat - WATCHDOG_INTERVAL * G_TIME_SPAN_MILLISECOND;
+  g_strlcpy(culprit, stall_culprit, sizeof culprit);
+  last_beat = now;
+  stall_culprit[0] = '\0';
+  stall_reported = false;
+  g_mutex_unlock(&watchdog_mutex);
+
+  if (late <= watchdog_threshold)
+    return G_SOURCE_CONTINUE;
+
+  if (culprit[0] != '\0') {
+    logger_warn("Main loop stalled for %" G_GINT64_FORMAT " ms, in %s", late / G_TIME_SPAN_MILLISECOND, culprit);
+  } else {
+    logger_warn("Main loop stalled for %" G_GINT64_FORMAT " ms", late / G_TIME_SPAN_MILLISECOND);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+static gpointer
+watchdog_watcher_thread(gpointer data)
+{
+  (void) data;
+
+  g_mutex_lock(&watchdog_mutex);
+  while (watchdog_running) {
+    gint64 now = g_get_monotonic_time();
+    gint64 blocked = now - last_beat - WATCHDOG_INTERVAL * G_TIME_SPAN_MILLISECOND;
+
+    if (blocked > watchdog_threshold && stall_culprit[0] == '\0' && depth > 0)
+      g_strlcpy(stall_culprit, scopes[depth - 1].name, sizeof stall_culprit);
+
+    if (blocked > watchdog_threshold * WATCHDOG_BLOCKED_FACTOR && !stall_reported) {
+      char culprit[WATCHDOG_NAME_MAX];
+      g_strlcpy(culprit, stall_culprit[0] != '\0' ? stall_culprit : "an unknown handler", sizeof culprit);
+      stall_reported = true;
+      g_mutex_unlock(&watchdog_mutex);
+      gint64 blocked_ms = blocked / G_TIME_SPAN_MILLISECOND;
+      logger_warn("Main loop blocked for %" G_GINT64_FORMAT " ms so far, in %s", blocked_ms, culprit);
+      g_mutex_lock(&watchdog_mutex);
+    }
+
+    g_cond_wait_until(&watchdog_cond, &watchdog_mutex, now + WATCHDOG_INTERVAL * G_TIME_SPAN_MILLISECOND);
+  }
+  g_mutex_unlock(&watchdog_mutex);
+  return NULL;
+}
+
+/**
+ * Mark the start of a handler on the main thread
+ * @Returns The scope to leave, or NULL when the watchdog is not running here
+ */
+WatchdogScope *
+watchdog_enter(const char *format, ...)
+{
+  if (main_thread == NULL || main_thread != g_thread_self())
+    return NULL;
+
+  g_mutex_lock(&watchdog_mutex);
+  if (depth >= WATCHDOG_MAX_DEPTH) {
+    g_mutex_unlock(&watchdog_mutex);
+    return NULL;
+  }
+  WatchdogScope *scope = &scopes[depth++];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(scope->name, sizeof scope->name, format, args);
+  va_end(args);
+  scope->start = g_get_monotonic_time();
+  g_mutex_unlock(&watchdog_mutex);
+  return scope;
+}
+
+/**
+ * Mark the end of a handler, which is blamed for the stall when it was slow
+ * The innermost slow handler is kept, as it left first
+ */
+void
+watchdog_leave(WatchdogScope *scope)
+{
+  gint64 duration = g_get_monotonic_time() - scope->start;
+
+  g_mutex_lock(&watchdog_mutex);
+  depth = scope - scopes;
+  if (duration > watchdog_threshold && stall_culprit[0] == '\0') {
+    snprintf(
+        stall_culprit,
+        sizeof stall_culprit,
+        "%s (%" G_GINT64_FORMAT " ms)",
+        scope->name,
+        duration / G_TIME_SPAN_MILLISECOND);
+  }
+  g_mutex_unlock(&watchdog_mutex);
+}
+
+/**
+ * Start watching the main context of the calling thread
+ * Without SEA_GREETER_WATCHDOG_THRESHOLD, it only starts in debug mode
+ */
+void
+watchdog_start(gboolean debug_mode)
+{
+  if (main_thread != NULL)
+    return;
+
+  gint64 threshold = debug_mode ? WATCHDOG_DEFAULT_THRESHOLD : 0;
+  const char *value = g_getenv("SEA_GREETER_WATCHDOG_THRESHOLD");
+  if (value != NULL)
+    threshold = g_ascii_strtoll(value, NULL, 10);
+  if (threshold <= 0)
+    return;
+
+  watchdog_threshold = threshold * G_TIME_SPAN_MILLISECOND;
+  main_thread = g_thread_self();
+  last_beat = g_get_monotonic_time();
+  watchdog_running = true;
+
+  heartbeat_id = g_timeout_add_full(G_PRIORITY_HIGH, WATCHDOG_INTERVAL, watchdog_heartbeat_cb, NULL, NULL);
+  watcher = g_thread_new("watchdog", watchdog_watcher_thread, NULL);
+}
+
+void
+watchdog_stop(void)
+{
+  if (watcher == NULL)
+    return;
+
+  g_mutex_lock(&watchdog_mutex);
+  watchdog_running = false;
+  g_cond_signal(&watchdog_cond);
+  g_mutex_unlock(&watchdog_mutex);
+
+  g_thread_join(watcher);
+  watcher = NULL;
+  g_source_remove(heartbeat_id);
+  heartbeat_id = 0;
+  main_thread = NULL;
+}
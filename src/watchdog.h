@@ -0,0 +1,20 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H 1
+
+#include <glib.h>
+
+typedef struct _WatchdogScope WatchdogScope;
+
+void watchdog_start(gboolean debug_mode);
+void watchdog_stop(void);
+
+WatchdogScope *watchdog_enter(const char *format, ...) G_GNUC_PRINTF(1, 2);
+void watchdog_leave(WatchdogScope *scope);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(WatchdogScope, watchdog_leave)
+
+/* Blame main loop stalls on the rest of the enclosing block */
+#define WATCHDOG_SCOPE(format, ...) \
+  G_GNUC_UNUSED g_autoptr(WatchdogScope) watchdog_scope = watchdog_enter(format, ##__VA_ARGS__)
+
+#endif